@@ -10,23 +10,26 @@ class Animation {
 private:
 	float m_duration;
 	float m_currentTime;
-	Object3D& m_object;
+	ObjectRef m_object;
 
 	/**
 	 * @brief Called when the animation is activated by an Animator.
 	 */
-	virtual void startAnimation() {}
+	virtual void startAnimation(Object3D& object) {}
 	/**
 	 * @brief Called when the animation is ticked by an Animator.
+	 * @param object the object being animated.
 	 * @param dt the change in time since the last tick.
 	 */
-	virtual void applyAnimation(float dt) = 0;
+	virtual void applyAnimation(Object3D& object, float dt) = 0;
 
 public:
-	Animation(Object3D& obj, float duration) : m_duration(duration),
-		m_currentTime(-1), m_object(obj) {
+	Animation(ObjectRef obj, float duration) : m_duration(duration),
+		m_currentTime(-1), m_object(std::move(obj)) {
 	}
 
+	virtual ~Animation() = default;
+
 	/**
 	* @brief The duration over which the animation is active.
 	*/
@@ -40,22 +43,27 @@ public:
 	/**
 	* @brief The object the animation is manipulating.
 	*/
-	Object3D& object() const { return m_object; }
+	const ObjectRef& object() const { return m_object; }
 
 	/**
-	* @brief Advances the animation by the given interval, in seconds.
+	* @brief Advances the animation by the given interval, in seconds. Time still passes if
+	* the object has been destroyed, but nothing is applied.
 	*/
-	void tick(float dt) {
+	void tick(ObjectPool& objects, float dt) {
 		m_currentTime += dt;
-		applyAnimation(dt);
+		if (Object3D* o = m_object.resolve(objects)) {
+			applyAnimation(*o, dt);
+		}
 	}
 
 	/**
 	 * @brief Starts the animation.
 	 */
-	void start() {
+	void start(ObjectPool& objects) {
 		m_currentTime = 0;
-		startAnimation();
+		if (Object3D* o = m_object.resolve(objects)) {
+			startAnimation(*o);
+		}
 	}
 
 };
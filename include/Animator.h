@@ -60,7 +60,8 @@ public:
 
 	/**
 	 * @brief Advance the animation sequence by the given time interval, in seconds.
+	 * @param objects the pool holding the animated objects.
 	 */
-	void tick(float dt);
+	void tick(float dt, ObjectPool& objects);
 
 };
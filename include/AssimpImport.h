@@ -1,12 +1,18 @@
 #pragma once
 #include "Mesh3D.h"
+#include "MeshRegistry.h"
 #include "Object3D.h"
 #include <assimp/scene.h>
 #include <unordered_map>
 #include <filesystem>
 #include <string>
 
-Object3D assimpLoad(const std::string& path, bool flipUVCoords);
+/**
+ * @param keepGeometry whether every mesh keeps a CPU-side copy of its geometry, which
+ * ray casting and occlusion culling need.
+ */
+Object3D assimpLoad(const std::string& path, bool flipUVCoords, bool keepGeometry = false);
 Object3D processAssimpNode(aiNode* node, const aiScene* scene,
 	const std::filesystem::path& modelPath,
-	std::unordered_map<std::string, Texture>& loadedTextures);
+	std::unordered_map<std::string, Texture>& loadedTextures,
+	std::unordered_map<unsigned int, MeshHandle>& loadedMeshes, bool keepGeometry = false);
@@ -13,7 +13,7 @@ private:
 	/**
 	 * @brief Advance the animation by the given time interval.
 	 */
-	void applyAnimation(float dt) override {
+	void applyAnimation(Object3D& object, float dt) override {
         float t = currentTime() / duration();
         float invT = 1 - t;
 
@@ -39,13 +39,13 @@ private:
                         (3 * invT * tSquared * m_mid2Point.z) +
                         (tCubed * m_endPoint.z);
 
-        object().setPosition(bezierV);
+        object.setPosition(bezierV);
 	}
 
 public:
 	// BezierTranslationAnimation(Object3D& obj, float duration, const glm::vec3& mid1Point, const glm::vec3& mid2Point, const glm::vec3& totalMovement) :
 	// 	Animation(obj, duration), m_startPoint(objectPosition), m_mid1Point(mid1Point), m_mid2Point(mid2Point), m_endPoint(glm::vec3(objectPosition + totalMovement)) {}
-	BezierTranslationAnimation(Object3D& obj, float duration, const glm::vec3& startPoint, const glm::vec3& mid1Point, const glm::vec3& mid2Point, const glm::vec3& endPoint) :
-		Animation(obj, duration), m_startPoint(startPoint), m_mid1Point(mid1Point), m_mid2Point(mid2Point), m_endPoint(endPoint) {}
+	BezierTranslationAnimation(ObjectRef obj, float duration, const glm::vec3& startPoint, const glm::vec3& mid1Point, const glm::vec3& mid2Point, const glm::vec3& endPoint) :
+		Animation(std::move(obj), duration), m_startPoint(startPoint), m_mid1Point(mid1Point), m_mid2Point(mid2Point), m_endPoint(endPoint) {}
 };
 
@@ -0,0 +1,128 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <limits>
+
+/**
+ * @brief An axis-aligned bounding box. A default-constructed box is empty (inverted), so
+ * it can be grown point by point with expand().
+ */
+struct AABB {
+    glm::vec3 min{ std::numeric_limits<float>::max() };
+    glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+    AABB() = default;
+    AABB(const glm::vec3& lo, const glm::vec3& hi) : min(lo), max(hi) {}
+
+    bool isEmpty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    /**
+     * @brief Half of the box's size along each axis.
+     */
+    glm::vec3 extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    void expand(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const AABB& other) {
+        if (other.isEmpty())
+            return;
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool overlaps(const AABB& other) const {
+        return min.x <= other.max.x && other.min.x <= max.x &&
+            min.y <= other.max.y && other.min.y <= max.y &&
+            min.z <= other.max.z && other.min.z <= max.z;
+    }
+
+    bool contains(const glm::vec3& p) const {
+        return p.x >= min.x && p.x <= max.x &&
+            p.y >= min.y && p.y <= max.y &&
+            p.z >= min.z && p.z <= max.z;
+    }
+
+    /**
+     * @brief Returns the box that encloses this box after transformation by the given matrix.
+     * Uses Arvo's method, so it costs a handful of multiply-adds instead of 8 corner transforms.
+     */
+    AABB transformed(const glm::mat4& m) const {
+        if (isEmpty())
+            return AABB();
+
+        glm::vec3 lo = glm::vec3(m[3]);
+        glm::vec3 hi = lo;
+        for (int col = 0; col < 3; col++) {
+            for (int row = 0; row < 3; row++) {
+                float a = m[col][row] * min[col];
+                float b = m[col][row] * max[col];
+                lo[row] += a < b ? a : b;
+                hi[row] += a < b ? b : a;
+            }
+        }
+        return AABB(lo, hi);
+    }
+};
+
+/**
+ * @brief A bounding sphere. A default-constructed sphere is empty (negative radius).
+ */
+struct BoundingSphere {
+    glm::vec3 center{ 0.f };
+    float radius = -1.f;
+
+    BoundingSphere() = default;
+    BoundingSphere(const glm::vec3& c, float r) : center(c), radius(r) {}
+
+    bool isEmpty() const {
+        return radius < 0.f;
+    }
+
+    /**
+     * @brief Grows the sphere to the smallest sphere enclosing both it and the other sphere.
+     */
+    void expand(const BoundingSphere& other) {
+        if (other.isEmpty())
+            return;
+        if (isEmpty()) {
+            *this = other;
+            return;
+        }
+
+        glm::vec3 offset = other.center - center;
+        float dist = glm::length(offset);
+        if (dist + other.radius <= radius)
+            return;
+        if (dist + radius <= other.radius) {
+            *this = other;
+            return;
+        }
+
+        float newRadius = (dist + radius + other.radius) * 0.5f;
+        center = center + offset * ((newRadius - radius) / dist);
+        radius = newRadius;
+    }
+
+    /**
+     * @brief Returns a sphere enclosing this sphere after transformation by the given matrix.
+     * Non-uniform scales use the largest axis scale, so the result stays conservative.
+     */
+    BoundingSphere transformed(const glm::mat4& m) const {
+        if (isEmpty())
+            return BoundingSphere();
+
+        float scale = glm::max(glm::length(glm::vec3(m[0])),
+            glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+        return BoundingSphere(glm::vec3(m * glm::vec4(center, 1.f)), radius * scale);
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Bounds.h"
+
+/**
+ * @brief A pair of bodies whose bounding boxes overlap. Holds the user ids the bodies
+ * were registered with, with a < b.
+ */
+struct ContactPair {
+    uint32_t a;
+    uint32_t b;
+};
+
+/**
+ * @brief Finds every overlapping pair among a set of moving boxes, using sweep-and-prune.
+ *
+ * Bodies are kept sorted by their minimum along one axis. Since bodies move a little each
+ * frame, the order is repaired with an insertion sort, which is close to linear for nearly
+ * sorted data. The sweep then only compares bodies whose intervals overlap on that axis, so
+ * a frame costs O(n + k) for n bodies and k overlapping intervals.
+ */
+class Broadphase {
+public:
+    using BodyId = uint32_t;
+
+    /**
+     * @brief Registers a body and returns the id used to update or remove it.
+     * @param userId the value reported for this body in contact pairs.
+     */
+    BodyId addBody(const AABB& bounds, uint32_t userId);
+
+    void updateBody(BodyId id, const AABB& bounds);
+    void removeBody(BodyId id);
+
+    size_t bodyCount() const;
+
+    /**
+     * @brief Finds every overlapping pair, and returns them as a list. The list is reused
+     * between calls, so it is only valid until the next call.
+     */
+    const std::vector<ContactPair>& findPairs();
+
+    /**
+     * @brief Finds every overlapping pair, and reports each one to the callback.
+     */
+    void findPairs(const std::function<void(const ContactPair&)>& callback);
+
+private:
+    struct Body {
+        AABB bounds;
+        uint32_t userId;
+        bool alive;
+    };
+
+    // A body's interval on the sweep axis, stored contiguously for the sweep.
+    struct Proxy {
+        float min;
+        float max;
+        BodyId id;
+    };
+
+    std::vector<Body> m_bodies;
+    std::vector<BodyId> m_freeIds;
+    std::vector<Proxy> m_proxies;
+    std::vector<ContactPair> m_pairs;
+
+    int m_axis = 0;
+
+    // Refreshes each proxy's interval, picks the sweep axis, and restores sorted order.
+    void prepareSweep();
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <optional>
 
 const float MOVESPEED   = 2.5f;
 const float SENSITIVITY = 0.1f;
@@ -33,7 +34,8 @@ class Camera {
         bool isFocused;
 
         bool isTargetting;
-        glm::vec3* target;
+        // A copy of the target's position, kept current with MoveTarget().
+        std::optional<glm::vec3> target;
         glm::vec3 hover;
         float targetLerp;
 
@@ -58,7 +60,7 @@ class Camera {
 
         isFocused = true;
         isTargetting = false;
-        target = NULL;
+        target = std::nullopt;
 
         UpdateVectors();
         RequestView();
@@ -134,7 +136,7 @@ class Camera {
         RequestView();
     }
 
-    void SetTarget(glm::vec3* t) {
+    void SetTarget(const glm::vec3& t) {
         isTargetting = true;
         target = t;
         zoom = ZOOM;
@@ -143,6 +145,13 @@ class Camera {
         RequestPerspective();
     }
 
+    // call whenever the target moves
+    void MoveTarget(const glm::vec3& t) {
+        target = t;
+
+        RequestView();
+    }
+
     void DropTarget() {
         isTargetting = false;
 
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "FrameUniforms.h"
+#include "RenderQueue.h"
+#include "RingBuffer.h"
+#include "ShaderProgram.h"
+#include "ShaderVariants.h"
+
+class Framebuffer;
+
+/**
+ * @brief What the last shade() lit.
+ */
+struct DeferredStats {
+    uint32_t pointLights = 0;
+    // Point lights whose volumes were in view, and drawn.
+    uint32_t drawnLights = 0;
+    // Fragments the point light volumes shaded, i.e., the cost of the point lights. Counted by
+    // an occlusion query and read a few frames late, so reading it never waits on the GPU.
+    uint64_t litFragments = 0;
+};
+
+/**
+ * @brief Deferred shading: opaque meshes write their surfaces to a G-buffer, and lights are
+ * then added in screen space, so a light costs only the pixels it reaches rather than every
+ * fragment of every mesh drawn.
+ *
+ * The G-buffer holds albedo (RGBA8), the world-space normal (RGB10_A2), the specular color and
+ * shininess (RGBA16F) and depth. shade() copies its depth into the target framebuffer, covers
+ * the pixels with geometry in a full-screen pass for the frame's directional and spot light,
+ * and draws a sphere around each point light, scaled to where the light fades out, whose back
+ * faces pass the depth test only in front of the geometry behind them. Each sphere adds its
+ * light to those pixels, and a distance check discards the ones in front of the sphere, so the
+ * point lights cost about as many fragments as they light. Transparent meshes cannot go
+ * through the G-buffer; they, and anything else forward-shaded, are drawn into the target
+ * after shade(), with the opaque meshes' depth in place.
+ *
+ * Lighting follows gl_phong_lighting.frag. Point lights are cut off at their lightRadius().
+ */
+class DeferredRenderer {
+public:
+    /**
+     * @param width, height the window size, read again by resize().
+     */
+    DeferredRenderer(uint32_t& width, uint32_t& height);
+    ~DeferredRenderer();
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    /**
+     * @brief Recreates the G-buffer at the window's size.
+     */
+    void resize();
+
+    /**
+     * @brief Makes the queue draw opaque meshes pushed with the forward program into the
+     * G-buffer, with the variant of the G-buffer program each mesh's textures need. Calling
+     * it (or detach()) again for the same queue does nothing, so it may be called every frame.
+     */
+    void attach(RenderQueue& queue, const ShaderProgram& forwardProgram);
+    void detach(RenderQueue& queue);
+
+    /**
+     * @brief Binds and clears the G-buffer, for the queue's opaque meshes.
+     */
+    void beginGeometry();
+
+    /**
+     * @brief Lights the G-buffer into the target, which also gets the G-buffer's depth.
+     * @param pointLights every point light, the frame's own one included if it should be.
+     */
+    void shade(Framebuffer& target, const FrameData& frame, const std::vector<FramePointLight>& pointLights);
+
+    const DeferredStats& stats() const;
+
+private:
+    // A point light as point_light.vert reads it.
+    struct LightInstance {
+        glm::vec4 positionRadius;
+        // The constant, linear and quadratic attenuation ride in the alphas.
+        glm::vec4 ambient;
+        glm::vec4 diffuse;
+        glm::vec4 specular;
+    };
+
+    static constexpr uint32_t QUERIES = RingBuffer::SECTIONS;
+
+    uint32_t& m_width;
+    uint32_t& m_height;
+
+    uint32_t m_gbuffer = 0;
+    uint32_t m_albedo = 0;
+    uint32_t m_normal = 0;
+    uint32_t m_specular = 0;
+    uint32_t m_depth = 0;
+
+    ShaderProgram m_geometryProgram;
+    ShaderVariants m_geometryVariants;
+    // Whether the G-buffer program has variants, read once its files are known.
+    bool m_hasVariants = false;
+    // The queue attach() set up, so that repeated calls change nothing.
+    RenderQueue* m_attachedQueue = nullptr;
+    ShaderProgram m_directionalProgram;
+    ShaderProgram m_pointProgram;
+
+    uint32_t m_quadVao = 0;
+    uint32_t m_quadVbo = 0;
+    uint32_t m_sphereVao = 0;
+    uint32_t m_sphereVbo = 0;
+    uint32_t m_sphereVertices = 0;
+    RingBuffer m_lights;
+
+    // Samples passed in the point light pass, one query per frame in flight.
+    uint32_t m_queries[QUERIES] = {};
+    bool m_queryIssued[QUERIES] = {};
+    uint32_t m_frame = 0;
+
+    DeferredStats m_stats;
+
+    void release();
+    // Sets the uniforms that read the G-buffer.
+    void setGBufferUniforms(ShaderProgram& program, const glm::mat4& inverseViewProjection);
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/ext.hpp>
+#include "ShaderProgram.h"
+
+// The std140 layout of the FrameData uniform block in shaders/frame_data.glsl. A vec3 takes
+// 16 bytes' alignment but only 12 bytes, so a following float may fill its last 4; explicit
+// padding keeps the C++ offsets equal to the GLSL ones.
+
+struct FrameDirLight {
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct FramePointLight {
+    glm::vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+    float pad0[2];
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct FrameSpotLight {
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 position;
+    // Cosines of the cone angles.
+    float cutOff;
+    float outerCutOff;
+    float constant;
+    float linear;
+    float quadratic;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+// The cascades of the directional light's shadow (see ShadowMaps.h).
+constexpr uint32_t SHADOW_CASCADES = 4;
+
+/**
+ * @brief The camera and lights of one frame, as every lighting shader sees them.
+ */
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float pad0;
+    glm::vec3 ambientColor;
+    float pad1;
+    FrameDirLight dirLight;
+    FramePointLight pointLight;
+    FrameSpotLight spotLight;
+    // The light cluster grid (see LightClusters.h): its size in clusters, and in w, 1 if the
+    // lighting shaders should read it.
+    glm::uvec4 clusterGrid;
+    // The size of a cluster on screen in pixels (xy), and the scale and bias that take the log
+    // of a view depth to its slice of clusters (zw).
+    glm::vec4 clusterScale;
+    // Shadows, from the atlas of ShadowMaps.h. World space to the atlas for each cascade of the
+    // directional light: texture coordinates in xy and depth in z.
+    glm::mat4 cascadeMatrices[SHADOW_CASCADES];
+    // The view depth each cascade reaches to.
+    glm::vec4 cascadeSplits;
+    // The world-space size of a texel of each cascade, for offsetting lookups along the normal.
+    glm::vec4 cascadeTexels;
+    // World space to the atlas for the spot light, before the divide by w.
+    glm::mat4 spotShadowMatrix;
+    // The corner of the point light's first cube face in the atlas (xy), and the size of a face
+    // (zw), in texture coordinates.
+    glm::vec4 pointShadowTile;
+    // The size of a texel one unit from the spot light (x) and the point light (y), and the near
+    // and far plane of the point light's faces (zw).
+    glm::vec4 shadowTexels;
+    // The number of cascades, 0 for no directional shadows (x), and 1 if the spot light (y) and
+    // the point light (z) cast shadows.
+    glm::uvec4 shadowFlags;
+};
+
+static_assert(sizeof(FrameDirLight) == 64 && sizeof(FramePointLight) == 80 && sizeof(FrameSpotLight) == 96,
+    "light structs match their std140 sizes");
+static_assert(offsetof(FramePointLight, ambient) == 32 && offsetof(FrameSpotLight, cutOff) == 28
+    && offsetof(FrameSpotLight, ambient) == 48, "light members match their std140 offsets");
+static_assert(offsetof(FrameData, viewPos) == 128 && offsetof(FrameData, ambientColor) == 144
+    && offsetof(FrameData, dirLight) == 160 && offsetof(FrameData, pointLight) == 224
+    && offsetof(FrameData, spotLight) == 304 && offsetof(FrameData, clusterGrid) == 400
+    && offsetof(FrameData, cascadeMatrices) == 432 && offsetof(FrameData, spotShadowMatrix) == 720
+    && offsetof(FrameData, shadowFlags) == 816 && sizeof(FrameData) == 832, "FrameData matches its std140 layout");
+
+// The radius of a light whose attenuation never falls off.
+constexpr float MAX_LIGHT_RADIUS = 1000.f;
+
+/**
+ * @brief The distance at which a light's attenuation falls to 5/256 of its brightest color,
+ * past which it is treated as having no effect.
+ */
+float lightRadius(const FramePointLight& light);
+float lightRadius(const FrameSpotLight& light);
+
+/**
+ * @brief The uniform buffer behind the FrameData block, bound to FRAME_UNIFORMS_BINDING for
+ * as long as it lives. Updating it once per frame reaches every program at once.
+ */
+class FrameUniformBuffer {
+public:
+    FrameUniformBuffer();
+    ~FrameUniformBuffer();
+
+    FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+    FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+
+    /**
+     * @brief Replaces the whole block with one buffer write.
+     */
+    void update(const FrameData& data);
+
+private:
+    uint32_t m_buffer = 0;
+};
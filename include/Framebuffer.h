@@ -1,7 +1,9 @@
 #pragma once
 
+#include "GLState.h"
 #include "ShaderProgram.h"
 #include <glad/glad.h>
+#include <iostream>
 
 const float screenVertices[] = {
   // positions   // texCoords
@@ -31,27 +33,28 @@ class Framebuffer {
         }
 
         ~Framebuffer() {
-            glDeleteVertexArrays(1, &screenVAO);
+            GLState::shared().deleteVertexArray(screenVAO);
             glDeleteBuffers(1, &screenVBO);
             glDeleteRenderbuffers(1, &rboId);
-            glDeleteTextures(1, &textureId);
-            glDeleteFramebuffers(1, &fboId);
+            GLState::shared().deleteTexture(textureId);
+            GLState::shared().deleteFramebuffer(fboId);
         }
 
         void Resize() {
             if (rboId)
                 glDeleteRenderbuffers(1, &rboId);
 
+            // Deleted through GLState, since the new ones may get the same names.
             if (textureId)
-                glDeleteTextures(1, &textureId);
+                GLState::shared().deleteTexture(textureId);
 
             if (fboId)
-                glDeleteFramebuffers(1, &fboId);
+                GLState::shared().deleteFramebuffer(fboId);
 
             // sets up VAO and VBO that wil fit the whole screen.
             glGenVertexArrays(1, &screenVAO);
             glGenBuffers(1, &screenVBO);
-            glBindVertexArray(screenVAO);
+            GLState::shared().bindVertexArray(screenVAO);
             glBindBuffer(GL_ARRAY_BUFFER, screenVBO);
             glBufferData(GL_ARRAY_BUFFER, sizeof(screenVertices), &screenVertices, GL_STATIC_DRAW);
             glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
@@ -62,11 +65,11 @@ class Framebuffer {
 
             // set up the framebuffer
             glGenFramebuffers(1, &fboId);
-            glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+            GLState::shared().bindFramebuffer(fboId);
 
             // set up texture buffer
             glGenTextures(1, &textureId);
-            glBindTexture(GL_TEXTURE_2D, textureId);
+            GLState::shared().bindTexture(0, textureId);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, winWidth, winHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -74,7 +77,6 @@ class Framebuffer {
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureId, 0);
-            glBindTexture(GL_TEXTURE_2D, 0);
 
 
             // set up render buffer object
@@ -89,8 +91,7 @@ class Framebuffer {
             if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
                 std::cout << "ERROR: Framebuffer incomplete!" << std::endl;
             }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glBindVertexArray(0);
+            GLState::shared().bindFramebuffer(0);
         }
 
         void Clear(float r = 0.0f, float g = 0.0f, float b = 0.0f, float a = 1.0f, bool includeDepth = true) {
@@ -112,30 +113,32 @@ class Framebuffer {
          *
          */
         void RenderOnScreen() {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glEnable(GL_DEPTH_TEST);
+            GLState& state = GLState::shared();
+            state.bindFramebuffer(0);
+            state.enable(GL_DEPTH_TEST);
 
             if (stencilEnabled)
-                glEnable(GL_STENCIL_TEST);
+                state.enable(GL_STENCIL_TEST);
 
             if (cullEnabled)
-                glEnable(GL_CULL_FACE);
+                state.enable(GL_CULL_FACE);
 
             Clear();
         }
 
         void RenderOnTexture() {
             // binds the framebuffer for drawing
-            glBindFramebuffer(GL_FRAMEBUFFER, fboId);
-            glViewport(0, 0, winWidth, winHeight);
+            GLState& state = GLState::shared();
+            state.bindFramebuffer(fboId);
+            state.viewport(0, 0, winWidth, winHeight);
             // glViewport(0, 0, width, height);
 
-            glEnable(GL_DEPTH_TEST);
+            state.enable(GL_DEPTH_TEST);
             if (stencilEnabled)
-                glEnable(GL_STENCIL_TEST);
+                state.enable(GL_STENCIL_TEST);
 
             if (cullEnabled)
-                glEnable(GL_CULL_FACE);
+                state.enable(GL_CULL_FACE);
 
             Clear(0.45f, 0.45f, 0.45f, 1.0f);
         }
@@ -143,28 +146,25 @@ class Framebuffer {
         void TextureToScreen() {
             // binds view buffer for drawing
             // glViewport(0, 0, width, height);
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glViewport(0, 0, winWidth, winHeight);
+            GLState& state = GLState::shared();
+            state.bindFramebuffer(0);
+            state.viewport(0, 0, winWidth, winHeight);
 
             Clear(1.0f, 1.0f, 1.0f, 1.0f);
 
             // draws texture to view
             program.activate();
-            glBindVertexArray(screenVAO);
+            state.bindVertexArray(screenVAO);
 
-            glDisable(GL_DEPTH_TEST);
+            state.disable(GL_DEPTH_TEST);
             if (stencilEnabled)
-                glDisable(GL_STENCIL_TEST);
+                state.disable(GL_STENCIL_TEST);
 
             if (cullEnabled)
-                glDisable(GL_CULL_FACE);
+                state.disable(GL_CULL_FACE);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, textureId);
+            state.bindTexture(0, textureId);
             glDrawArrays(GL_TRIANGLES, 0, 6);
-
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glBindVertexArray(0);
         }
     private:
         uint32_t screenVAO;
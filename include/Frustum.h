@@ -0,0 +1,99 @@
+#pragma once
+#include <glm/ext.hpp>
+#include "Bounds.h"
+
+/**
+ * @brief The six planes of a view frustum, in world space. Each plane is stored as
+ * (a, b, c, d) with a normalized normal pointing into the frustum, so a point p is inside
+ * the plane when dot(abc, p) + d >= 0.
+ */
+struct Frustum {
+    enum class Result {
+        Outside,
+        Intersects,
+        Inside
+    };
+
+    glm::vec4 planes[6];
+
+    /**
+     * @brief Extracts the frustum planes from a view-projection matrix (Gribb and Hartmann).
+     * Pass camera.perspective * camera.view for a world-space frustum.
+     */
+    static Frustum fromMatrix(const glm::mat4& viewProjection) {
+        const glm::mat4& m = viewProjection;
+        // glm is column-major, so row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i]).
+        auto row = [&m](int i) {
+            return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        };
+
+        Frustum f;
+        f.planes[0] = row(3) + row(0); // left
+        f.planes[1] = row(3) - row(0); // right
+        f.planes[2] = row(3) + row(1); // bottom
+        f.planes[3] = row(3) - row(1); // top
+        f.planes[4] = row(3) + row(2); // near
+        f.planes[5] = row(3) - row(2); // far
+
+        for (auto& p : f.planes) {
+            p = p / glm::length(glm::vec3(p));
+        }
+        return f;
+    }
+
+    Result test(const BoundingSphere& sphere) const {
+        if (sphere.isEmpty())
+            return Result::Outside;
+
+        Result result = Result::Inside;
+        for (auto& p : planes) {
+            float dist = glm::dot(glm::vec3(p), sphere.center) + p.w;
+            if (dist < -sphere.radius)
+                return Result::Outside;
+            if (dist < sphere.radius)
+                result = Result::Intersects;
+        }
+        return result;
+    }
+
+    Result test(const AABB& box) const {
+        if (box.isEmpty())
+            return Result::Outside;
+
+        glm::vec3 center = box.center();
+        glm::vec3 extents = box.extents();
+
+        Result result = Result::Inside;
+        for (auto& p : planes) {
+            glm::vec3 n = glm::vec3(p);
+            float dist = glm::dot(n, center) + p.w;
+            // The box's "radius" projected onto the plane normal.
+            float radius = glm::dot(extents, glm::abs(n));
+            if (dist < -radius)
+                return Result::Outside;
+            if (dist < radius)
+                result = Result::Intersects;
+        }
+        return result;
+    }
+};
+
+/**
+ * @brief Counts of what the culling traversal drew and skipped in one frame.
+ */
+struct CullStats {
+    // Objects whose meshes were drawn.
+    uint32_t visibleObjects = 0;
+    // Subtrees skipped because their bounds were outside the frustum. The objects beneath a
+    // culled subtree are never visited, so they are not counted separately.
+    uint32_t culledSubtrees = 0;
+    // Subtrees inside the frustum but hidden behind occluders.
+    uint32_t occludedSubtrees = 0;
+    // Objects whose bounds were tested against the frustum planes.
+    uint32_t testedObjects = 0;
+    uint32_t drawnMeshes = 0;
+
+    void reset() {
+        *this = CullStats();
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+
+/**
+ * @brief GL calls made and skipped through GLState while its debug mode was on.
+ */
+struct GLStateStats {
+    uint32_t issued = 0;
+    // Calls that would have set state GL already had.
+    uint32_t skipped = 0;
+    // Calls the shadow would have skipped, but GL's state turned out to differ, i.e., code
+    // changed it without going through GLState. They are issued after all.
+    uint32_t mismatches = 0;
+
+    void reset() {
+        *this = GLStateStats();
+    }
+};
+
+/**
+ * @brief A shadow of the GL state that is set often: the program, vertex array, 2D texture of
+ * each unit, framebuffer, viewport, depth writes and enabled capabilities. Setting state
+ * through it makes no GL call when the shadow says the state is already in place, so callers
+ * can simply set what they need rather than restoring defaults after themselves.
+ *
+ * Everything starts out unknown, so the first call for each piece of state is always made.
+ * Code that sets this state directly must call invalidate() afterwards, and objects must be
+ * deleted through it, since GL reuses the names of deleted objects. In debug mode, every
+ * call is counted, and each skipped call is checked against GL's actual state.
+ */
+class GLState {
+public:
+    /**
+     * @brief The tracker of the one GL context the program renders with.
+     */
+    static GLState& shared();
+
+    /**
+     * @brief Whether the current context lists the extension, for extensions glad was not
+     * generated with.
+     */
+    static bool hasExtension(const char* name);
+
+    void useProgram(uint32_t program);
+    void bindVertexArray(uint32_t vertexArray);
+    // Makes the unit active only if the texture has to be bound.
+    void bindTexture(uint32_t unit, uint32_t texture);
+    // Binds a buffer texture. Only the active unit is shadowed, so the call is always made.
+    void bindBufferTexture(uint32_t unit, uint32_t texture);
+    void bindFramebuffer(uint32_t framebuffer);
+    void viewport(int32_t x, int32_t y, int32_t width, int32_t height);
+    void depthMask(bool write);
+    void setEnabled(GLenum capability, bool enabled);
+
+    void enable(GLenum capability) {
+        setEnabled(capability, true);
+    }
+
+    void disable(GLenum capability) {
+        setEnabled(capability, false);
+    }
+
+    // Delete the object and forget every binding of it.
+    void deleteProgram(uint32_t program);
+    void deleteTexture(uint32_t texture);
+    void deleteVertexArray(uint32_t vertexArray);
+    void deleteFramebuffer(uint32_t framebuffer);
+
+    /**
+     * @brief Forgets the whole shadow, for after GL state was set without GLState.
+     */
+    void invalidate();
+
+    void setDebug(bool debug);
+    bool isDebug() const;
+
+    /**
+     * @brief The calls counted since the last reset, in debug mode.
+     */
+    GLStateStats& stats();
+
+private:
+    static constexpr uint32_t UNKNOWN = UINT32_MAX;
+
+    struct Capability {
+        GLenum capability;
+        bool enabled;
+    };
+
+    uint32_t m_program = UNKNOWN;
+    uint32_t m_vertexArray = UNKNOWN;
+    uint32_t m_framebuffer = UNKNOWN;
+    uint32_t m_activeUnit = UNKNOWN;
+    std::vector<uint32_t> m_textures;
+    int32_t m_viewport[4] = { -1, -1, -1, -1 };
+    // 0 for no depth writes, 1 for depth writes.
+    uint32_t m_depthMask = UNKNOWN;
+    // The capabilities whose state is known.
+    std::vector<Capability> m_capabilities;
+
+    bool m_debug = false;
+    GLStateStats m_stats;
+
+    // Whether the call can be skipped, given whether the shadow already has the value. In
+    // debug mode the call is counted, and actualMatches() asks GL before skipping.
+    template <typename Query>
+    bool skip(bool matches, Query actualMatches);
+    void activeUnit(uint32_t unit);
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct Vertex3D;
+
+/**
+ * @brief How full the arena's buffers are, and how broken up their free space is.
+ */
+struct GeometryArenaStats {
+    uint32_t pages = 0;
+    uint32_t allocations = 0;
+    // Capacity and use of all pages, in vertices and indices.
+    size_t vertexCapacity = 0;
+    size_t verticesUsed = 0;
+    size_t indexCapacity = 0;
+    size_t indicesUsed = 0;
+    // Separate free blocks, and the largest of them, over all pages.
+    uint32_t freeBlocks = 0;
+    size_t largestFreeVertices = 0;
+    size_t largestFreeIndices = 0;
+    // Free vertex space outside the largest free block of its page, which only a mesh small
+    // enough for one of the holes can use.
+    size_t strandedFreeVertices = 0;
+    // GPU memory allocated for the pages, and the part of it holding geometry.
+    size_t gpuBytes = 0;
+    size_t usedGpuBytes = 0;
+    // Times a page was repacked, to grow or to compact it.
+    uint32_t repacks = 0;
+
+    float occupancy() const {
+        return gpuBytes == 0 ? 0.f : float(usedGpuBytes) / float(gpuBytes);
+    }
+
+    /**
+     * @brief 0 when every page's free vertex space is one block, approaching 1 as it splits
+     * into many small ones.
+     */
+    float fragmentation() const {
+        size_t free = vertexCapacity - verticesUsed;
+        return free == 0 ? 0.f : float(strandedFreeVertices) / float(free);
+    }
+};
+
+/**
+ * @brief Large vertex and index buffers that meshes are sub-allocated from, so that meshes of
+ * the same vertex format share a vertex array and draw with base vertices instead of binding
+ * their own buffers. Every Mesh3D lives in the shared arena.
+ *
+ * The arena is split into pages, each with a vertex array over one vertex and one index
+ * buffer. Free space in each buffer is kept as a first-fit free list that merges neighboring
+ * blocks. A page that runs out of room is repacked into buffers twice its size (up to
+ * MAX_PAGE_VERTICES), and a new page is started past that. Freeing meshes leaves holes, which
+ * compact() closes by repacking the page, so meshes find their geometry through their
+ * Range, which moves with it. Not thread-safe; use it from the GL thread.
+ */
+class GeometryArena {
+public:
+    static constexpr uint32_t INITIAL_PAGE_VERTICES = 1 << 16;
+    static constexpr uint32_t MAX_PAGE_VERTICES = 1 << 20;
+    // Index room per vertex of room in a page. Index and vertex buffers grow separately when
+    // a mesh needs more of one.
+    static constexpr uint32_t INDICES_PER_VERTEX = 2;
+
+    struct Page;
+
+    /**
+     * @brief A mesh's place in the arena. It stays at the same address for as long as the
+     * mesh lives, but its page and offsets change when the arena repacks.
+     */
+    struct Range {
+        Page* page;
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    /**
+     * @brief The arena of Vertex3D meshes. It outlives the shared MeshRegistry.
+     */
+    static GeometryArena& shared();
+
+    GeometryArena() = default;
+    ~GeometryArena();
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    /**
+     * @brief Uploads a mesh's vertices and indices (relative to its first vertex) into free
+     * space, repacking or adding a page if needed.
+     */
+    Range* allocate(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& indices);
+
+    /**
+     * @brief Returns the range's space to its page's free lists. A page left empty is freed.
+     */
+    void free(Range* range);
+
+    /**
+     * @brief Repacks every page whose free space is split into more than one block, so each
+     * page's geometry is contiguous and its free space one block at the end.
+     * @return the number of pages repacked.
+     */
+    uint32_t compact();
+
+    /**
+     * @brief Deletes every page's buffers and vertex array while the GL context is still
+     * current. Meshes still alive afterwards can be freed, but not drawn, and nothing can be
+     * allocated; call it once, at shutdown.
+     */
+    void releaseBuffers();
+
+    uint32_t getVertexArray(const Range& range) const;
+
+    GeometryArenaStats stats() const;
+
+private:
+    std::vector<std::unique_ptr<Page>> m_pages;
+    uint32_t m_repacks = 0;
+
+    Page* createPage(uint32_t vertexCapacity, uint32_t indexCapacity);
+    // Copies the page's ranges, packed in their current order, into new buffers of the given
+    // capacity, then frees the old ones.
+    void repack(Page& page, uint32_t vertexCapacity, uint32_t indexCapacity);
+    bool fits(const Page& page, uint32_t vertexCount, uint32_t indexCount) const;
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Bounds.h"
+#include "Frustum.h"
+#include "Mesh3D.h"
+#include "Object3D.h"
+#include "ShaderProgram.h"
+
+/**
+ * @brief Draws many copies of one model, each with its own model matrix and material, using
+ * one instanced draw call per mesh of the model instead of one traversal and draw per copy.
+ *
+ * Instances are edited on the CPU through instances(); render() culls them against the view
+ * frustum and uploads the survivors to the instance buffer. Draw with a shader whose vertex
+ * stage reads the InstanceData attributes, e.g., light_perspective_instanced.vert.
+ */
+class InstanceBatch {
+public:
+    /**
+     * @brief A batch of copies of the model's whole tree, as it is currently posed.
+     */
+    explicit InstanceBatch(const Object3D& model);
+
+    /**
+     * @brief A batch of copies of a single mesh.
+     */
+    explicit InstanceBatch(MeshHandle mesh);
+
+    ~InstanceBatch();
+
+    InstanceBatch(InstanceBatch&& other) noexcept;
+    InstanceBatch& operator=(InstanceBatch&& other) noexcept;
+    InstanceBatch(const InstanceBatch&) = delete;
+    InstanceBatch& operator=(const InstanceBatch&) = delete;
+
+    /**
+     * @brief Adds an instance. The default material leaves colors unchanged, with the usual
+     * shininess of 4.
+     */
+    void add(const glm::mat4& model, const glm::vec4& material = glm::vec4(1, 1, 1, 4));
+
+    std::vector<InstanceData>& instances();
+    const std::vector<InstanceData>& instances() const;
+
+    /**
+     * @brief Draws every instance whose bounds intersect the frustum. The program must be
+     * active and have its view and projection uniforms set.
+     */
+    void render(ShaderProgram& program, const Frustum& frustum, CullStats& stats);
+
+private:
+    struct Part {
+        MeshHandle mesh;
+        // The mesh's transform relative to the model's root.
+        glm::mat4 transform;
+    };
+
+    std::vector<Part> m_parts;
+    // The bounds of all parts, in model space.
+    BoundingSphere m_sphere;
+
+    std::vector<InstanceData> m_instances;
+    // The instances that survived culling this frame, in upload order.
+    std::vector<InstanceData> m_visible;
+
+    uint32_t m_buffer = 0;
+    // The instance buffer's size, in instances.
+    size_t m_bufferCapacity = 0;
+};
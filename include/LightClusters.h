@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/ext.hpp>
+#include "FrameUniforms.h"
+#include "ThreadPool.h"
+
+/**
+ * @brief A light as shaders/clusters.glsl reads it: six RGBA32F texels. A point light is a
+ * spot light whose cone takes in every direction.
+ */
+struct ClusterLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 direction;
+    float cutOff;
+    glm::vec3 ambient;
+    float outerCutOff;
+    glm::vec3 diffuse;
+    float constant;
+    glm::vec3 specular;
+    float linear;
+    float quadratic;
+    float pad[3];
+};
+
+static_assert(sizeof(ClusterLight) == 6 * 16, "ClusterLight is six texels");
+
+/**
+ * @brief What the last build() assigned.
+ */
+struct LightClusterStats {
+    uint32_t lights = 0;
+    // Lights whose range is in view.
+    uint32_t visibleLights = 0;
+    // Light indices over all clusters: the lights a fragment loops over, summed over clusters.
+    uint32_t indices = 0;
+    uint32_t maxClusterLights = 0;
+    // Indices left out because the index buffer reached GL_MAX_TEXTURE_BUFFER_SIZE.
+    uint32_t droppedIndices = 0;
+    float assignMs = 0.f;
+};
+
+/**
+ * @brief Clustered forward lighting: the view frustum is split into a grid of clusters, GRID_X
+ * by GRID_Y tiles on screen and GRID_Z slices in depth, and each cluster gets the list of
+ * point and spot lights whose range reaches it. The lighting shaders look up the cluster of
+ * each fragment and light it with just those lights, so any number of lights can be in the
+ * scene while a fragment pays only for the ones nearby.
+ *
+ * build() assigns the lights on the CPU every frame: each light's sphere of influence (see
+ * lightRadius()) is bounded to a box of clusters, and the clusters in it are tested against
+ * the sphere on a ThreadPool, one depth slice per job and four clusters at a time with SSE.
+ * Slices are spaced exponentially, so clusters far away are as deep as they are wide. The
+ * lights, the clusters' index ranges and the indices go to three buffer textures, bound to
+ * the units of SharedTextureUnit; the grid's size and scale go into the FrameData.
+ */
+class LightClusters {
+public:
+    static constexpr uint32_t GRID_X = 16;
+    static constexpr uint32_t GRID_Y = 9;
+    static constexpr uint32_t GRID_Z = 24;
+    static constexpr uint32_t CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+
+    explicit LightClusters(ThreadPool& workers);
+    ~LightClusters();
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    /**
+     * @brief Assigns the lights to the clusters of the frame's camera, uploads them, and turns
+     * the clusters on in the frame's data. The frame's own point and spot light are lit as
+     * before, so they should not be among the lights.
+     * @param width, height the size of the framebuffer drawn to.
+     */
+    void build(FrameData& frame, uint32_t width, uint32_t height, const std::vector<FramePointLight>& pointLights,
+        const std::vector<FrameSpotLight>& spotLights);
+
+    const LightClusterStats& stats() const;
+
+private:
+    // The clusters of one row of tiles in one slice, in view space. Their y and z bounds are
+    // shared; the x bounds are kept apart for SSE.
+    struct ClusterRow {
+        alignas(16) float minX[GRID_X];
+        alignas(16) float maxX[GRID_X];
+        float minY;
+        float maxY;
+        float minZ;
+        float maxZ;
+    };
+
+    // A light's view-space sphere, and the box of clusters it may reach.
+    struct LightRange {
+        glm::vec3 center;
+        float radius;
+        uint32_t minX, maxX, minY, maxY, minZ, maxZ;
+        bool visible;
+    };
+
+    ThreadPool& m_workers;
+    uint32_t m_maxTexels = 0;
+
+    uint32_t m_buffers[3] = {};
+    uint32_t m_textures[3] = {};
+
+    // What the cluster bounds were computed for, and what follows from it.
+    glm::mat4 m_projection{ 0.f };
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    float m_near = 0.f;
+    float m_far = 0.f;
+    float m_tileWidth = 0.f;
+    float m_tileHeight = 0.f;
+    // Take the log of a view depth to its slice.
+    float m_sliceScale = 0.f;
+    float m_sliceBias = 0.f;
+    std::vector<ClusterRow> m_rows;
+
+    std::vector<ClusterLight> m_lights;
+    std::vector<LightRange> m_ranges;
+    // The lights of each cluster, filled one slice per job.
+    std::vector<std::vector<uint32_t>> m_clusterLights;
+    std::vector<glm::uvec2> m_clusterRanges;
+    std::vector<uint32_t> m_indices;
+
+    LightClusterStats m_stats;
+
+    // Recomputes the clusters' bounds, for a new projection or framebuffer size.
+    void computeBounds(const glm::mat4& projection, uint32_t width, uint32_t height);
+    // Bounds a world-space sphere to a box of clusters.
+    LightRange range(const glm::mat4& view, const glm::vec3& center, float radius) const;
+    uint32_t sliceOf(float depth) const;
+    // Tests the lights against the clusters of one slice.
+    void assignSlice(uint32_t slice);
+    void upload();
+};
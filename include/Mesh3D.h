@@ -2,9 +2,12 @@
 #include <glm/ext.hpp>
 #include <glad/glad.h>
 #include <vector>
+#include <memory>
 
 #include "Texture.h"
 #include "ShaderProgram.h"
+#include "Bounds.h"
+#include "GeometryArena.h"
 struct Vertex3D {
 	float x;
 	float y;
@@ -24,12 +27,63 @@ struct Vertex3D {
 		x(px), y(py), z(pz), nx(normX), ny(normY), nz(normZ), u(texU), v(texV), tangent(glm::vec3(0)) {}
 };
 
+/**
+ * @brief The per-instance attributes of an instanced draw (see Mesh3D::renderInstanced()),
+ * read at attribute locations 4-7 (the model matrix) and 8 (the material).
+ */
+struct InstanceData {
+	glm::mat4 model;
+	// A color multiplier in rgb, and the shininess in a.
+	glm::vec4 material;
+};
+
+/**
+ * @brief One command of a multi-draw indirect call, laid out as GL reads it from a draw
+ * indirect buffer.
+ */
+struct DrawElementsIndirectCommand {
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	// Where the command's per-instance attributes start, e.g., its record in a buffer of
+	// InstanceData.
+	uint32_t baseInstance;
+};
+
+/**
+ * @brief A CPU-side copy of a mesh's vertex positions and triangle indices, for systems that
+ * need the geometry after it has been uploaded to the GPU (e.g., occlusion culling).
+ */
+struct MeshGeometry {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+};
+
+/**
+ * @brief A mesh uploaded to the GPU, with its textures. Meshes are immutable once built and
+ * own their space in the shared GeometryArena, so they are shared between objects through
+ * MeshHandles (usually from a MeshRegistry) rather than copied. Meshes in the same arena page
+ * share a vertex array and draw from their own part of its buffers.
+ */
 class Mesh3D {
 private:
-	uint32_t m_vao;
+	// Where the mesh's vertices and indices are in the arena; it moves when the arena repacks.
+	GeometryArena::Range* m_range = nullptr;
+	// Unique to the mesh for the whole run, unlike its address, which a later mesh can reuse.
+	uint32_t m_id;
 	uint32_t m_vertexCount;
 	uint32_t m_faceCount;
 	std::vector<Texture> m_textures;
+	// The bounding box and sphere of the mesh's vertices, in local space.
+	AABB m_bounds;
+	BoundingSphere m_sphere;
+	// Only present if the mesh was constructed with keepGeometry.
+	std::shared_ptr<const MeshGeometry> m_geometry;
+
+	void bindTextures(ShaderProgram& program) const;
+	// The byte offset of the mesh's first index in its element buffer, as draw calls take it.
+	const void* indexOffset() const;
 
 public:
 	Mesh3D() = delete;
@@ -41,15 +95,66 @@ public:
 	Mesh3D(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces);
 
 	Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces,
-		Texture texture);
+		Texture texture, bool keepGeometry = false);
 
+	/**
+	 * @param keepGeometry whether to keep a CPU-side copy of the positions and indices,
+	 * available through getGeometry().
+	*/
 	Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces,
-		std::vector<Texture>&& textures);
+		std::vector<Texture>&& textures, bool keepGeometry = false);
+
+	~Mesh3D();
+
+	Mesh3D(Mesh3D&& other) noexcept;
+	Mesh3D& operator=(Mesh3D&& other) noexcept;
+	Mesh3D(const Mesh3D&) = delete;
+	Mesh3D& operator=(const Mesh3D&) = delete;
+
+	/**
+	 * @brief The axis-aligned box enclosing every vertex of the mesh, in local space.
+	*/
+	const AABB& getBounds() const;
+
+	/**
+	 * @brief A sphere enclosing every vertex of the mesh, in local space.
+	*/
+	const BoundingSphere& getBoundingSphere() const;
+
+	/**
+	 * @brief The CPU-side copy of the mesh's geometry, or nullptr if it was not kept.
+	*/
+	const MeshGeometry* getGeometry() const;
+
+	/**
+	 * @brief Shares ownership of the CPU-side geometry, for systems that cache data derived
+	 * from it (e.g., ray casting BVHs). nullptr if it was not kept.
+	*/
+	std::shared_ptr<const MeshGeometry> getSharedGeometry() const;
+
+	/**
+	 * @brief An id no other mesh of the run has, for caches that outlive the meshes they key.
+	 * A moved-to mesh takes over the id of the mesh it was moved from.
+	*/
+	uint32_t getId() const;
+
+	uint32_t getVertexCount() const;
+	uint32_t getIndexCount() const;
+	uint32_t getVertexArray() const;
+	const std::vector<Texture>& getTextures() const;
 
-	void addTexture(Texture texture);
+	/**
+	 * @brief The size of the mesh's part of the arena's vertex and index buffers.
+	*/
+	size_t gpuBytes() const;
 
 	/**
-	 * @brief Constructs a 1x1 square centered at the origin in world space.
+	 * @brief The size of the mesh's CPU-side geometry, or 0 if it was not kept.
+	*/
+	size_t cpuBytes() const;
+	/**
+	 * @brief Constructs a 1x1 square centered at the origin in world space. Squares are
+	 * cheap, so they always keep their geometry. See MeshRegistry::square() for a shared one.
 	*/
 	static Mesh3D square(const std::vector<Texture>& textures);
 
@@ -61,4 +166,46 @@ public:
 	*/
 	void render(ShaderProgram& program) const;
 
+	/**
+	 * @brief Issues the mesh's draw call alone. The caller must have bound the mesh's vertex
+	 * array and textures, e.g., a RenderQueue that skips binds already in place.
+	*/
+	void draw() const;
+
+	/**
+	 * @brief Issues the mesh's draw call as one instance whose per-instance attributes are
+	 * read starting at the given instance, e.g., one draw's record in a buffer of InstanceData.
+	*/
+	void draw(uint32_t baseInstance) const;
+
+	/**
+	 * @brief The indirect command equivalent to draw(baseInstance), for batching the mesh's
+	 * draws with others that share its vertex array into one glMultiDrawElementsIndirect.
+	*/
+	DrawElementsIndirectCommand indirectCommand(uint32_t baseInstance) const;
+
+	/**
+	 * @brief Points the InstanceData attributes (locations 4-8) of the bound vertex array at
+	 * the given buffer, one record per instance.
+	*/
+	static void attachInstanceAttributes(uint32_t instanceBuffer);
+
+	/**
+	 * @brief Disables the InstanceData attributes of the bound vertex array again, so shaders
+	 * see their constant values (see glVertexAttrib*) instead.
+	*/
+	static void detachInstanceAttributes();
+
+	/**
+	 * @brief Renders one copy of the mesh per InstanceData in the given buffer, with a single
+	 * draw call. The buffer's instance attributes are only attached for this draw.
+	*/
+	void renderInstanced(ShaderProgram& program, uint32_t instanceBuffer, uint32_t instanceCount) const;
+
 };
+
+/**
+ * @brief A shared reference to an immutable mesh. The mesh's GPU buffers are freed when its
+ * last handle goes away.
+ */
+using MeshHandle = std::shared_ptr<const Mesh3D>;
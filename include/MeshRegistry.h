@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Mesh3D.h"
+
+/**
+ * @brief What the registered meshes cost, and how much sharing saves.
+ */
+struct MeshMemoryStats {
+    // Distinct meshes, i.e., distinct GPU buffers.
+    size_t uniqueMeshes = 0;
+    // Handles to those meshes held outside the registry, e.g., one per object using a mesh.
+    size_t references = 0;
+    // GPU and CPU memory actually used by the unique meshes.
+    size_t gpuBytes = 0;
+    size_t cpuBytes = 0;
+    // The GPU memory every reference would need if each had its own copy of its mesh.
+    size_t unsharedGpuBytes = 0;
+};
+
+/**
+ * @brief The central list of meshes. Meshes are registered once and handed out as shared,
+ * immutable MeshHandles, so identical geometry has one identity (the handle's pointer) that
+ * renderers can group draws by. The registry keeps every mesh alive until releaseUnused()
+ * finds that nothing else refers to it, or until clear(). Not thread-safe; use it from the GL thread.
+ */
+class MeshRegistry {
+public:
+    /**
+     * @brief The registry that model imports and scenes register their meshes with.
+     */
+    static MeshRegistry& shared();
+
+    MeshRegistry() = default;
+    MeshRegistry(const MeshRegistry&) = delete;
+    MeshRegistry& operator=(const MeshRegistry&) = delete;
+
+    /**
+     * @brief Registers a new mesh.
+     */
+    MeshHandle add(Mesh3D&& mesh);
+
+    /**
+     * @brief Registers a mesh under a key, so later lookups of the same key share it. If the
+     * key is already taken, the existing mesh is returned and the new one is discarded.
+     */
+    MeshHandle add(const std::string& key, Mesh3D&& mesh);
+
+    /**
+     * @brief The mesh registered under the key, or nullptr.
+     */
+    MeshHandle find(const std::string& key) const;
+
+    /**
+     * @brief A unit square (see Mesh3D::square()) with the given textures, shared by every
+     * caller asking for the same textures.
+     */
+    MeshHandle square(const std::vector<Texture>& textures);
+
+    /**
+     * @brief Frees every mesh that only the registry still refers to, then compacts the
+     * GeometryArena around the space they leave.
+     * @return the number of meshes freed.
+     */
+    size_t releaseUnused();
+
+    /**
+     * @brief Drops the registry's handles to every mesh, freeing those nothing else refers to.
+     * Call before the GL context goes away; the registry itself lives until exit.
+     */
+    void clear();
+
+    MeshMemoryStats stats() const;
+    size_t size() const;
+
+private:
+    struct Entry {
+        MeshHandle mesh;
+        // Empty for unkeyed meshes.
+        std::string key;
+    };
+
+    // The registry's handle is the only one it holds, so a use count of 1 means unused.
+    std::vector<Entry> m_meshes;
+    std::unordered_map<std::string, std::weak_ptr<const Mesh3D>> m_keyed;
+
+    MeshHandle insert(Mesh3D&& mesh, const std::string& key);
+};
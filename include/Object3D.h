@@ -1,11 +1,19 @@
 #pragma once
+#include <functional>
 #include <memory>
 #include "ShaderProgram.h"
 #include "Mesh3D.h"
+#include "Frustum.h"
+#include "PhysicsBody.h"
+#include "Pool.h"
+
+class OcclusionCuller;
+class RenderQueue;
+
 class Object3D {
 private:
-	// The object's list of meshes and children.
-	std::vector<Mesh3D> m_meshes;
+	// The object's list of meshes, which are shared with other objects, and its children.
+	std::vector<MeshHandle> m_meshes;
 	std::vector<Object3D> m_children;
 
 	// The object's position, orientation, and scale in world space.
@@ -16,12 +24,8 @@ private:
 
     glm::vec3 m_forward;
 
-    // speed
-    glm::vec3 m_velocity;
-    glm::vec3 m_acceleration;
-
-    glm::vec3 m_rotVelocity;
-    glm::vec3 m_rotAcceleration;
+    // speed, acceleration and gravity
+    PhysicsBody m_body;
 
 	// The object's material.
 	/*glm::vec4 m_material;*/
@@ -31,11 +35,26 @@ private:
 	glm::mat4 m_baseTransform;
 
     bool m_display;
-    bool m_gravityAffected;
+    // Whether the object's meshes are rasterized into the software occlusion buffer.
+    bool m_occluder;
+    // Whether the object is alpha-blended, which puts its meshes in the transparent pass.
+    bool m_transparent;
 
 	// Some objects from Assimp imports have a "name" field, useful for debugging.
 	std::string m_name;
 
+	// The bounds of the object's own meshes, in local space.
+	AABB m_meshBounds;
+	BoundingSphere m_meshSphere;
+
+	// The bounds of the object and all of its children, in its parent's space.
+	// Rebuilt by updateBounds() whenever this object or a descendant has moved.
+	AABB m_bounds;
+	BoundingSphere m_sphere;
+	bool m_boundsDirty;
+	// The triangles of the object's meshes and all of its children's, kept with the bounds.
+	uint32_t m_subtreeTriangles;
+
 	// Recomputes the local->world transformation matrix.
 	glm::mat4 buildModelMatrix() const;
 
@@ -44,8 +63,8 @@ public:
 	// No default constructor; you must have a mesh to initialize an object.
 	Object3D() = delete;
 
-	Object3D(std::vector<Mesh3D>&& meshes);
-	Object3D(std::vector<Mesh3D>&& meshes, const glm::mat4& baseTransform);
+	Object3D(std::vector<MeshHandle>&& meshes);
+	Object3D(std::vector<MeshHandle>&& meshes, const glm::mat4& baseTransform);
 
 	// Simple accessors.
 	const glm::vec3& getPosition() const;
@@ -59,10 +78,16 @@ public:
     const glm::vec3& getAcceleration() const;
     const glm::vec3& getRotAcceleration() const;
     const glm::vec3& getForward() const;
+    const PhysicsBody& getBody() const;
     const float getShininess() const;
     const bool getDisplay() const;
+    bool isOccluder() const;
+    bool isTransparent() const;
 	/*const glm::vec4& getMaterial() const;*/
 
+	const std::vector<MeshHandle>& getMeshes() const;
+	const glm::mat4& getBaseTransform() const;
+
 	// Child management.
 	size_t numberOfChildren() const;
 	const Object3D& getChild(size_t index) const;
@@ -82,6 +107,8 @@ public:
     void setForward(const glm::vec3& vec);
     void setShininess(const float value);
     void setDisplay(const bool v);
+    void setOccluder(bool occluder);
+    void setTransparent(bool transparent);
 	/*void setMaterial(const glm::vec4& material);*/
 
 	// Transformations.
@@ -96,7 +123,70 @@ public:
     // movement
     void tick(float_t dt);
 
+	// Bounds. updateBounds() must be called after transformations (e.g., once per frame)
+	// for the cached subtree bounds to reflect them.
+	bool updateBounds();
+	const AABB& getLocalBounds() const;
+	const AABB& getBounds() const;
+	const BoundingSphere& getBoundingSphere() const;
+	AABB getWorldBounds(const glm::mat4& parentMatrix = glm::mat4(1)) const;
+	BoundingSphere getWorldBoundingSphere(const glm::mat4& parentMatrix = glm::mat4(1)) const;
+	// The triangles in the subtree, as of the last updateBounds().
+	uint32_t getSubtreeTriangles() const;
+	// The object's local->world matrix, under a parent with the given one.
+	glm::mat4 getModelMatrix(const glm::mat4& parentMatrix = glm::mat4(1)) const;
+
 	// Rendering.
 	void render(ShaderProgram& shaderProgram) const;
-	void renderRecursive(ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const;
+	void renderRecursive(RenderQueue& queue, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const;
+
+	// Rendering with view-frustum culling, and optionally occlusion culling.
+	// Bounds must be current (see updateBounds()).
+	void render(ShaderProgram& shaderProgram, const Frustum& frustum, CullStats& stats,
+		const OcclusionCuller* occlusion = nullptr) const;
+
+	// Culls like render(), but queues the visible meshes to be sorted and drawn by
+	// RenderQueue::submit().
+	void render(RenderQueue& queue, ShaderProgram& shaderProgram, const Frustum& frustum, CullStats& stats,
+		const OcclusionCuller* occlusion = nullptr) const;
+	void renderRecursive(RenderQueue& queue, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix,
+		const Frustum& frustum, CullStats& stats, const OcclusionCuller* occlusion, bool insideFrustum) const;
+	// Queues only the object's own meshes, not its children's, at the given local->world matrix.
+	void renderMeshes(RenderQueue& queue, ShaderProgram& shaderProgram, const glm::mat4& model,
+		CullStats& stats) const;
+
+	// Queues the meshes of every occluder in this subtree with the occlusion culler.
+	void addOccluders(OcclusionCuller& culler, const glm::mat4& parentMatrix = glm::mat4(1)) const;
+
+	// Calls visit(mesh, model) for every mesh of every displayed object in this subtree,
+	// depth-first, with the mesh's local->world matrix.
+	void forEachMesh(const std::function<void(const MeshHandle&, const glm::mat4&)>& visit,
+		const glm::mat4& parentMatrix = glm::mat4(1)) const;
+};
+
+// Scene objects live in a pool, and are referred to by handles that notice when the object
+// has been destroyed.
+using ObjectHandle = Handle<Object3D>;
+using ObjectPool = Pool<Object3D>;
+
+/**
+ * @brief Refers to a scene object, or to one of its descendants by a path of child indices.
+ */
+struct ObjectRef {
+	ObjectHandle handle;
+	std::vector<size_t> childPath;
+
+	ObjectRef(ObjectHandle h, std::vector<size_t> path = {}) : handle(h), childPath(std::move(path)) {
+	}
+
+	/**
+	 * @brief The referenced object, or nullptr if its scene object has been destroyed.
+	 */
+	Object3D* resolve(ObjectPool& objects) const {
+		Object3D* object = objects.get(handle);
+		for (size_t i = 0; object && i < childPath.size(); i++) {
+			object = &object->getChild(childPath[i]);
+		}
+		return object;
+	}
 };
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/ext.hpp>
+#include "Bounds.h"
+#include "Mesh3D.h"
+#include "ThreadPool.h"
+
+/**
+ * @brief A low-resolution software depth buffer for occlusion culling.
+ *
+ * Each frame, large occluder meshes (walls, floors) are rasterized into a 256x128 depth
+ * buffer on the CPU, and the bounding boxes of other objects are then tested against it
+ * before they are submitted to the GPU. Triangles are binned into screen tiles, and the
+ * tiles are rasterized in parallel on a ThreadPool, four pixels at a time with SSE.
+ *
+ * Depths are window-space values in [0, 1], with 1 the far plane.
+ */
+class OcclusionCuller {
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int TILE_WIDTH = 32;
+    static const int TILE_HEIGHT = 16;
+    static const int TILES_X = WIDTH / TILE_WIDTH;
+    static const int TILES_Y = HEIGHT / TILE_HEIGHT;
+
+    struct Stats {
+        uint32_t occluderTriangles = 0;
+        uint32_t testedBoxes = 0;
+        uint32_t occludedBoxes = 0;
+        float rasterizeMs = 0.f;
+    };
+
+    explicit OcclusionCuller(ThreadPool& pool);
+
+    /**
+     * @brief Clears the occluders and the depth buffer, and sets the camera to rasterize with.
+     * @param viewProjection the camera's projection * view matrix.
+     */
+    void beginFrame(const glm::mat4& viewProjection);
+
+    /**
+     * @brief Queues the triangles of a mesh as an occluder for this frame.
+     * @param model the mesh's local->world transformation matrix.
+     */
+    void addOccluder(const MeshGeometry& geometry, const glm::mat4& model);
+
+    /**
+     * @brief Rasterizes every queued occluder into the depth buffer.
+     */
+    void rasterize();
+
+    /**
+     * @brief Tests whether any part of a world-space box could be visible past the occluders.
+     * Conservative: boxes that cross the near plane are always reported visible.
+     */
+    bool isVisible(const AABB& worldBounds) const;
+
+    const Stats& getStats() const;
+    const std::vector<float>& getDepthBuffer() const;
+
+private:
+    struct ScreenTriangle {
+        float x[3];
+        float y[3];
+        float z[3];
+    };
+
+    ThreadPool& m_pool;
+    glm::mat4 m_viewProjection;
+
+    std::vector<ScreenTriangle> m_triangles;
+    // The clip-space positions of the occluder being added, kept to reuse its capacity.
+    std::vector<glm::vec4> m_clip;
+    std::vector<std::vector<uint32_t>> m_bins;
+    std::vector<float> m_depth;
+    // The farthest depth in each tile, for rejecting whole tiles at once.
+    std::vector<float> m_tileMaxDepth;
+
+    mutable Stats m_stats;
+
+    void addClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    void binTriangle(uint32_t index);
+    void rasterizeTile(int tile);
+};
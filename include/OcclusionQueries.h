@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include "Object3D.h"
+#include "ShaderProgram.h"
+#include "Frustum.h"
+#include "RenderQueue.h"
+
+/**
+ * @brief GPU occlusion culling for scene object subtrees.
+ *
+ * Occluders are drawn first. Then every other object is split into query units: a subtree
+ * with no child of HEAVY_TRIANGLES or more is one unit, while a subtree with such children
+ * is tested as its own meshes and light children together, with each heavy child split the
+ * same way. So a large model under a small root is tested against its own bounds. Each
+ * unit's bounding box is drawn, with color and depth writes off, inside a
+ * GL_ANY_SAMPLES_PASSED query. The query answer is used in one of
+ * two ways, neither of which makes the CPU wait for the GPU:
+ *  - Conditional: the object is drawn inside glBeginConditionalRender(GL_QUERY_NO_WAIT),
+ *    so the GPU discards its draws when the box was hidden (and draws it anyway if the answer
+ *    is not ready yet).
+ *  - LastFrame: the CPU reads the answer only once it is available, usually a frame later,
+ *    and skips hidden units' draw calls entirely. Units can appear a frame late.
+ *
+ * Only core GL 3.3 features are used, so this also runs on Mesa's software renderers.
+ */
+class OcclusionQueries {
+public:
+    static constexpr uint32_t HEAVY_TRIANGLES = 4096;
+
+    enum class Mode {
+        Conditional,
+        LastFrame
+    };
+
+    OcclusionQueries(ShaderProgram proxyProgram, Mode mode = Mode::Conditional);
+    ~OcclusionQueries();
+
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+    void setMode(Mode mode);
+    Mode getMode() const;
+
+    /**
+     * @brief Renders the objects, using occlusion queries to skip those hidden behind the
+     * occluders. program must already be active with its per-frame uniforms set, and the
+     * objects' bounds must be current.
+     */
+    void render(const ObjectPool& objects, ShaderProgram& program, const Frustum& frustum,
+        CullStats& stats, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition);
+
+private:
+    struct UnitQuery {
+        uint32_t query = 0;
+        // LastFrame mode: whether a query is in flight, and the last answer received.
+        bool pending = false;
+        bool visible = true;
+        // Whether a query was issued for the unit this frame.
+        bool issued = false;
+    };
+
+    // The queries of an object pool slot's units, in the order they are collected.
+    struct SlotQueries {
+        // The generation of the object in the slot, so a reused slot starts over.
+        uint32_t generation = 0;
+        // The units collected last frame; a different count starts the answers over too.
+        uint32_t units = 0;
+        std::vector<UnitQuery> queries;
+    };
+
+    struct Unit {
+        const Object3D* object;
+        glm::mat4 parentMatrix;
+        AABB bounds;
+        // Whether the unit is the object's own meshes and light children only.
+        bool split;
+        uint32_t slot;
+        uint32_t query;
+    };
+
+    ShaderProgram m_proxyProgram;
+    Mode m_mode;
+    std::vector<SlotQueries> m_slots;
+    std::vector<Unit> m_units;
+    // Draws each unit, since units are drawn under their own conditions.
+    RenderQueue m_queue;
+
+    uint32_t m_cubeVao;
+    uint32_t m_cubeVbo;
+    uint32_t m_cubeEbo;
+
+    void drawProxy(const AABB& bounds);
+    // Appends the units of the object's subtree.
+    void collectUnits(const Object3D& object, const glm::mat4& parentMatrix, uint32_t slot);
+    void renderUnit(const Unit& unit, ShaderProgram& program, const Frustum& frustum, CullStats& stats);
+};
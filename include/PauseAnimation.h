@@ -14,8 +14,9 @@ private:
 	/**
 	 * @brief Advance the animation by the given time interval.
 	 */
-	void applyAnimation(float dt) override {
+	void applyAnimation(Object3D& object, float dt) override {
 		// m_objectPosition += m_perSecond * dt;
+        (void) object;
         (void) dt;
 	}
 
@@ -24,7 +25,7 @@ public:
 	 * @brief Constructs a animation of a constant rotation by the given total rotation
 	 * angle, linearly interpolated across the given duration.
 	 */
-	PauseAnimation(Object3D& obj, float duration) :
-		Animation(obj, duration) {}
+	PauseAnimation(ObjectRef obj, float duration) :
+		Animation(std::move(obj), duration) {}
 };
 
@@ -0,0 +1,19 @@
+#pragma once
+#include <glm/ext.hpp>
+
+/**
+ * @brief Velocity, acceleration and gravity for an object that moves on its own.
+ */
+struct PhysicsBody {
+    glm::vec3 velocity{ 0.f };
+    glm::vec3 acceleration{ 0.f };
+    glm::vec3 rotVelocity{ 0.f };
+    glm::vec3 rotAcceleration{ 0.f };
+    bool gravityAffected = true;
+
+    /**
+     * @brief Advances the body by dt seconds, moving the given position and orientation.
+     * Includes gravity, bouncing off the ground plane at y = 0, and friction.
+     */
+    void step(glm::vec3& position, glm::vec3& orientation, float dt);
+};
@@ -0,0 +1,239 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A reference to an element of a Pool<T>. A handle goes stale when its element is
+ * destroyed, and stays stale even after the slot is reused, because the slot's generation
+ * counter no longer matches.
+ */
+template <typename T>
+struct Handle {
+    static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+    uint32_t index = INVALID_INDEX;
+    uint32_t generation = 0;
+
+    /**
+     * @brief Whether the handle was ever assigned. It may still be stale; see Pool::contains().
+     */
+    bool isNull() const {
+        return index == INVALID_INDEX;
+    }
+
+    bool operator==(const Handle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const Handle& other) const {
+        return !(*this == other);
+    }
+};
+
+/**
+ * @brief Owns a set of T in stable slots, addressed by generational handles.
+ *
+ * Slots are allocated in fixed-size chunks that never move, so creating elements never
+ * invalidates pointers to other elements. Destroyed slots go on a free list and are reused
+ * by later creations; creation and destruction are both O(1). Iteration visits live
+ * elements in slot order, skipping dead slots.
+ */
+template <typename T>
+class Pool {
+private:
+    static constexpr uint32_t CHUNK_SIZE = 64;
+
+    struct Slot {
+        std::optional<T> value;
+        // Starts at 1, so a default Handle never matches a slot.
+        uint32_t generation = 1;
+        uint32_t nextFree = Handle<T>::INVALID_INDEX;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    uint32_t m_capacity = 0;
+    uint32_t m_firstFree = Handle<T>::INVALID_INDEX;
+    size_t m_size = 0;
+
+    Slot& slot(uint32_t index) {
+        return m_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    const Slot& slot(uint32_t index) const {
+        return m_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    template <typename PoolType, typename Value>
+    class Iterator {
+    public:
+        Iterator(PoolType* pool, uint32_t index) : m_pool(pool), m_index(index) {
+            skipDead();
+        }
+
+        Value& operator*() const {
+            return *m_pool->slot(m_index).value;
+        }
+
+        Value* operator->() const {
+            return &*m_pool->slot(m_index).value;
+        }
+
+        Iterator& operator++() {
+            m_index++;
+            skipDead();
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return m_index != other.m_index;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return m_index == other.m_index;
+        }
+
+        /**
+         * @brief The handle of the element the iterator points to.
+         */
+        Handle<T> handle() const {
+            return { m_index, m_pool->slot(m_index).generation };
+        }
+
+    private:
+        PoolType* m_pool;
+        uint32_t m_index;
+
+        void skipDead() {
+            while (m_index < m_pool->m_capacity && !m_pool->slot(m_index).value) {
+                m_index++;
+            }
+        }
+    };
+
+public:
+    using iterator = Iterator<Pool, T>;
+    using const_iterator = Iterator<const Pool, const T>;
+
+    Pool() = default;
+    Pool(Pool&&) noexcept = default;
+    Pool& operator=(Pool&&) noexcept = default;
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    /**
+     * @brief Constructs a new element in a free slot, and returns its handle.
+     */
+    template <typename... Args>
+    Handle<T> create(Args&&... args) {
+        if (m_firstFree == Handle<T>::INVALID_INDEX) {
+            m_chunks.emplace_back(new Slot[CHUNK_SIZE]);
+            // Thread the new slots onto the free list, lowest index first.
+            for (uint32_t i = CHUNK_SIZE; i-- > 0;) {
+                slot(m_capacity + i).nextFree = m_firstFree;
+                m_firstFree = m_capacity + i;
+            }
+            m_capacity += CHUNK_SIZE;
+        }
+
+        uint32_t index = m_firstFree;
+        Slot& s = slot(index);
+        s.value.emplace(std::forward<Args>(args)...);
+        m_firstFree = s.nextFree;
+        m_size++;
+        return { index, s.generation };
+    }
+
+    /**
+     * @brief Destroys the element, making its handle (and any copies) stale. Does nothing if
+     * the handle is already stale.
+     */
+    void destroy(Handle<T> handle) {
+        if (!contains(handle))
+            return;
+
+        Slot& s = slot(handle.index);
+        s.value.reset();
+        s.generation++;
+        s.nextFree = m_firstFree;
+        m_firstFree = handle.index;
+        m_size--;
+    }
+
+    /**
+     * @brief Whether the handle refers to a live element.
+     */
+    bool contains(Handle<T> handle) const {
+        return handle.index < m_capacity && slot(handle.index).generation == handle.generation &&
+            slot(handle.index).value.has_value();
+    }
+
+    /**
+     * @brief The element the handle refers to, or nullptr if the handle is stale.
+     */
+    T* get(Handle<T> handle) {
+        return contains(handle) ? &*slot(handle.index).value : nullptr;
+    }
+
+    const T* get(Handle<T> handle) const {
+        return contains(handle) ? &*slot(handle.index).value : nullptr;
+    }
+
+    /**
+     * @brief The element the handle refers to. Throws if the handle is stale.
+     */
+    T& at(Handle<T> handle) {
+        if (!contains(handle))
+            throw std::runtime_error("Stale or invalid pool handle");
+        return *slot(handle.index).value;
+    }
+
+    const T& at(Handle<T> handle) const {
+        if (!contains(handle))
+            throw std::runtime_error("Stale or invalid pool handle");
+        return *slot(handle.index).value;
+    }
+
+    /**
+     * @brief The handle of the element in the given slot, or a null handle if the slot is dead.
+     * Lets slot indices stand in for handles in systems that only store an integer.
+     */
+    Handle<T> handleAt(uint32_t index) const {
+        if (index >= m_capacity || !slot(index).value)
+            return {};
+        return { index, slot(index).generation };
+    }
+
+    /**
+     * @brief The number of live elements.
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * @brief One past the highest slot index; slot indices of live elements are below this.
+     */
+    uint32_t capacity() const {
+        return m_capacity;
+    }
+
+    iterator begin() {
+        return iterator(this, 0);
+    }
+
+    iterator end() {
+        return iterator(this, m_capacity);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, m_capacity);
+    }
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+constexpr uint32_t PROGRAM_BINARY_VERSION = 1;
+
+/**
+ * @brief The header of a cached program binary file, followed by the binary itself.
+ */
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    // The key the binary was stored under (see ProgramBinaryCache::key()).
+    uint64_t key;
+    // The driver's binary format, as glGetProgramBinary returned it.
+    uint32_t format;
+    uint32_t length;
+};
+
+/**
+ * @brief Programs the cache answered, and the ones it did not.
+ */
+struct ProgramCacheStats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    // Cached binaries the driver refused, e.g., after a driver update. Their programs were
+    // compiled from source instead and stored again.
+    uint32_t rejected = 0;
+    uint32_t stored = 0;
+};
+
+/**
+ * @brief Linked programs saved as driver binaries (glGetProgramBinary), so that later runs
+ * skip compiling and linking GLSL.
+ *
+ * Each binary is a file in the cache directory named after its key, a hash of the program's
+ * sources and defines and of the driver's vendor, renderer and version strings, so a changed
+ * shader or driver simply misses. The driver may still refuse a binary it wrote; the file is
+ * then deleted and load() misses, so callers always have source compilation to fall back on.
+ * Program binaries take GL 4.1 or GL_ARB_get_program_binary; without either, every load
+ * misses and nothing is stored.
+ */
+class ProgramBinaryCache {
+public:
+    /**
+     * @brief The cache that ShaderProgram::load() uses, in the shader_cache directory.
+     */
+    static ProgramBinaryCache& shared();
+
+    explicit ProgramBinaryCache(std::filesystem::path directory);
+
+    ProgramBinaryCache(const ProgramBinaryCache&) = delete;
+    ProgramBinaryCache& operator=(const ProgramBinaryCache&) = delete;
+
+    /**
+     * @brief Loads the program binary calls that glad skips on contexts below GL 4.1, for
+     * GL_ARB_get_program_binary. Call it after glad is loaded, with the platform's lookup.
+     */
+    static void loadEntryPoints(void* (*getFunction)(const char* name));
+
+    /**
+     * @brief Whether the context can save and restore program binaries. Needs a current context.
+     */
+    bool isAvailable();
+
+    /**
+     * @brief The key of a program built from the given (fully expanded) sources and defines,
+     * with the current driver.
+     */
+    uint64_t key(std::string_view vertexSource, std::string_view fragmentSource, std::string_view defines);
+
+    /**
+     * @brief Creates a linked program from the binary stored under the key.
+     * @return the program, or 0 if there is no binary or the driver rejected it.
+     */
+    uint32_t load(uint64_t key);
+
+    /**
+     * @brief Asks the driver to keep the program's binary retrievable. Call it before linking
+     * a program that will be stored.
+     */
+    void prepare(uint32_t program);
+
+    /**
+     * @brief Saves a linked program's binary under the key. Failing to write it is reported
+     * and otherwise ignored; the program is simply compiled again next time.
+     */
+    void store(uint64_t key, uint32_t program);
+
+    const ProgramCacheStats& stats() const;
+
+private:
+    std::filesystem::path m_directory;
+    bool m_checked = false;
+    bool m_available = false;
+    // The driver's vendor, renderer and version, read once.
+    std::string m_driver;
+    ProgramCacheStats m_stats;
+
+    std::filesystem::path pathOf(uint64_t key) const;
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Bounds.h"
+#include "Mesh3D.h"
+#include "Object3D.h"
+#include "ThreadPool.h"
+
+/**
+ * @brief One node of a BVH. Nodes are 32 bytes and 32-byte aligned, so a node's bounds load
+ * as two SSE registers and a pair of siblings (which are always adjacent) share a cache line.
+ */
+struct alignas(32) BVHNode {
+    glm::vec3 min;
+    // Inner nodes: the index of the left child, with the right child right after it.
+    // Leaves: the first of the leaf's primitives.
+    uint32_t first;
+    glm::vec3 max;
+    // The number of primitives in a leaf, or 0 for an inner node.
+    uint32_t count;
+};
+
+/**
+ * @brief A bounding volume hierarchy over a set of boxes, split with the binned surface area
+ * heuristic. It only stores the tree and the order of the primitives; what the primitives
+ * are (triangles, object instances) is up to the user.
+ */
+class BVH {
+public:
+    void build(const std::vector<AABB>& primitiveBounds);
+
+    const std::vector<BVHNode>& getNodes() const;
+    // Leaf primitive slots, in tree order, mapped to the indices given to build().
+    const std::vector<uint32_t>& getPrimitives() const;
+
+private:
+    std::vector<BVHNode> m_nodes;
+    std::vector<uint32_t> m_primitives;
+};
+
+/**
+ * @brief The nearest triangle hit by a ray.
+ */
+struct RayHit {
+    bool hit = false;
+    float distance = std::numeric_limits<float>::max();
+    glm::vec3 point{ 0.f };
+    // The scene object that was hit.
+    ObjectHandle object;
+    // The index of the mesh within that object's subtree, counted depth-first.
+    uint32_t mesh = 0;
+    // The index of the triangle within the mesh, i.e., indices[3 * triangle] onward.
+    uint32_t triangle = 0;
+    // The weights of the triangle's second and third vertices; the first gets the rest.
+    glm::vec2 barycentric{ 0.f };
+};
+
+class MeshBVH;
+
+/**
+ * @brief Ray casts against the triangles of scene objects, for picking and line-of-sight tests.
+ *
+ * Each mesh gets its own BVH over its triangles, in its local space, built once and shared
+ * by every copy of the mesh. A small top-level BVH over the world-space boxes of each mesh
+ * instance is rebuilt by build(), which must be called again after objects move. Only meshes
+ * that kept their geometry (see Mesh3D's keepGeometry) can be hit.
+ */
+class Raycaster {
+public:
+    explicit Raycaster(ThreadPool& pool);
+    ~Raycaster();
+
+    Raycaster(const Raycaster&) = delete;
+    Raycaster& operator=(const Raycaster&) = delete;
+
+    /**
+     * @brief Gathers every displayed mesh instance in the objects' subtrees, builds BVHs for
+     * meshes not seen before (in parallel), and rebuilds the top-level BVH.
+     */
+    void build(const ObjectPool& objects);
+
+    /**
+     * @brief Finds the nearest triangle along a ray.
+     * @param direction need not be normalized; the hit distance is in world units either way.
+     */
+    RayHit raycast(const glm::vec3& origin, const glm::vec3& direction,
+        float maxDistance = std::numeric_limits<float>::max()) const;
+
+    /**
+     * @brief Whether nothing lies on the segment between two points. Stops at the first
+     * triangle found, so it is cheaper than raycast().
+     */
+    bool lineOfSight(const glm::vec3& from, const glm::vec3& to) const;
+
+    size_t instanceCount() const;
+    size_t triangleCount() const;
+
+private:
+    struct Instance {
+        glm::mat4 worldToLocal;
+        const MeshBVH* bvh;
+        ObjectHandle object;
+        uint32_t mesh;
+    };
+
+    ThreadPool& m_pool;
+    std::vector<Instance> m_instances;
+    BVH m_topLevel;
+    size_t m_triangleCount = 0;
+
+    // Mesh BVHs by geometry. The geometry is held too, so its address can't be reused by
+    // another mesh while its BVH is cached.
+    struct CachedBVH {
+        std::shared_ptr<const MeshGeometry> geometry;
+        std::unique_ptr<MeshBVH> bvh;
+    };
+    std::unordered_map<const MeshGeometry*, CachedBVH> m_meshBVHs;
+};
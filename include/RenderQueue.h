@@ -0,0 +1,208 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glm/ext.hpp>
+#include "Mesh3D.h"
+#include "RingBuffer.h"
+#include "ShaderProgram.h"
+#include "ShaderVariants.h"
+
+enum class RenderPass : uint32_t {
+    // Depth-tested and written, drawn front to back so early depth tests reject hidden fragments.
+    Opaque,
+    // Alpha-blended without depth writes, drawn back to front after every opaque mesh.
+    Transparent,
+};
+
+/**
+ * @brief One mesh to draw, with everything needed to draw it and the key it is sorted by.
+ */
+struct DrawPacket {
+    uint64_t key;
+    const Mesh3D* mesh;
+    ShaderProgram* program;
+    glm::mat4 model;
+    float shininess;
+};
+
+/**
+ * @brief The state changes a RenderQueue made and avoided in its last submit().
+ */
+struct RenderQueueStats {
+    uint32_t packets = 0;
+    uint32_t programBinds = 0;
+    uint32_t vertexArrayBinds = 0;
+    uint32_t textureBinds = 0;
+    uint32_t materialUniforms = 0;
+    // Binds and uniforms that would have repeated the state already in place.
+    uint32_t skippedProgramBinds = 0;
+    uint32_t skippedVertexArrayBinds = 0;
+    uint32_t skippedTextureBinds = 0;
+    uint32_t skippedMaterialUniforms = 0;
+    // Draws whose model matrix and material were read from the frame's draw data buffer.
+    uint32_t streamedDraws = 0;
+    // GL draw calls issued; a multi-draw counts once however many meshes it draws.
+    uint32_t drawCalls = 0;
+    // Of those, the glMultiDrawElementsIndirect calls.
+    uint32_t multiDraws = 0;
+
+    uint32_t stateChanges() const {
+        return programBinds + vertexArrayBinds + textureBinds + materialUniforms;
+    }
+
+    uint32_t avoidedStateChanges() const {
+        return skippedProgramBinds + skippedVertexArrayBinds + skippedTextureBinds + skippedMaterialUniforms;
+    }
+
+    void reset() {
+        *this = RenderQueueStats();
+    }
+};
+
+/**
+ * @brief Collects a frame's draws and submits them in an order that minimizes state changes.
+ *
+ * Each packet gets a 64-bit key, from the most significant bits down:
+ *
+ *     opaque:       pass (2) | shader (6) | textures (14) | mesh (16) | depth (26)
+ *     transparent:  pass (2) | far-to-near depth (26) | shader (6) | textures (14) | mesh (16)
+ *
+ * so one radix sort groups opaque meshes by program, then texture set, then mesh,
+ * nearest first within a group, and orders transparent meshes strictly back to front.
+ * Shader, texture set and mesh ids are handed out the first time each is seen and only
+ * affect the order; submit() skips a bind by comparing the actual GL objects, so the ids never
+ * have to be exact.
+ *
+ * A program that declares the draw data inputs (drawModel and drawMaterial at the InstanceData
+ * locations, as light_perspective.vert does) gets each draw's model matrix and material from
+ * attributes rather than uniforms. With a draw data buffer, the first submit() of a frame
+ * writes every packet's record into one section of it in a linear pass, which all passes draw
+ * from, and each draw picks its record by base instance; the section is fenced after the last
+ * pass. Otherwise the attributes' constant values are set per draw. Such programs must take
+ * the shininess from drawMaterial too, since the queue leaves their "material.shininess"
+ * uniform unset. Other programs get "model" and "material.shininess" uniforms.
+ *
+ * Where the context has multi-draw indirect (GL 4.3), streamed draws are not issued one by
+ * one: submit() also writes an indirect command per packet, and each run of consecutive
+ * packets that needs no state change in between (same program, vertex array and textures)
+ * becomes a single glMultiDrawElementsIndirect. Each command's base instance selects its
+ * draw data record, so shaders need no gl_DrawID. Older contexts keep the per-draw path.
+ */
+class RenderQueue {
+public:
+    /**
+     * @param streamDrawData whether to stream per-draw data through a ring buffer. It takes
+     * GL 4.2 (base instances); without it, the queue falls back to constant attributes.
+     * Streamed draws are batched into multi-draws on GL 4.3.
+     */
+    explicit RenderQueue(bool streamDrawData = false);
+
+    /**
+     * @brief Empties the queue for a new frame, seen through the given view matrix.
+     */
+    void begin(const glm::mat4& view);
+
+    /**
+     * @brief Draws meshes pushed with the variants' full program with the variant that suits
+     * each mesh instead. The variants must outlive the queue or be removed first.
+     */
+    void addVariants(ShaderVariants& variants);
+    void removeVariants(ShaderVariants& variants);
+
+    /**
+     * @brief Draws opaque meshes pushed with the program with the replacement instead, e.g., a
+     * program that fills a G-buffer; transparent meshes keep the program. Variants of the
+     * replacement apply. nullptr ends the replacement.
+     */
+    void replaceOpaqueProgram(const ShaderProgram& program, ShaderProgram* replacement);
+
+    /**
+     * @brief Queues a mesh drawn with the program at the given model matrix.
+     */
+    void push(const Mesh3D& mesh, ShaderProgram& program, const glm::mat4& model, float shininess,
+        RenderPass pass = RenderPass::Opaque);
+
+    /**
+     * @brief Sorts the queued packets and draws them. Every program's camera and light
+     * uniforms must already be set; the queue sets the draw data, or "model" and
+     * "material.shininess" for programs without it.
+     */
+    void submit(RenderQueueStats& stats);
+
+    /**
+     * @brief Draws only the queued packets of one pass, e.g., to draw something else between
+     * the opaque and transparent meshes. Each pass is drawn at most once per frame.
+     */
+    void submit(RenderQueueStats& stats, RenderPass pass);
+
+    size_t size() const;
+    const std::vector<DrawPacket>& packets() const;
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    struct ProgramInfo {
+        uint32_t id;
+        // The GL program the info was read from; a reloaded program is read again.
+        uint32_t glProgram;
+        // Whether the program reads the draw data attributes instead of a model uniform.
+        bool readsDrawData;
+    };
+
+    struct MeshIds {
+        uint32_t mesh;
+        uint32_t textures;
+        // The ShaderFeature bits its textures call for.
+        uint32_t features;
+    };
+
+    glm::mat4 m_view{ 1.f };
+    std::vector<DrawPacket> m_packets;
+    std::vector<SortEntry> m_order;
+    std::vector<SortEntry> m_scratch;
+    // Whether m_order holds the packets queued so far, sorted.
+    bool m_sorted = false;
+
+    bool m_streamDrawData;
+    // Created on the first submit(), with one InstanceData per packet.
+    std::unique_ptr<RingBuffer> m_drawData;
+    // Created on the first submit() with multi-draw indirect, with one command per packet.
+    std::unique_ptr<RingBuffer> m_commands;
+    // Whether the sorted packets' records (and commands) are written for this frame, where,
+    // and whether their sections are fenced yet.
+    bool m_written = false;
+    bool m_wroteCommands = false;
+    bool m_fenced = true;
+    uint32_t m_firstRecord = 0;
+    size_t m_commandOffset = 0;
+    // Packets drawn from the written records so far, over all passes.
+    uint32_t m_drawnPackets = 0;
+
+    std::vector<ShaderVariants*> m_variants;
+    ShaderProgram m_replacedProgram;
+    ShaderProgram* m_opaqueReplacement = nullptr;
+    std::unordered_map<const ShaderProgram*, ProgramInfo> m_programs;
+    // Keyed by Mesh3D::getId(), since a released mesh's address can come back as another mesh.
+    std::unordered_map<uint32_t, MeshIds> m_meshIds;
+    std::map<std::vector<uint32_t>, uint32_t> m_textureSetIds;
+
+    const ProgramInfo& programInfo(const ShaderProgram& program);
+    const MeshIds& meshIds(const Mesh3D& mesh);
+
+    // Fills m_order with the packets, sorted by key, unless it already is.
+    void sort();
+    // Writes the records and commands of every sorted packet, for all passes to draw from.
+    void writeDrawData();
+    // Fences the written sections, unless they already are.
+    void fenceDrawData();
+    // Draws the sorted packets in [first, end).
+    void draw(RenderQueueStats& stats, uint32_t first, uint32_t end);
+    // Sorts m_order by key, least significant byte first.
+    void radixSort();
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+/**
+ * @brief A GPU buffer that the CPU rewrites every frame, split into sections used in turn so
+ * that the CPU fills one while the GPU may still be reading the others.
+ *
+ * Where the context has buffer storage (GL 4.4), the whole buffer is mapped once, persistently
+ * and coherently, and writes go straight to it. Otherwise each section is mapped unsynchronized
+ * while it is written. Either way a fence per section keeps the CPU from overwriting data the
+ * GPU has not consumed yet; with three sections, that wait almost never happens.
+ */
+class RingBuffer {
+public:
+    static constexpr uint32_t SECTIONS = 3;
+
+    /**
+     * @param sectionBytes the initial size of each section. Sections grow by doubling, so
+     * section offsets stay multiples of it (e.g., of a record size it was a multiple of).
+     */
+    RingBuffer(GLenum target, size_t sectionBytes);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    /**
+     * @brief Moves to the next section, waiting for the GPU to finish with it, and returns
+     * where to write up to the given number of bytes. The section grows if it is too small,
+     * which replaces the buffer (see getId()).
+     */
+    void* beginWrite(size_t bytes);
+
+    /**
+     * @brief Finishes writing the current section.
+     * @return the section's byte offset in the buffer.
+     */
+    size_t endWrite();
+
+    /**
+     * @brief Marks the current section as in use by every command issued so far. Call it after
+     * the draws that read the section.
+     */
+    void fence();
+
+    uint32_t getId() const;
+    size_t getSectionBytes() const;
+    bool isPersistent() const;
+
+private:
+    GLenum m_target;
+    uint32_t m_buffer = 0;
+    size_t m_sectionBytes;
+    uint32_t m_section = SECTIONS - 1;
+    GLsync m_fences[SECTIONS] = {};
+    bool m_persistent;
+    // The persistent mapping of the whole buffer, or the current section's mapping otherwise.
+    std::byte* m_mapping = nullptr;
+
+    void allocate();
+    void release();
+    void wait(uint32_t section);
+};
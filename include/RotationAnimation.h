@@ -14,8 +14,8 @@ private:
 	/**
 	 * @brief Advance the animation by the given time interval.
 	 */
-	void applyAnimation(float dt) override {
-		object().rotate(m_perSecond * dt);
+	void applyAnimation(Object3D& object, float dt) override {
+		object.rotate(m_perSecond * dt);
 	}
 
 public:
@@ -23,7 +23,7 @@ public:
 	 * @brief Constructs a animation of a constant rotation by the given total rotation
 	 * angle, linearly interpolated across the given duration.
 	 */
-	RotationAnimation(Object3D& object, float duration, const glm::vec3& totalRotation) :
-		Animation(object, duration), m_perSecond(totalRotation / duration) {}
+	RotationAnimation(ObjectRef object, float duration, const glm::vec3& totalRotation) :
+		Animation(std::move(object), duration), m_perSecond(totalRotation / duration) {}
 };
 
@@ -0,0 +1,281 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <glm/ext.hpp>
+#include "Object3D.h"
+#include "Texture.h"
+
+/*
+ * Scenes are described in a line-based text format (.scene) for authoring, and compiled to a
+ * binary format (.sceneb) that is memory-mapped and read in place. The binary form is a header
+ * followed by packed arrays of the records below; strings live in one table of
+ * null-terminated strings and are referred to by offset. The layout is little-endian and
+ * versioned; a file with another version is recompiled from its text.
+ *
+ * A text scene looks like:
+ *
+ *     shader toon                      # a preset, or a vertex and a fragment shader path
+ *
+ *     object floor                     # the name is optional; named roots go in Scene::named
+ *         square                       # or: model <path> [flip_uvs] [keep_geometry]
+ *         texture <path> <sampler>     # squares only
+ *         position 0 0 0
+ *         rotation -90 0 0             # degrees
+ *         scale 100                    # or x y z
+ *         center, velocity, acceleration <x y z>; shininess <s>
+ *         occluder, no_gravity, hidden
+ *         transparent                  # blended, and drawn back to front after opaque objects
+ *         parent <name>                # an object defined earlier
+ *     end
+ *
+ *     animator                         # plays its animations in sequence
+ *         pause <object> <seconds>
+ *         rotate <object> <seconds> <x y z degrees>
+ *         translate <object> <seconds> <x y z>
+ *         bezier <object> <seconds> <start> <control 1> <control 2> <end>
+ *     end
+ *
+ *     light directional|point|spot     # overrides only the given fields of the scene's light
+ *         position, direction, ambient, diffuse, specular <x y z>
+ *         attenuation <constant> <linear> <quadratic>
+ *         cutoff <inner degrees> <outer degrees>
+ *         hidden
+ *     end
+ */
+
+constexpr uint32_t SCENE_FILE_VERSION = 1;
+// Marks an absent string or node reference.
+constexpr uint32_t SCENE_FILE_NONE = UINT32_MAX;
+
+struct SceneFileSection {
+    // Byte offset from the start of the file, and the number of records.
+    uint32_t offset;
+    uint32_t count;
+};
+
+struct SceneFileHeader {
+    char magic[4];
+    uint32_t version;
+    // A preset name (see Scene.cpp) if fragmentShader is SCENE_FILE_NONE, else a vertex shader path.
+    uint32_t vertexShader;
+    uint32_t fragmentShader;
+    SceneFileSection nodes;
+    SceneFileSection textures;
+    SceneFileSection animators;
+    SceneFileSection animations;
+    SceneFileSection lights;
+    // The string table; count is in bytes.
+    SceneFileSection strings;
+};
+
+enum SceneNodeFlags : uint32_t {
+    NODE_SQUARE = 1 << 0,
+    NODE_FLIP_UVS = 1 << 1,
+    NODE_KEEP_GEOMETRY = 1 << 2,
+    NODE_OCCLUDER = 1 << 3,
+    NODE_NO_GRAVITY = 1 << 4,
+    NODE_HIDDEN = 1 << 5,
+    NODE_SHININESS = 1 << 6,
+    NODE_TRANSPARENT = 1 << 7,
+};
+
+/**
+ * @brief One object of the scene. Parents always come before their children.
+ */
+struct SceneFileNode {
+    uint32_t name;
+    uint32_t parent;
+    // The model path; unused for squares.
+    uint32_t model;
+    uint32_t flags;
+    // The textures of a square.
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    glm::vec3 position;
+    // In radians.
+    glm::vec3 rotation;
+    glm::vec3 scale;
+    glm::vec3 center;
+    glm::vec3 velocity;
+    glm::vec3 acceleration;
+    float shininess;
+};
+
+struct SceneFileTexture {
+    uint32_t path;
+    uint32_t sampler;
+};
+
+struct SceneFileAnimator {
+    uint32_t firstAnimation;
+    uint32_t animationCount;
+};
+
+enum class SceneAnimationType : uint32_t {
+    Pause,
+    Rotation,
+    Translation,
+    Bezier,
+};
+
+struct SceneFileAnimation {
+    SceneAnimationType type;
+    uint32_t node;
+    float duration;
+    // The total rotation (in radians) or movement in points[0]; all four points for a Bezier.
+    glm::vec3 points[4];
+};
+
+enum class SceneLightType : uint32_t {
+    Directional,
+    Point,
+    Spot,
+};
+
+enum SceneLightFields : uint32_t {
+    LIGHT_POSITION = 1 << 0,
+    LIGHT_DIRECTION = 1 << 1,
+    LIGHT_AMBIENT = 1 << 2,
+    LIGHT_DIFFUSE = 1 << 3,
+    LIGHT_SPECULAR = 1 << 4,
+    LIGHT_ATTENUATION = 1 << 5,
+    LIGHT_CUTOFF = 1 << 6,
+    LIGHT_HIDDEN = 1 << 7,
+};
+
+struct SceneFileLight {
+    SceneLightType type;
+    // Which of the fields below were given; the rest keep the scene's defaults.
+    uint32_t fields;
+    glm::vec3 position;
+    glm::vec3 direction;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float constant;
+    float linear;
+    float quadratic;
+    // In degrees, like the scene's SpotLight.
+    float cutOff;
+    float outerCutOff;
+};
+
+static_assert(std::is_trivially_copyable_v<SceneFileNode> && std::is_trivially_copyable_v<SceneFileAnimation>
+    && std::is_trivially_copyable_v<SceneFileLight>, "scene file records are read in place");
+
+/**
+ * @brief Compiles the text form of a scene to its binary form.
+ * @param sourceName used in error messages, which are thrown as std::runtime_error.
+ */
+std::vector<std::byte> compileSceneText(std::string_view text, const std::string& sourceName);
+
+/**
+ * @brief A read-only view of a whole file, memory-mapped where the platform allows it and
+ * read into memory otherwise.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::byte* data() const;
+    size_t size() const;
+
+private:
+    const std::byte* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+    std::vector<std::byte> m_buffer;
+
+    void unmap();
+};
+
+template <typename T>
+struct SceneFileArray {
+    const T* data;
+    uint32_t count;
+
+    const T* begin() const { return data; }
+    const T* end() const { return data + count; }
+    const T& operator[](uint32_t i) const { return data[i]; }
+    uint32_t size() const { return count; }
+};
+
+/**
+ * @brief A compiled scene. The records are checked once when the file is opened, so readers
+ * can follow every offset and index without further checks.
+ */
+class SceneFile {
+public:
+    explicit SceneFile(MappedFile file);
+    explicit SceneFile(std::vector<std::byte> data);
+
+    /**
+     * @brief Opens a .sceneb file directly, or a text scene through its compiled copy next to
+     * it, which is (re)built whenever it is missing or older than the text.
+     */
+    static SceneFile load(const std::filesystem::path& path);
+
+    const SceneFileHeader& header() const;
+    SceneFileArray<SceneFileNode> nodes() const;
+    SceneFileArray<SceneFileTexture> textures() const;
+    SceneFileArray<SceneFileAnimator> animators() const;
+    SceneFileArray<SceneFileAnimation> animations() const;
+    SceneFileArray<SceneFileLight> lights() const;
+
+    /**
+     * @brief A string from the string table, or an empty string for SCENE_FILE_NONE.
+     */
+    std::string_view string(uint32_t offset) const;
+
+private:
+    // Where the data lives: a mapped file, or a buffer compiled in memory.
+    std::optional<MappedFile> m_file;
+    std::vector<std::byte> m_buffer;
+    const std::byte* m_data;
+    size_t m_size;
+
+    template <typename T>
+    SceneFileArray<T> section(const SceneFileSection& s) const {
+        return { reinterpret_cast<const T*>(m_data + s.offset), s.count };
+    }
+
+    void validate() const;
+};
+
+/**
+ * @brief Models and textures loaded for earlier scenes, so loading a scene whose assets are
+ * cached costs only copies of objects, which share the already-uploaded meshes.
+ */
+class SceneAssets {
+public:
+    /**
+     * @brief The model at the path, imported with Assimp the first time it is asked for.
+     */
+    const Object3D& model(const std::string& path, bool flipUVCoords, bool keepGeometry);
+
+    /**
+     * @brief The texture at the path, bound to the given sampler.
+     */
+    Texture texture(const std::string& path, const std::string& samplerName);
+
+private:
+    std::unordered_map<std::string, Object3D> m_models;
+    std::unordered_map<std::string, Texture> m_textures;
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include "ShaderProgram.h"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The programs a ShaderManager keeps, and what became of their builds.
+ */
+struct ShaderManagerStats {
+    uint32_t programs = 0;
+    // Builds submitted and not yet finished.
+    uint32_t pending = 0;
+    // Programs rebuilt because one of their files changed.
+    uint32_t reloads = 0;
+    // Builds that failed to compile or link. The program kept what it had before.
+    uint32_t failures = 0;
+};
+
+/**
+ * @brief Builds shader programs without waiting on each one, and rebuilds them when their
+ * files change.
+ *
+ * request() submits a program's compiles and link and returns at once; the program is linked
+ * by a later update() or finish(). Submitting every program before waiting on any lets the
+ * driver compile them together, on its own threads where it has GL_KHR_parallel_shader_compile
+ * (or the ARB version). With the extension, update() only takes the builds the driver reports
+ * as complete; without it, asking for a result blocks until the driver is done, so update()
+ * takes one build per call.
+ *
+ * update() also checks the files of each program, includes too, every WATCH_INTERVAL and
+ * rebuilds those that changed. A finished build replaces the program in every copy at once
+ * (see ShaderProgram::adopt()). A build that fails is reported and dropped, and the program
+ * keeps the GL program it had: the last one that linked, or none. GL calls must come from the
+ * thread of the context, so the manager only runs when its owner calls it.
+ */
+class ShaderManager {
+public:
+    static constexpr std::chrono::milliseconds WATCH_INTERVAL{ 500 };
+
+    /**
+     * @brief The manager of the programs the shader factories build.
+     */
+    static ShaderManager& shared();
+
+    ShaderManager() = default;
+
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator=(const ShaderManager&) = delete;
+
+    /**
+     * @brief Submits a program's build. Its uniforms and attributes are only known once the
+     * build finishes, so wait for it with finish() before setting any.
+     * @param defines #define lines inserted at the top of both shaders.
+     */
+    ShaderProgram request(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+        const std::string& defines = "");
+
+    /**
+     * @brief Submits a build of a program requested before, from the same shaders but with
+     * other defines. Its GL program stays 0 until the build finishes.
+     */
+    ShaderProgram requestVariant(const ShaderProgram& program, const std::string& defines);
+
+    /**
+     * @brief The files a program was last built from, includes too; none for a program that
+     * does not come from the manager.
+     */
+    std::vector<std::string> files(const ShaderProgram& program) const;
+
+    /**
+     * @brief Takes finished builds, without waiting on the driver where it can tell, and
+     * rebuilds programs whose files changed. Call it once per frame.
+     */
+    void update();
+
+    /**
+     * @brief Waits for every submitted build.
+     */
+    void finish();
+
+    void setWatching(bool watching);
+    bool isWatching() const;
+
+    ShaderManagerStats stats() const;
+
+private:
+    struct Build {
+        uint32_t vertex;
+        uint32_t fragment;
+        uint32_t program;
+        uint64_t cacheKey;
+    };
+
+    struct Entry {
+        // Shares its state with the copies handed out.
+        ShaderProgram program;
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::string defines;
+        // The files read for the last build, includes too, and when each was last written.
+        std::vector<std::string> files;
+        std::vector<std::filesystem::file_time_type> writeTimes;
+        // The build in flight, if any.
+        bool building = false;
+        Build build{};
+    };
+
+    std::vector<Entry> m_entries;
+    bool m_checked = false;
+    bool m_parallel = false;
+    bool m_watching = true;
+    std::chrono::steady_clock::time_point m_lastWatch;
+    uint32_t m_reloads = 0;
+    uint32_t m_failures = 0;
+
+    // Whether the driver can report a build's completion without blocking.
+    bool isParallel();
+    // Reads the entry's files and submits its build, or adopts a cached binary right away.
+    void submit(Entry& entry);
+    bool isComplete(const Entry& entry) const;
+    // Takes the entry's build: adopts the program if it linked, reports it if not.
+    void complete(Entry& entry);
+    // Whether a file of the entry was written since its last build.
+    bool changed(const Entry& entry) const;
+};
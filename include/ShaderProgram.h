@@ -1,22 +1,172 @@
 #pragma once
 #include <glm/ext.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The binding points of uniform blocks that every program shares. A linked program's
+ * blocks are bound to these by name, since GLSL 3.30 cannot give them a binding itself.
+ */
+enum UniformBlockBinding : uint32_t {
+	// The FrameData block of shaders/frame_data.glsl (see FrameUniforms.h).
+	FRAME_UNIFORMS_BINDING = 0,
+};
+
+/**
+ * @brief The texture units of samplers that every program shares, set by name whenever a
+ * program is linked, for the same reason. They are the last of the 16 units GL 3.3 guarantees,
+ * clear of the units meshes bind their maps to.
+ */
+enum SharedTextureUnit : uint32_t {
+	// The shadow atlas of shaders/shadows.glsl (see ShadowMaps.h).
+	SHADOW_ATLAS_UNIT = 12,
+	// The buffer textures of shaders/clusters.glsl (see LightClusters.h).
+	CLUSTER_LIGHTS_UNIT = 13,
+	CLUSTER_RANGES_UNIT = 14,
+	CLUSTER_INDICES_UNIT = 15,
+};
+
+/**
+ * @brief A uniform's slot in its program's uniform table, looked up once with
+ * ShaderProgram::uniform() so that per-draw uniforms skip the name lookup too.
+ */
+struct UniformHandle {
+	int32_t index = -1;
+
+	bool isValid() const {
+		return index >= 0;
+	}
+};
+
+/**
+ * @brief Uniform uploads across all programs, and the GL calls that were saved.
+ */
+struct UniformStats {
+	// glUniform* calls made.
+	uint32_t uploads = 0;
+	// Uploads skipped because the uniform already had the value.
+	uint32_t skippedUploads = 0;
+	// glGetUniformLocation calls the location table answered instead.
+	uint32_t locationLookupsSaved = 0;
+
+	void reset() {
+		*this = UniformStats();
+	}
+};
+
+/**
+ * @brief A linked vertex+fragment shader program. Copies share the same GL program, uniform
+ * table and shadow of uniform values.
+ *
+ * The active uniforms are enumerated once when the program is linked, and each one keeps a
+ * copy of the value last uploaded to it; setting a uniform to the value it already has makes
+ * no GL call. Uniforms must be set while their program is active, as with glUniform*.
+ */
 class ShaderProgram {
-	uint32_t m_programId;
+	struct Uniform {
+		int32_t location;
+		uint32_t type;
+		// A copy of the last value uploaded, if known.
+		bool known;
+		alignas(16) std::byte value[sizeof(glm::mat4)];
+	};
+
+	struct NameHash {
+		using is_transparent = void;
+		size_t operator()(std::string_view name) const {
+			return std::hash<std::string_view>{}(name);
+		}
+	};
+
+	struct State {
+		// 0 until a program is linked.
+		uint32_t programId = 0;
+		std::vector<Uniform> uniforms;
+		std::unordered_map<std::string, int32_t, NameHash, std::equal_to<>> indices;
+		// The locations of the active vertex attributes.
+		std::unordered_map<std::string, int32_t, NameHash, std::equal_to<>> attributes;
+	};
+
+	std::shared_ptr<State> m_state;
+
+	void buildUniformTable();
+	int32_t indexOf(std::string_view uniformName) const;
+	// Uploads the value unless the shadow says the uniform already has it.
+	template <typename T>
+	void upload(int32_t index, const T& value);
 
 public:
 	ShaderProgram();
 	void load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
 
+	/**
+	 * @brief Reads a shader file with its `#include` lines expanded.
+	 * @param files if given, every file read is appended to it, the shader itself first.
+	 * @param defines lines such as "#define HAS_NORMAL_MAP", inserted after the #version line.
+	 */
+	static std::string readSource(const std::string& path, std::vector<std::string>* files = nullptr,
+		std::string_view defines = {});
+
+	/**
+	 * @brief Makes every copy of the program use another linked GL program, e.g., one rebuilt
+	 * from changed sources, and deletes the old one. Uniforms the new program shares with the
+	 * old one keep the values set so far.
+	 */
+	void adopt(uint32_t programId);
+
 	void activate();
 
-	void setUniform(const std::string& uniformName, bool value);
-	void setUniform(const std::string& uniformName, int32_t value);
-	void setUniform(const std::string& uniformName, float value);
-	void setUniform(const std::string& uniformName, const glm::vec2& value);
-	void setUniform(const std::string& uniformName, const glm::vec3& value);
-	void setUniform(const std::string& uniformName, const glm::vec4& value);
-	void setUniform(const std::string& uniformName, const glm::mat2& value);
-	void setUniform(const std::string& uniformName, const glm::mat3& value);
-	void setUniform(const std::string& uniformName, const glm::mat4& value);
-};
\ No newline at end of file
+	uint32_t getId() const;
+
+	/**
+	 * @brief Whether the two are copies of the same program.
+	 */
+	bool operator==(const ShaderProgram& other) const;
+
+	/**
+	 * @brief The handle of a uniform, or an invalid handle if the program has no active
+	 * uniform of that name. Setting an invalid handle does nothing, like location -1 in GL.
+	 */
+	UniformHandle uniform(std::string_view uniformName) const;
+
+	/**
+	 * @brief The location of an active vertex attribute, or -1 if the program has none of
+	 * that name.
+	 */
+	int32_t attributeLocation(std::string_view attributeName) const;
+
+	/**
+	 * @brief Forgets the shadowed values, for when uniforms were set behind the program's back.
+	 */
+	void invalidateUniforms();
+
+	void setUniform(std::string_view uniformName, bool value);
+	void setUniform(std::string_view uniformName, int32_t value);
+	void setUniform(std::string_view uniformName, float value);
+	void setUniform(std::string_view uniformName, const glm::vec2& value);
+	void setUniform(std::string_view uniformName, const glm::vec3& value);
+	void setUniform(std::string_view uniformName, const glm::vec4& value);
+	void setUniform(std::string_view uniformName, const glm::mat2& value);
+	void setUniform(std::string_view uniformName, const glm::mat3& value);
+	void setUniform(std::string_view uniformName, const glm::mat4& value);
+
+	void setUniform(UniformHandle uniform, bool value);
+	void setUniform(UniformHandle uniform, int32_t value);
+	void setUniform(UniformHandle uniform, float value);
+	void setUniform(UniformHandle uniform, const glm::vec2& value);
+	void setUniform(UniformHandle uniform, const glm::vec3& value);
+	void setUniform(UniformHandle uniform, const glm::vec4& value);
+	void setUniform(UniformHandle uniform, const glm::mat2& value);
+	void setUniform(UniformHandle uniform, const glm::mat3& value);
+	void setUniform(UniformHandle uniform, const glm::mat4& value);
+
+	/**
+	 * @brief Uniform work since the last reset, over every program.
+	 */
+	static UniformStats& stats();
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ShaderProgram.h"
+#include "Texture.h"
+
+struct FrameData;
+
+/**
+ * @brief The optional parts of a lighting shader, each turned on by a define in
+ * shaders/features.glsl. A program built without any of the defines has every feature.
+ */
+enum ShaderFeature : uint32_t {
+    // HAS_NORMAL_MAP: normals come from material.normal rather than the vertices.
+    FEATURE_NORMAL_MAP = 1 << 0,
+    // HAS_SPECULAR_MAP: specular color comes from material.specular rather than the diffuse map.
+    FEATURE_SPECULAR_MAP = 1 << 1,
+    // HAS_DIR_LIGHT, NUM_POINT_LIGHTS 1 and HAS_SPOT_LIGHT: the frame's lights.
+    FEATURE_DIR_LIGHT = 1 << 2,
+    FEATURE_POINT_LIGHT = 1 << 3,
+    FEATURE_SPOT_LIGHT = 1 << 4,
+    // HAS_CLUSTER_LIGHTS: the lights of the cluster grid (see LightClusters.h).
+    FEATURE_CLUSTER_LIGHTS = 1 << 5,
+    // HAS_SHADOWS: the frame's lights are shadowed (see ShadowMaps.h).
+    FEATURE_SHADOWS = 1 << 6,
+
+    FEATURE_MATERIAL = FEATURE_NORMAL_MAP | FEATURE_SPECULAR_MAP,
+    FEATURE_LIGHTS = FEATURE_DIR_LIGHT | FEATURE_POINT_LIGHT | FEATURE_SPOT_LIGHT | FEATURE_CLUSTER_LIGHTS
+        | FEATURE_SHADOWS,
+    FEATURE_ALL = FEATURE_MATERIAL | FEATURE_LIGHTS,
+};
+
+/**
+ * @brief The variants of a program built so far.
+ */
+struct ShaderVariantStats {
+    uint32_t variants = 0;
+    // Variants still building, or that failed to; their meshes are drawn with the full program.
+    uint32_t pending = 0;
+};
+
+/**
+ * @brief Versions of one lighting program with only the features a mesh needs, so a mesh
+ * with only a diffuse map gets no normal map or specular map sampling, and lights that are
+ * off cost nothing.
+ *
+ * The full program has every feature and is always ready. A variant is requested from the
+ * ShaderManager the first time a mesh needs it, and kept from then on; until it has linked,
+ * select() hands out the full program instead. The material features of a mesh follow from
+ * the sampler names of its textures, and the light features from the frame's lights, set once
+ * per frame with setLights().
+ */
+class ShaderVariants {
+public:
+    /**
+     * @param program the full program, from the ShaderManager. Its shaders must include
+     * shaders/features.glsl.
+     */
+    explicit ShaderVariants(ShaderProgram program);
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    /**
+     * @brief Whether the program's shaders include shaders/features.glsl, so that its
+     * variants differ. The program must come from the ShaderManager.
+     */
+    static bool supports(const ShaderProgram& program);
+
+    /**
+     * @brief The material features of a mesh with the given textures.
+     */
+    static uint32_t materialFeatures(const std::vector<Texture>& textures);
+
+    /**
+     * @brief The light features of a frame: the lights that have any color at all, and the
+     * cluster grid and shadows if they are in use.
+     */
+    static uint32_t lightFeatures(const FrameData& frame);
+
+    /**
+     * @brief The #define lines of a variant.
+     */
+    static std::string defines(uint32_t features);
+
+    const ShaderProgram& program() const;
+
+    void setLights(uint32_t lightFeatures);
+
+    /**
+     * @brief The program to draw a mesh with the given material features with, under the
+     * current lights. References stay valid for as long as the variants live.
+     */
+    ShaderProgram& select(uint32_t materialFeatures);
+
+    ShaderVariantStats stats() const;
+
+private:
+    ShaderProgram m_program;
+    uint32_t m_lights = FEATURE_LIGHTS;
+    // By features; nodes never move, so the references select() returns stay valid.
+    std::unordered_map<uint32_t, ShaderProgram> m_variants;
+};
@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/ext.hpp>
+#include "Bounds.h"
+#include "FrameUniforms.h"
+#include "Mesh3D.h"
+#include "Object3D.h"
+#include "ShaderProgram.h"
+
+/**
+ * @brief What one shadow map cost in the last render().
+ */
+struct ShadowViewStats {
+    // Casters drawn into the map's cache of static casters; 0 while the cache held.
+    uint32_t staticDraws = 0;
+    // Casters drawn over the cache, every frame.
+    uint32_t dynamicDraws = 0;
+    // Depth samples written, counted by an occlusion query and read a few frames late, so
+    // reading it never waits on the GPU.
+    uint64_t fragments = 0;
+    // Texels copied from the cache into the atlas, to start over from the static casters.
+    uint32_t copiedTexels = 0;
+
+    void add(const ShadowViewStats& other) {
+        staticDraws += other.staticDraws;
+        dynamicDraws += other.dynamicDraws;
+        fragments += other.fragments;
+        copiedTexels += other.copiedTexels;
+    }
+};
+
+/**
+ * @brief What the last render() drew.
+ */
+struct ShadowStats {
+    ShadowViewStats cascades[SHADOW_CASCADES];
+    ShadowViewStats spot;
+    // The point light's six faces, added up.
+    ShadowViewStats point;
+    uint32_t staticCasters = 0;
+    uint32_t dynamicCasters = 0;
+    // Maps whose cache was drawn again, because the light or a static caster moved.
+    uint32_t staticRedraws = 0;
+};
+
+/**
+ * @brief Shadow maps for the frame's lights, in one depth atlas of TILE_SIZE tiles that the
+ * lighting shaders sample through shaders/shadows.glsl.
+ *
+ * The directional light gets SHADOW_CASCADES cascades, each covering a slice of the view
+ * frustum up to the shadow distance, nearer slices thinner. A cascade is fitted around a
+ * sphere enclosing its slice, so its size does not change as the camera turns, and moved in
+ * steps of an eighth of its width, a whole number of texels, with room to spare for the slice;
+ * between steps, its projection stays exactly the same. The spot light gets a perspective map
+ * and the point light six cube faces, each optional.
+ *
+ * Casters are the meshes of the scene's objects. An object that has not moved for
+ * SETTLE_FRAMES frames is static: its meshes are drawn into a cache, a second atlas, only when
+ * a map's projection changes or a static object moves, appears or goes away. Each frame, a
+ * map whose dynamic casters were drawn last frame is copied back from the cache, and the
+ * dynamic casters are drawn over it; a map with nothing moving costs nothing.
+ */
+class ShadowMaps {
+public:
+    static constexpr uint32_t TILE_SIZE = 1024;
+    static constexpr uint32_t SETTLE_FRAMES = 30;
+
+    ShadowMaps();
+    ~ShadowMaps();
+
+    ShadowMaps(const ShadowMaps&) = delete;
+    ShadowMaps& operator=(const ShadowMaps&) = delete;
+
+    /**
+     * @brief How far from the camera the cascades reach; nothing further is shadowed by the
+     * directional light.
+     */
+    void setDistance(float distance);
+    void setSpotShadows(bool enabled);
+    void setPointShadows(bool enabled);
+
+    /**
+     * @brief Draws the maps for the frame's lights and camera, binds the atlas, and fills in
+     * the frame's shadow data. Leaves the framebuffer and viewport to be set again.
+     */
+    void render(FrameData& frame, const ObjectPool& objects);
+
+    const ShadowStats& stats() const;
+
+private:
+    // The maps: the cascades, the spot light, and the point light's faces, in atlas order.
+    static constexpr uint32_t SPOT_VIEW = SHADOW_CASCADES;
+    static constexpr uint32_t POINT_VIEW = SPOT_VIEW + 1;
+    static constexpr uint32_t VIEWS = POINT_VIEW + 6;
+    static constexpr uint32_t QUERIES = 3;
+
+    struct Caster {
+        const Mesh3D* mesh;
+        glm::mat4 model;
+        BoundingSphere sphere;
+    };
+
+    // Whether an object pool slot's object has been still, and for how long.
+    struct ObjectState {
+        uint32_t generation = 0;
+        uint64_t transforms = 0;
+        uint32_t stillFrames = 0;
+        bool isStatic = false;
+        // Whether the slot holds an object, and whether it was seen this frame.
+        bool present = false;
+        bool seen = false;
+    };
+
+    struct View {
+        // World space to clip space, as the map is drawn.
+        glm::mat4 matrix{ 1.f };
+        bool active = false;
+        // Cascades keep casters in front of their near plane by clamping their depth.
+        bool depthClamp = false;
+        // The matrix the cache was drawn with.
+        glm::mat4 cachedMatrix{ 1.f };
+        bool cached = false;
+        // Whether the atlas holds more than the cache, i.e., dynamic casters.
+        bool dirty = true;
+    };
+
+    uint32_t m_atlas = 0;
+    uint32_t m_atlasFbo = 0;
+    uint32_t m_cache = 0;
+    uint32_t m_cacheFbo = 0;
+    ShaderProgram m_depthProgram;
+
+    float m_distance = 60.f;
+    bool m_spotShadows = false;
+    bool m_pointShadows = false;
+
+    std::vector<ObjectState> m_objects;
+    std::vector<Caster> m_staticCasters;
+    std::vector<Caster> m_dynamicCasters;
+    // The casters of the object being gathered.
+    std::vector<Caster> m_objectCasters;
+    // Whether the static casters changed this frame.
+    bool m_staticChanged = true;
+
+    View m_views[VIEWS];
+    // Samples passed while each map was drawn, one set of queries per frame in flight.
+    uint32_t m_queries[QUERIES][VIEWS] = {};
+    bool m_queryIssued[QUERIES][VIEWS] = {};
+    uint32_t m_frame = 0;
+
+    ShadowViewStats m_viewStats[VIEWS];
+    ShadowStats m_stats;
+
+    // Sorts the objects' meshes into static and dynamic casters.
+    void gatherCasters(const ObjectPool& objects);
+    // Sets up the cascades around the camera, and fills in their part of the frame's data.
+    void fitCascades(FrameData& frame);
+    // Likewise for the spot light and the point light's faces.
+    void fitLights(FrameData& frame);
+    // Draws the casters that reach the view into the bound framebuffer; returns how many.
+    uint32_t drawCasters(const View& view, const std::vector<Caster>& casters);
+    void renderView(uint32_t index, uint32_t slot);
+    // The view's tile in the atlas: its lower left corner in texels.
+    static glm::ivec2 tileOf(uint32_t view);
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "Bounds.h"
+#include "Frustum.h"
+
+/**
+ * @brief A loose, hashed uniform grid over world-space boxes, for "what is near here"
+ * queries without scanning every object.
+ *
+ * Each item lives in exactly one cell: the one containing its center. Items may hang over
+ * their cell by up to half a cell on each side, so queries look half a cell past their
+ * region. Moving an item is O(1), and only touches the grid when its center changes cells.
+ * Items bigger than a cell (floors, walls) are kept in a separate list that every query
+ * checks.
+ */
+class SpatialGrid {
+public:
+    using ItemId = uint32_t;
+
+    /**
+     * @param cellSize the edge length of a cell; roughly the size of a typical object.
+     */
+    explicit SpatialGrid(float cellSize = 8.f);
+
+    /**
+     * @brief Adds an item and returns the id used to update or remove it.
+     * @param userId the value reported for this item by queries.
+     */
+    ItemId insert(const AABB& bounds, uint32_t userId);
+    void update(ItemId id, const AABB& bounds);
+    void remove(ItemId id);
+
+    size_t size() const;
+    const AABB& getBounds(ItemId id) const;
+
+    // Each query calls the visitor with the user id of every item that matches.
+    using Visitor = std::function<void(uint32_t userId)>;
+
+    void queryBox(const AABB& box, const Visitor& visit) const;
+    void querySphere(const glm::vec3& center, float radius, const Visitor& visit) const;
+    void queryFrustum(const Frustum& frustum, const Visitor& visit) const;
+
+    /**
+     * @brief Finds the k items whose boxes are nearest to a point, ordered nearest first.
+     * @param maxDistance items farther than this are ignored.
+     */
+    std::vector<uint32_t> queryNearest(const glm::vec3& point, size_t k,
+        float maxDistance = std::numeric_limits<float>::max()) const;
+
+private:
+    struct Item {
+        AABB bounds;
+        uint32_t userId;
+        bool alive;
+        bool large;
+        uint64_t cell;
+        // Position of the item's id within its cell's list (or the large list).
+        uint32_t slot;
+    };
+
+    float m_cellSize;
+    float m_invCellSize;
+
+    std::vector<Item> m_items;
+    std::vector<ItemId> m_freeIds;
+    std::unordered_map<uint64_t, std::vector<ItemId>> m_cells;
+    std::vector<ItemId> m_large;
+    size_t m_count = 0;
+
+    glm::ivec3 cellOf(const glm::vec3& p) const;
+    static uint64_t keyOf(const glm::ivec3& cell);
+
+    void link(ItemId id);
+    void unlink(ItemId id);
+
+    // Calls visit(id) for every item that might overlap the box.
+    void forCandidates(const AABB& box, const std::function<void(ItemId)>& visit) const;
+};
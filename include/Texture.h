@@ -2,6 +2,7 @@
 #include <glad/glad.h>
 #include <string>
 #include <filesystem>
+#include "GLState.h"
 #include "StbImage.h"
 
 /**
@@ -20,7 +21,7 @@ struct Texture {
 	static Texture loadImage(const StbImage& texture, const std::string& samplerName) {
 		uint32_t texId;
 		glGenTextures(1, &texId);
-		glBindTexture(GL_TEXTURE_2D, texId);
+		GLState::shared().bindTexture(0, texId);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -28,7 +29,6 @@ struct Texture {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.getWidth(), texture.getHeight(), 0, GL_RGBA,
 			GL_UNSIGNED_BYTE, texture.getData());
 		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
 
 		return Texture{ texId, samplerName };
 	}
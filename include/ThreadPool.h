@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads that run data-parallel loops.
+ *
+ * parallelFor() hands out loop indices to the workers and the calling thread, and returns
+ * once every index has run. Only one loop runs at a time, and a job must not call
+ * parallelFor() on the same pool.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workerCount = defaultWorkerCount()) {
+        for (size_t i = 0; i < workerCount; i++) {
+            m_workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Runs job(i) for every i in [0, count), spread across the workers and the
+     * calling thread. Blocks until all of them have finished.
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)>& job) {
+        if (count == 0)
+            return;
+        if (m_workers.empty() || count == 1) {
+            for (size_t i = 0; i < count; i++) {
+                job(i);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> submit(m_submitMutex);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_count = count;
+            m_next = 0;
+            m_finishedWorkers = 0;
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        runJobs(job, count);
+
+        // Every worker checks in for every loop, so none can still be looking at this
+        // loop's job once we return.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_finished.wait(lock, [this] { return m_finishedWorkers == m_workers.size(); });
+    }
+
+    size_t workerCount() const {
+        return m_workers.size();
+    }
+
+    /**
+     * @brief Leaves one hardware thread for the calling (render) thread.
+     */
+    static size_t defaultWorkerCount() {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n > 1 ? n - 1 : 0;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_submitMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_finished;
+
+    const std::function<void(size_t)>* m_job = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next{ 0 };
+    size_t m_finishedWorkers = 0;
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+
+    void runJobs(const std::function<void(size_t)>& job, size_t count) {
+        size_t i;
+        while ((i = m_next.fetch_add(1)) < count) {
+            job(i);
+        }
+    }
+
+    void workerLoop() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != seen; });
+            if (m_stopping)
+                return;
+
+            seen = m_generation;
+            const auto* job = m_job;
+            size_t count = m_count;
+            lock.unlock();
+
+            runJobs(*job, count);
+
+            lock.lock();
+            if (++m_finishedWorkers == m_workers.size()) {
+                m_finished.notify_all();
+            }
+        }
+    }
+};
@@ -13,8 +13,8 @@ private:
 	/**
 	 * @brief Advance the animation by the given time interval.
 	 */
-	void applyAnimation(float dt) override {
-		object().move(m_perSecond * dt);
+	void applyAnimation(Object3D& object, float dt) override {
+		object.move(m_perSecond * dt);
 	}
 
 public:
@@ -22,7 +22,7 @@ public:
 	 * @brief Constructs a animation of a constant rotation by the given total rotation
 	 * angle, linearly interpolated across the given duration.
 	 */
-	TranslationAnimation(Object3D& obj, float duration, const glm::vec3& totalMovement) :
-		Animation(obj, duration), m_perSecond(totalMovement / duration) {}
+	TranslationAnimation(ObjectRef obj, float duration, const glm::vec3& totalMovement) :
+		Animation(std::move(obj), duration), m_perSecond(totalMovement / duration) {}
 };
 
@@ -0,0 +1,46 @@
+// The point and spot lights of the cluster grid that LightClusters builds each frame (see
+// include/LightClusters.h). Include after frame_data.glsl. The samplers are bound to their
+// units when a program links.
+
+// Six texels per light; the layout must match ClusterLight in include/LightClusters.h.
+uniform samplerBuffer clusterLights;
+// Per cluster: the offset of its first light index, and its number of lights.
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+
+// A light of the grid, as a spot light; the cone of a point light takes in every direction.
+// Past the radius, the light is left out of the clusters, so it must be left out here too.
+SpotLight clusterLight(int index, out float radius) {
+    int texel = index * 6;
+    vec4 positionRadius = texelFetch(clusterLights, texel);
+    vec4 directionCutOff = texelFetch(clusterLights, texel + 1);
+    vec4 ambientOuterCutOff = texelFetch(clusterLights, texel + 2);
+    vec4 diffuseConstant = texelFetch(clusterLights, texel + 3);
+    vec4 specularLinear = texelFetch(clusterLights, texel + 4);
+    vec4 quadratic = texelFetch(clusterLights, texel + 5);
+
+    SpotLight light;
+    light.position = positionRadius.xyz;
+    light.direction = directionCutOff.xyz;
+    light.cutOff = directionCutOff.w;
+    light.outerCutOff = ambientOuterCutOff.w;
+    light.constant = diffuseConstant.w;
+    light.linear = specularLinear.w;
+    light.quadratic = quadratic.x;
+    light.ambient = ambientOuterCutOff.rgb;
+    light.diffuse = diffuseConstant.rgb;
+    light.specular = specularLinear.rgb;
+    radius = positionRadius.w;
+    return light;
+}
+
+// The offset and count of the light indices of the cluster a fragment falls in.
+uvec2 clusterRange(vec3 worldPos) {
+    float depth = -(view * vec4(worldPos, 1.0)).z;
+    uvec3 cell;
+    cell.xy = uvec2(gl_FragCoord.xy / clusterScale.xy);
+    cell.z = uint(max(log(depth) * clusterScale.z + clusterScale.w, 0.0));
+    cell = min(cell, clusterGrid.xyz - 1u);
+    int cluster = int(cell.x + clusterGrid.x * (cell.y + clusterGrid.y * cell.z));
+    return texelFetch(clusterRanges, cluster).rg;
+}
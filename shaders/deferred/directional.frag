@@ -0,0 +1,30 @@
+#version 330
+// Shades every covered pixel with the frame's directional light and spot light.
+layout (location=0) out vec4 FragColor;
+
+#include "../frame_data.glsl"
+#include "../shadows.glsl"
+#include "gbuffer.glsl"
+
+void main() {
+    Surface surface = readSurface();
+    vec3 eyeDir = normalize(viewPos - surface.position);
+
+    // Shadowed pixels keep the ambient light.
+    float dirLit = dirShadow(surface.position, surface.normal);
+    vec3 result = shade(surface, normalize(-dirLight.direction), eyeDir, dirLight.ambient, dirLight.diffuse * dirLit,
+        dirLight.specular * dirLit);
+
+    vec3 lightDir = normalize(spotLight.position - surface.position);
+    float distance = length(spotLight.position - surface.position);
+    float attenuation = 1.0 / (spotLight.constant + spotLight.linear * distance
+        + spotLight.quadratic * (distance * distance));
+    float theta = dot(lightDir, normalize(-spotLight.direction));
+    float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+    float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+    float spotLit = spotShadow(surface.position, surface.normal);
+    result += attenuation * intensity * shade(surface, lightDir, eyeDir, spotLight.ambient, spotLight.diffuse * spotLit,
+        spotLight.specular * spotLit);
+
+    FragColor = vec4(result, 1.0);
+}
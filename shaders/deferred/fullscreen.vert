@@ -0,0 +1,8 @@
+#version 330 core
+// A full-screen quad on the far plane, so that with a GL_GREATER depth test only pixels
+// covered by geometry are shaded.
+layout (location = 0) in vec2 aPos;
+
+void main() {
+    gl_Position = vec4(aPos, 1.0, 1.0);
+}
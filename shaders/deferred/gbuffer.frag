@@ -0,0 +1,44 @@
+#version 330
+// Writes the surface of each fragment to the G-buffer, for the deferred lighting passes to
+// shade (see include/DeferredRenderer.h). Drawn with light_perspective.vert.
+layout (location=0) out vec4 gAlbedo;
+layout (location=1) out vec4 gNormal;
+layout (location=2) out vec4 gSpecular;
+
+in vec2 TexCoord;
+in vec3 FragWorldPos;
+in mat3 TBN;
+// A color multiplier in rgb, and a shininess in a that overrides material.shininess if positive.
+flat in vec4 InstanceMaterial;
+
+struct Material {
+    sampler2D normal;
+    sampler2D diffuse;
+    sampler2D specular;
+    float     shininess;
+};
+uniform Material material;
+
+// Which of the maps this program uses; the light features do not matter here.
+#include "../features.glsl"
+
+void main() {
+    vec4 albedo = texture(material.diffuse, TexCoord);
+#ifdef HAS_SPECULAR_MAP
+    vec3 specularColor = texture(material.specular, TexCoord).rgb;
+#else
+    vec3 specularColor = albedo.rgb;
+#endif
+
+#ifdef HAS_NORMAL_MAP
+    vec3 norm = texture(material.normal, TexCoord).rgb;
+    norm = normalize(TBN * (norm * 2.0 - 1.0));
+#else
+    vec3 norm = normalize(TBN[2]);
+#endif
+
+    gAlbedo = vec4(albedo.rgb * InstanceMaterial.rgb, 1.0);
+    // Normals are stored in [0, 1].
+    gNormal = vec4(norm * 0.5 + 0.5, 1.0);
+    gSpecular = vec4(specularColor, InstanceMaterial.a > 0.0 ? InstanceMaterial.a : material.shininess);
+}
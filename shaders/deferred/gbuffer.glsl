@@ -0,0 +1,40 @@
+// Reads the G-buffer at the fragment being shaded. The layout must match what
+// gbuffer.frag writes.
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+// Takes window coordinates back to world space.
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+
+struct Surface {
+    vec3 position;
+    vec3 normal;
+    vec3 albedo;
+    vec3 specular;
+    float shininess;
+};
+
+Surface readSurface() {
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    float depth = texture(gDepth, uv).r;
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec4 specular = texture(gSpecular, uv);
+
+    Surface surface;
+    surface.position = world.xyz / world.w;
+    surface.normal = normalize(texture(gNormal, uv).rgb * 2.0 - 1.0);
+    surface.albedo = texture(gAlbedo, uv).rgb;
+    surface.specular = specular.rgb;
+    surface.shininess = specular.a;
+    return surface;
+}
+
+// The Phong terms of one light, before attenuation.
+vec3 shade(Surface surface, vec3 lightDir, vec3 eyeDir, vec3 ambient, vec3 diffuse, vec3 specular) {
+    float lambertFactor = max(dot(surface.normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float spec = pow(max(dot(reflectDir, eyeDir), 0.0), surface.shininess);
+    return ambient * surface.albedo + diffuse * lambertFactor * surface.albedo + specular * spec * surface.specular;
+}
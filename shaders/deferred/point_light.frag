@@ -0,0 +1,25 @@
+#version 330
+// Adds one point light to the pixels its volume covers.
+layout (location=0) out vec4 FragColor;
+
+flat in vec4 PositionRadius;
+flat in vec4 Ambient;
+flat in vec4 Diffuse;
+flat in vec4 Specular;
+
+#include "../frame_data.glsl"
+#include "gbuffer.glsl"
+
+void main() {
+    Surface surface = readSurface();
+    vec3 toLight = PositionRadius.xyz - surface.position;
+    float distance = length(toLight);
+    // The volume also covers surfaces in front of the light's sphere.
+    if (distance > PositionRadius.w)
+        discard;
+
+    float attenuation = 1.0 / (Ambient.a + Diffuse.a * distance + Specular.a * (distance * distance));
+    vec3 eyeDir = normalize(viewPos - surface.position);
+    FragColor = vec4(attenuation * shade(surface, toLight / distance, eyeDir, Ambient.rgb, Diffuse.rgb,
+        Specular.rgb), 1.0);
+}
@@ -0,0 +1,25 @@
+#version 330
+// Places a unit sphere around each point light, scaled to the distance at which the light
+// fades out. One instance per light.
+layout (location=0) in vec3 vPosition;
+// xyz: the light's position, w: its radius.
+layout (location=1) in vec4 lightPositionRadius;
+// rgb: the light's colors; a: its constant, linear and quadratic attenuation.
+layout (location=2) in vec4 lightAmbient;
+layout (location=3) in vec4 lightDiffuse;
+layout (location=4) in vec4 lightSpecular;
+
+#include "../frame_data.glsl"
+
+flat out vec4 PositionRadius;
+flat out vec4 Ambient;
+flat out vec4 Diffuse;
+flat out vec4 Specular;
+
+void main() {
+    gl_Position = projection * view * vec4(lightPositionRadius.xyz + vPosition * lightPositionRadius.w, 1.0);
+    PositionRadius = lightPositionRadius;
+    Ambient = lightAmbient;
+    Diffuse = lightDiffuse;
+    Specular = lightSpecular;
+}
@@ -0,0 +1,12 @@
+// The optional features of the lighting shaders. A variant is built with VARIANT and the
+// defines of just the features it has (see include/ShaderVariants.h); a program built
+// without them has them all.
+#ifndef VARIANT
+#define HAS_NORMAL_MAP
+#define HAS_SPECULAR_MAP
+#define HAS_DIR_LIGHT
+#define NUM_POINT_LIGHTS 1
+#define HAS_SPOT_LIGHT
+#define HAS_CLUSTER_LIGHTS
+#define HAS_SHADOWS
+#endif
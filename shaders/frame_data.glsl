@@ -0,0 +1,77 @@
+// Per-frame camera and light data, shared by every program that includes this file through
+// one uniform buffer. The layout must match FrameData in include/FrameUniforms.h.
+
+struct DirLight {
+    vec3 direction;
+
+    // represents color
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// Point Light
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 direction;
+    vec3 position;
+
+    float cutOff;
+    float outerCutOff;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    // Location of the camera.
+    vec3 viewPos;
+    // Ambient light color.
+    vec3 ambientColor;
+
+    DirLight dirLight;
+    PointLight pointLight;
+    SpotLight spotLight;
+
+    // The light cluster grid (see clusters.glsl): its size in clusters, and in w, whether to
+    // read it.
+    uvec4 clusterGrid;
+    // A cluster's size on screen in pixels (xy), and the scale and bias that take the log of a
+    // view depth to its slice (zw).
+    vec4 clusterScale;
+
+    // Shadows (see shadows.glsl). World space to the shadow atlas for each cascade of the
+    // directional light.
+    mat4 cascadeMatrices[4];
+    // The view depth each cascade reaches to.
+    vec4 cascadeSplits;
+    // The world-space size of a texel of each cascade.
+    vec4 cascadeTexels;
+    // World space to the shadow atlas for the spot light, before the divide by w.
+    mat4 spotShadowMatrix;
+    // The corner of the point light's first cube face in the atlas (xy), and the size of a face (zw).
+    vec4 pointShadowTile;
+    // The size of a texel one unit from the spot light (x) and the point light (y), and the near
+    // and far plane of the point light's faces (zw).
+    vec4 shadowTexels;
+    // The number of cascades (x), and whether the spot light (y) and point light (z) cast shadows.
+    uvec4 shadowFlags;
+};
@@ -8,6 +8,8 @@ in vec2 TexCoord;
 in vec3 FragWorldPos;
 in mat3 TBN;
 // in vec3 Normal;
+// A color multiplier in rgb, and a shininess in a that overrides material.shininess if positive.
+flat in vec4 InstanceMaterial;
 
 // Uniforms: MUST BE PROVIDED BY THE APPLICATION.
 
@@ -19,72 +21,39 @@ struct Material {
     float     shininess;
 };
 uniform Material material;
-
-// Location of the camera.
-uniform vec3 viewPos;
-
-// Ambient light color.
-uniform vec3 ambientColor;
-
-struct DirLight {
-    vec3 direction;
-
-    // represents color
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-uniform DirLight dirLight;
-
-// Point Light
-struct PointLight {
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-uniform PointLight pointLight;
-
-struct SpotLight {
-    vec3 direction;
-    vec3 position;
-
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-uniform SpotLight spotLight;
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 eyeDir) {
+// The shininess in effect for this fragment; set in main().
+float shininess;
+
+// The camera position, ambient color and lights.
+#include "frame_data.glsl"
+// Which of the maps and lights this program uses.
+#include "features.glsl"
+// Any number of point and spot lights, by the cluster of the fragment.
+#include "clusters.glsl"
+// How much of the frame's lights the shadow maps let through.
+#include "shadows.glsl"
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 eyeDir, vec3 albedo, vec3 specularColor, float shadow) {
     vec3 lightDir = normalize(-light.direction);
 
     float lambertFactor = max(dot(normal, lightDir), 0.0);
 
     vec3 reflectDir = normalize(reflect(-lightDir, normal));
-    float spec = pow(max(dot(reflectDir, eyeDir), 0.0), material.shininess);
+    float spec = pow(max(dot(reflectDir, eyeDir), 0.0), shininess);
+    // Shadow takes away the diffuse and specular light, not the ambient.
+    lambertFactor *= shadow;
+    spec *= shadow;
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * vec3(texture(material.diffuse, TexCoord));
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * albedo;
     vec3 specular = vec3(0);
     if (lambertFactor > 0.75) {
         diffuse *= vec3(0.8);
-        specular = light.specular * (spec / 2) * vec3(texture(material.specular, TexCoord));
+        specular = light.specular * (spec / 2) * specularColor;
     }
     else if (lambertFactor > 0.5) {
         diffuse *= vec3(0.6);
-        // specular = light.specular * (spec / 2) * vec3(texture(material.specular, TexCoord));
+        // specular = light.specular * (spec / 2) * specularColor;
     }
     else if (lambertFactor > 0.25) {
         diffuse *= vec3(0.2);
@@ -96,7 +65,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 eyeDir) {
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 eyeDir) {
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 eyeDir, vec3 albedo, vec3 specularColor, float shadow) {
     vec3 lightDir = normalize(light.position - FragWorldPos);
 
     float lambertFactor = max(dot(normal, lightDir), 0.0);
@@ -105,18 +74,20 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 eyeDir) {
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
     vec3 reflectDir = normalize(reflect(-lightDir, normal));
-    float spec = pow(max(dot(reflectDir, eyeDir), 0.0), material.shininess);
+    float spec = pow(max(dot(reflectDir, eyeDir), 0.0), shininess);
+    lambertFactor *= shadow;
+    spec *= shadow;
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * vec3(texture(material.diffuse, TexCoord));
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * albedo;
     vec3 specular = vec3(0);
     if (lambertFactor > 0.8) {
         diffuse *= vec3(0.8);
-        specular = light.specular * (spec / 2) * vec3(texture(material.specular, TexCoord));
+        specular = light.specular * (spec / 2) * specularColor;
     }
     else if (lambertFactor > 0.4) {
         diffuse *= vec3(0.6);
-        // specular = light.specular * (spec / 2) * vec3(texture(material.specular, TexCoord));
+        // specular = light.specular * (spec / 2) * specularColor;
     }
     else if (lambertFactor > 0.2) {
         diffuse *= vec3(0.2);
@@ -132,7 +103,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 eyeDir) {
     return (ambient + diffuse + specular);
 }
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 eyeDir) {
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 eyeDir, vec3 albedo, vec3 specularColor, float shadow) {
     // WARN(liam): could be incorrect
     // vec3 lightDir = normalize(-light.direction);
     vec3 lightDir = normalize(light.position - FragWorldPos);
@@ -143,22 +114,24 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 eyeDir) {
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
     vec3 reflectDir = normalize(reflect(-lightDir, normal));
-    float spec = pow(max(dot(reflectDir, eyeDir), 0.0), material.shininess);
+    float spec = pow(max(dot(reflectDir, eyeDir), 0.0), shininess);
+    lambertFactor *= shadow;
+    spec *= shadow;
 
     float theta = dot(lightDir, normalize(-light.direction));
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord));
-    vec3 diffuse = light.diffuse * vec3(texture(material.diffuse, TexCoord));
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * albedo;
     vec3 specular = vec3(0);
     if (lambertFactor > 0.8) {
         diffuse *= vec3(0.8);
-        specular = light.specular * (spec / 2) * vec3(texture(material.specular, TexCoord));
+        specular = light.specular * (spec / 2) * specularColor;
     }
     else if (lambertFactor > 0.4) {
         diffuse *= vec3(0.6);
-        // specular = light.specular * (spec / 2) * vec3(texture(material.specular, TexCoord));
+        // specular = light.specular * (spec / 2) * specularColor;
     }
     else if (lambertFactor > 0.2) {
         diffuse *= vec3(0.2);
@@ -175,17 +148,63 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 eyeDir) {
 }
 
 void main() {
-
-    // vec3 norm = normalize(Normal);
+    shininess = InstanceMaterial.a > 0.0 ? InstanceMaterial.a : material.shininess;
+
+    // The diffuse map is sampled once, for every light.
+    vec4 albedo = texture(material.diffuse, TexCoord);
+#ifdef HAS_SPECULAR_MAP
+    vec3 specularColor = texture(material.specular, TexCoord).rgb;
+#else
+    // Without a specular map, material.specular would sample unit 0, the diffuse map.
+    vec3 specularColor = albedo.rgb;
+#endif
+
+#ifdef HAS_NORMAL_MAP
     vec3 norm = texture(material.normal, TexCoord).rgb;
     norm = normalize(TBN * (norm * 2.0 - 1.0));
+#else
+    // The interpolated vertex normal, the third column of the TBN matrix.
+    vec3 norm = normalize(TBN[2]);
+#endif
 
     vec3 eyeDir = normalize(viewPos - FragWorldPos);
 
     vec3 result = vec3(0);
-    result += CalcDirLight(dirLight, norm, eyeDir);
-    result += CalcPointLight(pointLight, norm, eyeDir);
-    result += CalcSpotLight(spotLight, norm, eyeDir);
+#ifdef HAS_DIR_LIGHT
+    float dirLit = 1.0;
+#ifdef HAS_SHADOWS
+    dirLit = dirShadow(FragWorldPos, norm);
+#endif
+    result += CalcDirLight(dirLight, norm, eyeDir, albedo.rgb, specularColor, dirLit);
+#endif
+#if NUM_POINT_LIGHTS > 0
+    float pointLit = 1.0;
+#ifdef HAS_SHADOWS
+    pointLit = pointShadow(FragWorldPos, norm);
+#endif
+    result += CalcPointLight(pointLight, norm, eyeDir, albedo.rgb, specularColor, pointLit);
+#endif
+#ifdef HAS_SPOT_LIGHT
+    float spotLit = 1.0;
+#ifdef HAS_SHADOWS
+    spotLit = spotShadow(FragWorldPos, norm);
+#endif
+    result += CalcSpotLight(spotLight, norm, eyeDir, albedo.rgb, specularColor, spotLit);
+#endif
+#ifdef HAS_CLUSTER_LIGHTS
+    if (clusterGrid.w != 0u) {
+        uvec2 range = clusterRange(FragWorldPos);
+        for (uint i = 0u; i < range.y; i++) {
+            float radius;
+            SpotLight light = clusterLight(int(texelFetch(clusterIndices, int(range.x + i)).r), radius);
+            if (distance(light.position, FragWorldPos) < radius) {
+                // The grid's lights cast no shadows.
+                result += CalcSpotLight(light, norm, eyeDir, albedo.rgb, specularColor, 1.0);
+            }
+        }
+    }
+#endif
 
-    FragColor = vec4(result, 1.0);
+    // The alpha only matters for transparent objects, which are drawn blended.
+    FragColor = vec4(result * InstanceMaterial.rgb, albedo.a);
 }
@@ -6,16 +6,22 @@ layout (location=1) in vec3 vNormal;
 layout (location=2) in vec2 vTexCoord;
 layout (location=3) in vec3 vTangent;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+// The camera's projection and view matrices, among the rest of the frame's data.
+#include "frame_data.glsl"
+
+// The draw's model matrix (locations 4-7) and its material: a color multiplier in rgb, and
+// the shininess in a. They come from the render queue's per-draw data, one record per draw.
+layout (location=4) in mat4 drawModel;
+layout (location=8) in vec4 drawMaterial;
 
 out vec2 TexCoord;
 out vec3 FragWorldPos;
 out mat3 TBN;
 // out vec3 Normal;
+flat out vec4 InstanceMaterial;
 
 void main() {
+    mat4 model = drawModel;
     // Transform the vertex position from local space to clip space.
     gl_Position = projection * view * model * vec4(vPosition, 1.0);
     // Pass along the vertex texture coordinate.
@@ -33,4 +39,5 @@ void main() {
     vec3 B = cross(N, T);
 
     TBN = mat3(T, B, N);
+    InstanceMaterial = drawMaterial;
 }
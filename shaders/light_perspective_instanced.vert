@@ -0,0 +1,43 @@
+#version 330
+// The instanced variant of light_perspective.vert: each instance brings its own model matrix
+// and material, read from per-instance attributes instead of uniforms.
+layout (location=0) in vec3 vPosition;
+layout (location=1) in vec3 vNormal;
+layout (location=2) in vec2 vTexCoord;
+layout (location=3) in vec3 vTangent;
+// Locations 4-7 hold the columns of the instance's model matrix.
+layout (location=4) in mat4 instanceModel;
+// A color multiplier in rgb, and the shininess in a.
+layout (location=8) in vec4 instanceMaterial;
+
+// The camera's projection and view matrices, among the rest of the frame's data.
+#include "frame_data.glsl"
+
+// Where the mesh sits within the instanced model.
+uniform mat4 meshTransform;
+
+out vec2 TexCoord;
+out vec3 FragWorldPos;
+out mat3 TBN;
+flat out vec4 InstanceMaterial;
+
+void main() {
+    mat4 model = instanceModel * meshTransform;
+    // Transform the vertex position from local space to clip space.
+    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    // Pass along the vertex texture coordinate.
+    TexCoord = vTexCoord;
+    // Transform the vertex normal from local space to world space, using the Normal matrix.
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+
+    FragWorldPos = vec3(model * vec4(vPosition, 1.0));
+
+    // Gram-Schmidt optimization for TBN
+    vec3 T = normalize(normalMatrix * vTangent);
+    vec3 N = normalize(normalMatrix * vNormal);
+    T = normalize(T - dot(T, N) * N);
+    vec3 B = cross(N, T);
+
+    TBN = mat3(T, B, N);
+    InstanceMaterial = instanceMaterial;
+}
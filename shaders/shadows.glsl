@@ -0,0 +1,70 @@
+// Shadow lookups in the atlas that ShadowMaps renders each frame (see include/ShadowMaps.h).
+// Include after frame_data.glsl. The sampler is bound to its unit when a program links.
+// Each function returns how much of its light reaches a point: 1 when lit, 0 in shadow.
+
+uniform sampler2DShadow shadowAtlas;
+
+// How many texels along the surface normal a lookup starts from, so that surfaces turned away
+// from the light do not shadow themselves.
+const float SHADOW_NORMAL_OFFSET = 1.5;
+
+// Four filtered lookups around the texel, i.e., percentage-closer filtering over 3x3 texels.
+float sampleShadow(vec3 coord) {
+    vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    float lit = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec2 offset = (vec2(i & 1, i >> 1) - 0.5) * texel;
+        lit += texture(shadowAtlas, vec3(coord.xy + offset, coord.z));
+    }
+    return lit * 0.25;
+}
+
+// The cascade of the directional light that covers the point is the first one reaching past
+// its view depth; points past the last cascade are lit.
+float dirShadow(vec3 worldPos, vec3 normal) {
+    float depth = -(view * vec4(worldPos, 1.0)).z;
+    for (uint i = 0u; i < shadowFlags.x; i++) {
+        if (depth < cascadeSplits[i]) {
+            vec3 offset = normal * cascadeTexels[i] * SHADOW_NORMAL_OFFSET;
+            return sampleShadow((cascadeMatrices[i] * vec4(worldPos + offset, 1.0)).xyz);
+        }
+    }
+    return 1.0;
+}
+
+float spotShadow(vec3 worldPos, vec3 normal) {
+    if (shadowFlags.y == 0u)
+        return 1.0;
+    float distance = length(worldPos - spotLight.position);
+    vec4 coord = spotShadowMatrix * vec4(worldPos + normal * shadowTexels.x * distance * SHADOW_NORMAL_OFFSET, 1.0);
+    // Behind the light, where the spot light does not reach anyway.
+    if (coord.w <= 0.0)
+        return 1.0;
+    return sampleShadow(coord.xyz / coord.w);
+}
+
+// The point light's cube faces are projected directly: the face is the axis the point is
+// furthest along, and the other two axes, over that distance, are its place on the face. The
+// projection must match the face matrices of ShadowMaps.
+float pointShadow(vec3 worldPos, vec3 normal) {
+    if (shadowFlags.z == 0u)
+        return 1.0;
+    vec3 toPoint = worldPos - pointLight.position;
+    toPoint += normal * shadowTexels.y * length(toPoint) * SHADOW_NORMAL_OFFSET;
+    vec3 distances = abs(toPoint);
+    int axis = distances.x > distances.y ? (distances.x > distances.z ? 0 : 2) : (distances.y > distances.z ? 1 : 2);
+    float major = distances[axis];
+    int face = axis * 2 + (toPoint[axis] < 0.0 ? 1 : 0);
+    vec2 onFace = vec2(toPoint[(axis + 1) % 3], toPoint[(axis + 2) % 3]) / major;
+
+    float near = shadowTexels.z;
+    float far = shadowTexels.w;
+    float depth = ((far + near) - 2.0 * far * near / major) / (far - near) * 0.5 + 0.5;
+
+    // Faces sit side by side in the atlas, so lookups stay a texel inside their own.
+    vec2 corner = pointShadowTile.xy + vec2(face % 3, face / 3) * pointShadowTile.zw;
+    vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 uv = clamp(corner + (onFace * 0.5 + 0.5) * pointShadowTile.zw, corner + texel,
+        corner + pointShadowTile.zw - texel);
+    return sampleShadow(vec3(uv, depth));
+}
@@ -15,7 +15,7 @@ void Animator::nextAnimation() {
 	}
 }
 
-void Animator::tick(float dt) {
+void Animator::tick(float dt, ObjectPool& objects) {
 	// Advance the active animation by the given interval.
 	if (m_currentIndex >= 0) {
 		float lastTime = m_currentTime;
@@ -25,15 +25,15 @@ void Animator::tick(float dt) {
 		// both the active animation (up to the transition time), and the subsequent animation
 		// (by the amount we exceeded the transition time).
 		if (m_currentTime >= m_nextTransition) {
-			m_currentAnimation->tick(m_nextTransition - lastTime);
+			m_currentAnimation->tick(objects, m_nextTransition - lastTime);
 			float overTime = m_currentTime - m_nextTransition;
 			nextAnimation();
 			if (m_currentAnimation != nullptr) {
-				m_currentAnimation->tick(overTime);
+				m_currentAnimation->tick(objects, overTime);
 			}
 		}
 		else {
-			m_currentAnimation->tick(dt);
+			m_currentAnimation->tick(objects, dt);
 		}
 	}
 }
@@ -73,7 +73,7 @@ std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, c
 }
 
 Mesh3D fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
-	std::unordered_map<std::string, Texture>& loadedTextures) {
+	std::unordered_map<std::string, Texture>& loadedTextures, bool keepGeometry) {
 	std::vector<Vertex3D> vertices;
 
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
@@ -125,12 +125,12 @@ Mesh3D fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::files
 		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 	}
 
-	return Mesh3D(std::move(vertices), std::move(faces), std::move(textures));
+	return Mesh3D(std::move(vertices), std::move(faces), std::move(textures), keepGeometry);
 }
 
 
 
-Object3D assimpLoad(const std::string& path, bool flipTextureCoords) {
+Object3D assimpLoad(const std::string& path, bool flipTextureCoords, bool keepGeometry) {
 	Assimp::Importer importer;
 
 	auto options = aiProcessPreset_TargetRealtime_MaxQuality |
@@ -151,21 +151,27 @@ Object3D assimpLoad(const std::string& path, bool flipTextureCoords) {
 	else {
 
 	}
-	std::vector<Mesh3D> meshes;
 	std::unordered_map<std::string, Texture> loadedTextures;
-	auto ret = processAssimpNode(scene->mRootNode, scene, std::filesystem::path(path), loadedTextures);
+	std::unordered_map<unsigned int, MeshHandle> loadedMeshes;
+	auto ret = processAssimpNode(scene->mRootNode, scene, std::filesystem::path(path), loadedTextures,
+		loadedMeshes, keepGeometry);
 	return ret;
 }
 
 Object3D processAssimpNode(aiNode* node, const aiScene* scene,
 	const std::filesystem::path& modelPath,
-	std::unordered_map<std::string, Texture>& loadedTextures) {
+	std::unordered_map<std::string, Texture>& loadedTextures,
+	std::unordered_map<unsigned int, MeshHandle>& loadedMeshes, bool keepGeometry) {
 
-	// Load the aiNode's meshes.
-	std::vector<Mesh3D> meshes;
+	// Load the aiNode's meshes. Nodes that use the same aiMesh share one registered mesh.
+	std::vector<MeshHandle> meshes;
 	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.emplace_back(fromAssimpMesh(mesh, scene, modelPath, loadedTextures));
+		MeshHandle& loaded = loadedMeshes[node->mMeshes[i]];
+		if (!loaded) {
+			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+			loaded = MeshRegistry::shared().add(fromAssimpMesh(mesh, scene, modelPath, loadedTextures, keepGeometry));
+		}
+		meshes.push_back(loaded);
 	}
 
 	std::vector<Texture> textures;
@@ -181,7 +187,8 @@ Object3D processAssimpNode(aiNode* node, const aiScene* scene,
 	auto parent = Object3D(std::move(meshes), baseTransform);
 
 	for (unsigned int i = 0; i < node->mNumChildren; i++) {
-		Object3D child = processAssimpNode(node->mChildren[i], scene, modelPath, loadedTextures);
+		Object3D child = processAssimpNode(node->mChildren[i], scene, modelPath, loadedTextures, loadedMeshes,
+			keepGeometry);
 		parent.addChild(std::move(child));
 	}
 
@@ -0,0 +1,117 @@
+#include "Broadphase.h"
+#include <algorithm>
+
+Broadphase::BodyId Broadphase::addBody(const AABB& bounds, uint32_t userId) {
+    BodyId id;
+    if (!m_freeIds.empty()) {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+        m_bodies[id] = Body{ bounds, userId, true };
+    }
+    else {
+        id = static_cast<BodyId>(m_bodies.size());
+        m_bodies.push_back(Body{ bounds, userId, true });
+    }
+
+    // New bodies go at the end; the next insertion sort moves them into place.
+    m_proxies.push_back(Proxy{ bounds.min[m_axis], bounds.max[m_axis], id });
+    return id;
+}
+
+void Broadphase::updateBody(BodyId id, const AABB& bounds) {
+    m_bodies[id].bounds = bounds;
+}
+
+void Broadphase::removeBody(BodyId id) {
+    if (!m_bodies[id].alive)
+        return;
+
+    m_bodies[id].alive = false;
+    m_freeIds.push_back(id);
+
+    // Erasing keeps the remaining proxies sorted.
+    auto it = std::find_if(m_proxies.begin(), m_proxies.end(),
+        [id](const Proxy& p) { return p.id == id; });
+    if (it != m_proxies.end())
+        m_proxies.erase(it);
+}
+
+size_t Broadphase::bodyCount() const {
+    return m_proxies.size();
+}
+
+void Broadphase::prepareSweep() {
+    // Sweep along the axis where the bodies are most spread out, which gives the fewest
+    // false overlaps on that axis.
+    glm::vec3 sum(0.f);
+    glm::vec3 sumSq(0.f);
+    for (auto& p : m_proxies) {
+        glm::vec3 c = m_bodies[p.id].bounds.center();
+        sum += c;
+        sumSq += c * c;
+    }
+    int axis = m_axis;
+    if (!m_proxies.empty()) {
+        float n = static_cast<float>(m_proxies.size());
+        glm::vec3 variance = sumSq / n - (sum / n) * (sum / n);
+        int best = 0;
+        if (variance.y > variance[best])
+            best = 1;
+        if (variance.z > variance[best])
+            best = 2;
+        // Switching axes costs a full sort, so only switch for a clear improvement.
+        if (variance[best] > variance[m_axis] * 1.25f)
+            axis = best;
+    }
+    bool axisChanged = axis != m_axis;
+    m_axis = axis;
+
+    for (auto& p : m_proxies) {
+        const AABB& b = m_bodies[p.id].bounds;
+        p.min = b.min[m_axis];
+        p.max = b.max[m_axis];
+    }
+
+    if (axisChanged) {
+        std::sort(m_proxies.begin(), m_proxies.end(),
+            [](const Proxy& l, const Proxy& r) { return l.min < r.min; });
+        return;
+    }
+
+    // Insertion sort: bodies only move a little between frames, so this is nearly linear.
+    for (size_t i = 1; i < m_proxies.size(); i++) {
+        Proxy key = m_proxies[i];
+        size_t j = i;
+        while (j > 0 && m_proxies[j - 1].min > key.min) {
+            m_proxies[j] = m_proxies[j - 1];
+            j--;
+        }
+        m_proxies[j] = key;
+    }
+}
+
+const std::vector<ContactPair>& Broadphase::findPairs() {
+    m_pairs.clear();
+    findPairs([this](const ContactPair& pair) {
+        m_pairs.push_back(pair);
+    });
+    return m_pairs;
+}
+
+void Broadphase::findPairs(const std::function<void(const ContactPair&)>& callback) {
+    prepareSweep();
+
+    for (size_t i = 0; i < m_proxies.size(); i++) {
+        const Proxy& p = m_proxies[i];
+        const Body& a = m_bodies[p.id];
+
+        // Every later proxy starts after p does; once one starts after p ends, none of the
+        // rest can overlap p.
+        for (size_t j = i + 1; j < m_proxies.size() && m_proxies[j].min <= p.max; j++) {
+            const Body& b = m_bodies[m_proxies[j].id];
+            if (a.bounds.overlaps(b.bounds)) {
+                callback(ContactPair{ std::min(a.userId, b.userId), std::max(a.userId, b.userId) });
+            }
+        }
+    }
+}
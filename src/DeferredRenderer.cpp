@@ -0,0 +1,315 @@
+#include "DeferredRenderer.h"
+#include "Framebuffer.h"
+#include "Frustum.h"
+#include "GLState.h"
+#include "ShaderManager.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <glad/glad.h>
+
+namespace {
+    constexpr uint32_t INITIAL_LIGHTS = 256;
+
+    // The G-buffer's textures, on units 0-3 while the lights are drawn.
+    constexpr int32_t ALBEDO_UNIT = 0;
+    constexpr int32_t NORMAL_UNIT = 1;
+    constexpr int32_t SPECULAR_UNIT = 2;
+    constexpr int32_t DEPTH_UNIT = 3;
+
+    uint32_t createTexture(GLint internalFormat, GLenum format, GLenum type, uint32_t width, uint32_t height) {
+        uint32_t texture;
+        glGenTextures(1, &texture);
+        GLState::shared().bindTexture(0, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        // Each pixel reads only its own texel.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    /**
+     * @brief The triangles of an icosahedron subdivided once, counter-clockwise from outside,
+     * scaled so that its faces lie just outside the unit sphere: a volume drawn at a light's
+     * radius must cover every point the light reaches.
+     */
+    std::vector<glm::vec3> sphereTriangles() {
+        const float t = (1.f + std::sqrt(5.f)) / 2.f;
+        const glm::vec3 corners[12] = {
+            { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+            { 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+            { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 },
+        };
+        const uint32_t faces[20][3] = {
+            { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+            { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+            { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+            { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 },
+        };
+
+        // Each face splits into four, with the new corners pushed out onto the sphere.
+        std::vector<glm::vec3> triangles;
+        triangles.reserve(20 * 4 * 3);
+        for (auto& face : faces) {
+            glm::vec3 a = glm::normalize(corners[face[0]]);
+            glm::vec3 b = glm::normalize(corners[face[1]]);
+            glm::vec3 c = glm::normalize(corners[face[2]]);
+            glm::vec3 ab = glm::normalize(a + b);
+            glm::vec3 bc = glm::normalize(b + c);
+            glm::vec3 ca = glm::normalize(c + a);
+            for (const glm::vec3& v : { a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca }) {
+                triangles.push_back(v);
+            }
+        }
+
+        // The corners are on the sphere, so the faces cut into it; the nearest face decides how
+        // far to push them all out.
+        float inner = 1.f;
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            glm::vec3 normal = glm::normalize(glm::cross(triangles[i + 1] - triangles[i], triangles[i + 2] - triangles[i]));
+            inner = std::min(inner, glm::dot(normal, triangles[i]));
+        }
+        for (auto& v : triangles) {
+            v /= inner;
+        }
+        return triangles;
+    }
+}
+
+DeferredRenderer::DeferredRenderer(uint32_t& width, uint32_t& height)
+    : m_width(width), m_height(height),
+    m_geometryProgram(ShaderManager::shared().request("shaders/light_perspective.vert", "shaders/deferred/gbuffer.frag")),
+    m_geometryVariants(m_geometryProgram),
+    m_directionalProgram(ShaderManager::shared().request("shaders/deferred/fullscreen.vert",
+        "shaders/deferred/directional.frag")),
+    m_pointProgram(ShaderManager::shared().request("shaders/deferred/point_light.vert",
+        "shaders/deferred/point_light.frag")),
+    m_lights(GL_ARRAY_BUFFER, INITIAL_LIGHTS * sizeof(LightInstance)) {
+    GLState& state = GLState::shared();
+
+    // The program's files are recorded when it is requested, so this needs no link.
+    m_hasVariants = ShaderVariants::supports(m_geometryProgram);
+    // Lights make no difference to the G-buffer.
+    m_geometryVariants.setLights(FEATURE_LIGHTS);
+
+    // Only the positions of the screen quad.
+    glGenVertexArrays(1, &m_quadVao);
+    state.bindVertexArray(m_quadVao);
+    glGenBuffers(1, &m_quadVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_quadVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(screenVertices), screenVertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr);
+    glEnableVertexAttribArray(0);
+
+    std::vector<glm::vec3> sphere = sphereTriangles();
+    m_sphereVertices = static_cast<uint32_t>(sphere.size());
+    glGenVertexArrays(1, &m_sphereVao);
+    state.bindVertexArray(m_sphereVao);
+    glGenBuffers(1, &m_sphereVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_sphereVbo);
+    glBufferData(GL_ARRAY_BUFFER, sphere.size() * sizeof(glm::vec3), sphere.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+    glEnableVertexAttribArray(0);
+    // The light attributes are pointed at this frame's section of the ring buffer in shade().
+    for (uint32_t i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(1 + i);
+        glVertexAttribDivisor(1 + i, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenQueries(QUERIES, m_queries);
+    resize();
+}
+
+DeferredRenderer::~DeferredRenderer() {
+    release();
+    glDeleteQueries(QUERIES, m_queries);
+    glDeleteBuffers(1, &m_sphereVbo);
+    glDeleteBuffers(1, &m_quadVbo);
+    GLState::shared().deleteVertexArray(m_sphereVao);
+    GLState::shared().deleteVertexArray(m_quadVao);
+}
+
+void DeferredRenderer::release() {
+    GLState& state = GLState::shared();
+    for (uint32_t* texture : { &m_albedo, &m_normal, &m_specular, &m_depth }) {
+        if (*texture) {
+            state.deleteTexture(*texture);
+            *texture = 0;
+        }
+    }
+    if (m_gbuffer) {
+        state.deleteFramebuffer(m_gbuffer);
+        m_gbuffer = 0;
+    }
+}
+
+void DeferredRenderer::resize() {
+    release();
+    GLState& state = GLState::shared();
+
+    glGenFramebuffers(1, &m_gbuffer);
+    state.bindFramebuffer(m_gbuffer);
+
+    m_albedo = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, m_width, m_height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_albedo, 0);
+    m_normal = createTexture(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, m_width, m_height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_normal, 0);
+    // Shininess goes well past 1.
+    m_specular = createTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, m_width, m_height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_specular, 0);
+    // The same format as a Framebuffer's depth, so it can be blitted into one.
+    m_depth = createTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, m_width, m_height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depth, 0);
+
+    const GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, attachments);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR: G-buffer incomplete!" << std::endl;
+    }
+    state.bindFramebuffer(0);
+}
+
+void DeferredRenderer::attach(RenderQueue& queue, const ShaderProgram& forwardProgram) {
+    if (m_attachedQueue == &queue)
+        return;
+    queue.replaceOpaqueProgram(forwardProgram, &m_geometryProgram);
+    if (m_hasVariants) {
+        queue.addVariants(m_geometryVariants);
+    }
+    m_attachedQueue = &queue;
+}
+
+void DeferredRenderer::detach(RenderQueue& queue) {
+    if (m_attachedQueue != &queue)
+        return;
+    queue.replaceOpaqueProgram(m_geometryProgram, nullptr);
+    queue.removeVariants(m_geometryVariants);
+    m_attachedQueue = nullptr;
+}
+
+void DeferredRenderer::beginGeometry() {
+    GLState& state = GLState::shared();
+    state.bindFramebuffer(m_gbuffer);
+    state.viewport(0, 0, m_width, m_height);
+    state.enable(GL_DEPTH_TEST);
+    state.disable(GL_BLEND);
+    state.depthMask(true);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+}
+
+void DeferredRenderer::setGBufferUniforms(ShaderProgram& program, const glm::mat4& inverseViewProjection) {
+    program.setUniform("gAlbedo", ALBEDO_UNIT);
+    program.setUniform("gNormal", NORMAL_UNIT);
+    program.setUniform("gSpecular", SPECULAR_UNIT);
+    program.setUniform("gDepth", DEPTH_UNIT);
+    program.setUniform("inverseViewProjection", inverseViewProjection);
+    program.setUniform("screenSize", glm::vec2(m_width, m_height));
+}
+
+void DeferredRenderer::shade(Framebuffer& target, const FrameData& frame,
+    const std::vector<FramePointLight>& pointLights) {
+    GLState& state = GLState::shared();
+    m_stats.pointLights = static_cast<uint32_t>(pointLights.size());
+
+    // The query of this slot was issued QUERIES frames ago; take its count if the GPU is done,
+    // and keep the last count otherwise.
+    uint32_t slot = m_frame++ % QUERIES;
+    if (m_queryIssued[slot]) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(m_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(m_queries[slot], GL_QUERY_RESULT, &samples);
+            m_stats.litFragments = samples;
+            m_queryIssued[slot] = false;
+        }
+    }
+
+    // Forward-shaded meshes drawn after this must be hidden by the deferred ones.
+    state.bindFramebuffer(target.fboId);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_gbuffer);
+    glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fboId);
+
+    state.bindTexture(ALBEDO_UNIT, m_albedo);
+    state.bindTexture(NORMAL_UNIT, m_normal);
+    state.bindTexture(SPECULAR_UNIT, m_specular);
+    state.bindTexture(DEPTH_UNIT, m_depth);
+    glm::mat4 viewProjection = frame.projection * frame.view;
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+
+    // The lights only add to the pixels; none of them changes depth.
+    state.enable(GL_DEPTH_TEST);
+    state.depthMask(false);
+    state.disable(GL_BLEND);
+
+    // The quad is on the far plane, in front of the cleared depth only where there is nothing.
+    state.disable(GL_CULL_FACE);
+    glDepthFunc(GL_GREATER);
+    m_directionalProgram.activate();
+    setGBufferUniforms(m_directionalProgram, inverseViewProjection);
+    state.bindVertexArray(m_quadVao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    // The lights in view, to this frame's section of the ring buffer.
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    auto* instances = static_cast<LightInstance*>(m_lights.beginWrite(pointLights.size() * sizeof(LightInstance)));
+    uint32_t drawn = 0;
+    for (auto& light : pointLights) {
+        float radius = lightRadius(light);
+        if (radius <= 0.f || frustum.test(BoundingSphere(light.position, radius)) == Frustum::Result::Outside)
+            continue;
+        instances[drawn++] = { glm::vec4(light.position, radius), glm::vec4(light.ambient, light.constant),
+            glm::vec4(light.diffuse, light.linear), glm::vec4(light.specular, light.quadratic) };
+    }
+    size_t offset = m_lights.endWrite();
+    m_stats.drawnLights = drawn;
+
+    if (drawn > 0) {
+        state.bindVertexArray(m_sphereVao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_lights.getId());
+        for (uint32_t i = 0; i < 4; i++) {
+            glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(LightInstance),
+                reinterpret_cast<const void*>(offset + i * sizeof(glm::vec4)));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // The back faces of each volume pass where the geometry is in front of them, which
+        // still works with the camera inside the volume; depth clamping keeps the parts past the
+        // far plane. The lights add up.
+        state.enable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glDepthFunc(GL_GEQUAL);
+        state.enable(GL_DEPTH_CLAMP);
+        state.enable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        m_pointProgram.activate();
+        setGBufferUniforms(m_pointProgram, inverseViewProjection);
+        glBeginQuery(GL_SAMPLES_PASSED, m_queries[slot]);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, m_sphereVertices, drawn);
+        glEndQuery(GL_SAMPLES_PASSED);
+        m_queryIssued[slot] = true;
+
+        glCullFace(GL_BACK);
+        state.disable(GL_DEPTH_CLAMP);
+        state.disable(GL_BLEND);
+    }
+    else if (!m_queryIssued[slot]) {
+        m_stats.litFragments = 0;
+    }
+    m_lights.fence();
+
+    glDepthFunc(GL_LESS);
+    state.depthMask(true);
+    state.enable(GL_CULL_FACE);
+}
+
+const DeferredStats& DeferredRenderer::stats() const {
+    return m_stats;
+}
@@ -0,0 +1,61 @@
+#include "FrameUniforms.h"
+#include <algorithm>
+#include <cmath>
+#include <glad/glad.h>
+
+namespace {
+    // The attenuation at which a light's brightest color would add less than 5 of 256 levels.
+    constexpr float LIGHT_CUTOFF = 5.f / 256.f;
+
+    float attenuationRadius(float constant, float linear, float quadratic, const glm::vec3& ambient,
+        const glm::vec3& diffuse, const glm::vec3& specular) {
+        glm::vec3 colors = glm::max(ambient, glm::max(diffuse, specular));
+        float brightest = std::max(colors.x, std::max(colors.y, colors.z));
+        if (brightest <= 0.f)
+            return 0.f;
+
+        // Solves brightest / (constant + linear * d + quadratic * d^2) = LIGHT_CUTOFF for d.
+        float c = constant - brightest / LIGHT_CUTOFF;
+        if (c >= 0.f)
+            return 0.f;
+        float radius;
+        if (quadratic > 0.f) {
+            radius = (-linear + std::sqrt(linear * linear - 4.f * quadratic * c)) / (2.f * quadratic);
+        }
+        else if (linear > 0.f) {
+            radius = -c / linear;
+        }
+        else {
+            return MAX_LIGHT_RADIUS;
+        }
+        return std::min(radius, MAX_LIGHT_RADIUS);
+    }
+}
+
+float lightRadius(const FramePointLight& light) {
+    return attenuationRadius(light.constant, light.linear, light.quadratic, light.ambient, light.diffuse,
+        light.specular);
+}
+
+float lightRadius(const FrameSpotLight& light) {
+    return attenuationRadius(light.constant, light.linear, light.quadratic, light.ambient, light.diffuse,
+        light.specular);
+}
+
+FrameUniformBuffer::FrameUniformBuffer() {
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, m_buffer);
+}
+
+FrameUniformBuffer::~FrameUniformBuffer() {
+    glDeleteBuffers(1, &m_buffer);
+}
+
+void FrameUniformBuffer::update(const FrameData& data) {
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,197 @@
+#include "GLState.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    GLint getInteger(GLenum name) {
+        GLint value = 0;
+        glGetIntegerv(name, &value);
+        return value;
+    }
+}
+
+GLState& GLState::shared() {
+    static GLState state;
+    return state;
+}
+
+bool GLState::hasExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const GLubyte* extension = glGetStringi(GL_EXTENSIONS, i);
+        if (extension != nullptr && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+template <typename Query>
+bool GLState::skip(bool matches, Query actualMatches) {
+    if (!m_debug)
+        return matches;
+
+    if (!matches) {
+        m_stats.issued++;
+        return false;
+    }
+    if (!actualMatches()) {
+        m_stats.mismatches++;
+        m_stats.issued++;
+        return false;
+    }
+    m_stats.skipped++;
+    return true;
+}
+
+void GLState::useProgram(uint32_t program) {
+    if (skip(m_program == program, [&] { return uint32_t(getInteger(GL_CURRENT_PROGRAM)) == program; }))
+        return;
+    glUseProgram(program);
+    m_program = program;
+}
+
+void GLState::bindVertexArray(uint32_t vertexArray) {
+    if (skip(m_vertexArray == vertexArray,
+        [&] { return uint32_t(getInteger(GL_VERTEX_ARRAY_BINDING)) == vertexArray; }))
+        return;
+    glBindVertexArray(vertexArray);
+    m_vertexArray = vertexArray;
+}
+
+void GLState::activeUnit(uint32_t unit) {
+    if (skip(m_activeUnit == unit, [&] { return uint32_t(getInteger(GL_ACTIVE_TEXTURE)) == GL_TEXTURE0 + unit; }))
+        return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    m_activeUnit = unit;
+}
+
+void GLState::bindTexture(uint32_t unit, uint32_t texture) {
+    if (m_textures.size() <= unit) {
+        m_textures.resize(unit + 1, UNKNOWN);
+    }
+    bool matches = m_textures[unit] == texture;
+    if (skip(matches, [&] {
+        // Checking a unit's binding takes making it active, so restore the active unit after.
+        GLint previous = getInteger(GL_ACTIVE_TEXTURE);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        uint32_t actual = uint32_t(getInteger(GL_TEXTURE_BINDING_2D));
+        glActiveTexture(static_cast<GLenum>(previous));
+        return actual == texture;
+    }))
+        return;
+    activeUnit(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    m_textures[unit] = texture;
+}
+
+void GLState::bindBufferTexture(uint32_t unit, uint32_t texture) {
+    activeUnit(unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+}
+
+void GLState::bindFramebuffer(uint32_t framebuffer) {
+    if (skip(m_framebuffer == framebuffer, [&] {
+        return uint32_t(getInteger(GL_DRAW_FRAMEBUFFER_BINDING)) == framebuffer
+            && uint32_t(getInteger(GL_READ_FRAMEBUFFER_BINDING)) == framebuffer;
+    }))
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    m_framebuffer = framebuffer;
+}
+
+void GLState::viewport(int32_t x, int32_t y, int32_t width, int32_t height) {
+    const int32_t requested[4] = { x, y, width, height };
+    if (skip(std::equal(requested, requested + 4, m_viewport), [&] {
+        GLint actual[4];
+        glGetIntegerv(GL_VIEWPORT, actual);
+        return std::equal(requested, requested + 4, actual);
+    }))
+        return;
+    glViewport(x, y, width, height);
+    std::copy(requested, requested + 4, m_viewport);
+}
+
+void GLState::depthMask(bool write) {
+    if (skip(m_depthMask == uint32_t(write), [&] {
+        GLboolean actual;
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &actual);
+        return bool(actual) == write;
+    }))
+        return;
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    m_depthMask = write;
+}
+
+void GLState::setEnabled(GLenum capability, bool enabled) {
+    auto it = std::find_if(m_capabilities.begin(), m_capabilities.end(), [capability](const Capability& c) {
+        return c.capability == capability;
+    });
+    bool matches = it != m_capabilities.end() && it->enabled == enabled;
+    if (skip(matches, [&] { return bool(glIsEnabled(capability)) == enabled; }))
+        return;
+
+    if (enabled) {
+        glEnable(capability);
+    }
+    else {
+        glDisable(capability);
+    }
+    if (it == m_capabilities.end()) {
+        m_capabilities.push_back({ capability, enabled });
+    }
+    else {
+        it->enabled = enabled;
+    }
+}
+
+void GLState::deleteProgram(uint32_t program) {
+    glDeleteProgram(program);
+    // A current program is only deleted once another is used, but its name may be reused.
+    if (m_program == program) {
+        m_program = UNKNOWN;
+    }
+}
+
+void GLState::deleteTexture(uint32_t texture) {
+    glDeleteTextures(1, &texture);
+    // GL binds 0 wherever the texture was bound.
+    std::replace(m_textures.begin(), m_textures.end(), texture, 0u);
+}
+
+void GLState::deleteVertexArray(uint32_t vertexArray) {
+    glDeleteVertexArrays(1, &vertexArray);
+    if (m_vertexArray == vertexArray) {
+        m_vertexArray = 0;
+    }
+}
+
+void GLState::deleteFramebuffer(uint32_t framebuffer) {
+    glDeleteFramebuffers(1, &framebuffer);
+    if (m_framebuffer == framebuffer) {
+        m_framebuffer = 0;
+    }
+}
+
+void GLState::invalidate() {
+    m_program = UNKNOWN;
+    m_vertexArray = UNKNOWN;
+    m_framebuffer = UNKNOWN;
+    m_activeUnit = UNKNOWN;
+    m_textures.clear();
+    std::fill(m_viewport, m_viewport + 4, -1);
+    m_depthMask = UNKNOWN;
+    m_capabilities.clear();
+}
+
+void GLState::setDebug(bool debug) {
+    m_debug = debug;
+}
+
+bool GLState::isDebug() const {
+    return m_debug;
+}
+
+GLStateStats& GLState::stats() {
+    return m_stats;
+}
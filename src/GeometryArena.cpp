@@ -0,0 +1,341 @@
+#include "GeometryArena.h"
+#include <algorithm>
+#include <map>
+#include <glad/glad.h>
+#include "GLState.h"
+#include "Mesh3D.h"
+
+struct GeometryArena::Page {
+    uint32_t vao = 0;
+    uint32_t vbo = 0;
+    uint32_t ebo = 0;
+    uint32_t vertexCapacity = 0;
+    uint32_t indexCapacity = 0;
+    uint32_t verticesUsed = 0;
+    uint32_t indicesUsed = 0;
+    // Free blocks by offset, each with its size.
+    std::map<uint32_t, uint32_t> freeVertices;
+    std::map<uint32_t, uint32_t> freeIndices;
+    std::vector<std::unique_ptr<Range>> ranges;
+
+    ~Page() {
+        releaseBuffers();
+    }
+
+    // Leaves the names 0, so a page released at shutdown makes no GL calls when it goes.
+    void releaseBuffers() {
+        if (vao == 0)
+            return;
+        GLState::shared().deleteVertexArray(vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        vao = vbo = ebo = 0;
+    }
+};
+
+namespace {
+    using FreeList = std::map<uint32_t, uint32_t>;
+
+    bool hasBlock(const FreeList& free, uint32_t count) {
+        if (count == 0)
+            return true;
+        for (auto& [offset, size] : free) {
+            if (size >= count)
+                return true;
+        }
+        return false;
+    }
+
+    // Takes count elements from the first block big enough; hasBlock() must have found one.
+    uint32_t takeBlock(FreeList& free, uint32_t count) {
+        if (count == 0)
+            return 0;
+        auto it = std::find_if(free.begin(), free.end(), [count](auto& block) {
+            return block.second >= count;
+        });
+        uint32_t offset = it->first;
+        uint32_t remaining = it->second - count;
+        free.erase(it);
+        if (remaining > 0) {
+            free.emplace(offset + count, remaining);
+        }
+        return offset;
+    }
+
+    // Returns a block, merging it with the free blocks right before and after it.
+    void giveBlock(FreeList& free, uint32_t offset, uint32_t count) {
+        if (count == 0)
+            return;
+        auto next = free.lower_bound(offset);
+        if (next != free.end() && offset + count == next->first) {
+            count += next->second;
+            next = free.erase(next);
+        }
+        if (next != free.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += count;
+                return;
+            }
+        }
+        free.emplace(offset, count);
+    }
+
+    // Whether the free space is one block at the end, i.e., there is nothing to compact.
+    bool isPacked(const FreeList& free, uint32_t used) {
+        return free.empty() || (free.size() == 1 && free.begin()->first == used);
+    }
+
+    uint32_t grow(uint32_t capacity, uint64_t needed) {
+        uint64_t grown = std::max<uint32_t>(capacity, 1);
+        while (grown < needed) {
+            grown *= 2;
+        }
+        return static_cast<uint32_t>(std::min<uint64_t>(grown, UINT32_MAX));
+    }
+
+    // Points the vertex array at the page's buffers. Vertex arrays remember the buffer each
+    // attribute reads from, so this is repeated whenever the buffers are replaced.
+    void configureVertexArray(uint32_t vao, uint32_t vbo, uint32_t ebo) {
+        GLState::shared().bindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        // Each vertex is 3 floats for position...
+        glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex3D), 0);
+        glEnableVertexAttribArray(0);
+        // ... then 3 floats for normal vector...
+        glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)12);
+        glEnableVertexAttribArray(1);
+        // ... the 2 floats for texture coordinate...
+        glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex3D), (void*)24);
+        glEnableVertexAttribArray(2);
+        // ... and the 3 floats for tangent vector.
+        glVertexAttribPointer(3, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)32);
+        glEnableVertexAttribArray(3);
+        // The element buffer binding is part of the vertex array too.
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    uint32_t createBuffer(GLenum target, size_t bytes) {
+        uint32_t buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, static_cast<GLsizeiptr>(bytes), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(target, 0);
+        return buffer;
+    }
+}
+
+GeometryArena& GeometryArena::shared() {
+    static GeometryArena arena;
+    return arena;
+}
+
+GeometryArena::~GeometryArena() = default;
+
+GeometryArena::Range* GeometryArena::allocate(const std::vector<Vertex3D>& vertices,
+    const std::vector<uint32_t>& indices) {
+    uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+    uint32_t indexCount = static_cast<uint32_t>(indices.size());
+
+    Page* page = nullptr;
+    for (auto& candidate : m_pages) {
+        if (fits(*candidate, vertexCount, indexCount)) {
+            page = candidate.get();
+            break;
+        }
+    }
+    if (page == nullptr && !m_pages.empty()) {
+        // Grow the newest page if it may. Repacking also closes its holes, so the capacity
+        // only has to cover what is used.
+        Page& last = *m_pages.back();
+        uint32_t vertexCapacity = grow(last.vertexCapacity, uint64_t(last.verticesUsed) + vertexCount);
+        uint32_t indexCapacity = grow(last.indexCapacity, uint64_t(last.indicesUsed) + indexCount);
+        if (vertexCapacity <= MAX_PAGE_VERTICES && indexCapacity <= MAX_PAGE_VERTICES * INDICES_PER_VERTEX) {
+            repack(last, vertexCapacity, indexCapacity);
+            page = &last;
+        }
+    }
+    if (page == nullptr) {
+        page = createPage(std::max(INITIAL_PAGE_VERTICES, vertexCount),
+            std::max(INITIAL_PAGE_VERTICES * INDICES_PER_VERTEX, indexCount));
+    }
+
+    auto range = std::make_unique<Range>();
+    range->page = page;
+    range->vertexCount = vertexCount;
+    range->indexCount = indexCount;
+    range->firstVertex = takeBlock(page->freeVertices, vertexCount);
+    range->firstIndex = takeBlock(page->freeIndices, indexCount);
+    page->verticesUsed += vertexCount;
+    page->indicesUsed += indexCount;
+
+    if (vertexCount > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, page->vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(range->firstVertex * sizeof(Vertex3D)),
+            static_cast<GLsizeiptr>(vertexCount * sizeof(Vertex3D)), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    if (indexCount > 0) {
+        // Use the copy binding for the index upload, so the element buffer of whichever vertex
+        // array is bound stays as it is.
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page->ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(range->firstIndex * sizeof(uint32_t)),
+            static_cast<GLsizeiptr>(indexCount * sizeof(uint32_t)), indices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    page->ranges.push_back(std::move(range));
+    return page->ranges.back().get();
+}
+
+void GeometryArena::free(Range* range) {
+    Page* page = range->page;
+    giveBlock(page->freeVertices, range->firstVertex, range->vertexCount);
+    giveBlock(page->freeIndices, range->firstIndex, range->indexCount);
+    page->verticesUsed -= range->vertexCount;
+    page->indicesUsed -= range->indexCount;
+
+    auto& ranges = page->ranges;
+    ranges.erase(std::find_if(ranges.begin(), ranges.end(), [range](auto& r) {
+        return r.get() == range;
+    }));
+
+    if (ranges.empty()) {
+        m_pages.erase(std::find_if(m_pages.begin(), m_pages.end(), [page](auto& p) {
+            return p.get() == page;
+        }));
+    }
+}
+
+uint32_t GeometryArena::compact() {
+    uint32_t repacked = 0;
+    for (auto& page : m_pages) {
+        if (!isPacked(page->freeVertices, page->verticesUsed) || !isPacked(page->freeIndices, page->indicesUsed)) {
+            repack(*page, page->vertexCapacity, page->indexCapacity);
+            repacked++;
+        }
+    }
+    return repacked;
+}
+
+void GeometryArena::releaseBuffers() {
+    for (auto& page : m_pages) {
+        page->releaseBuffers();
+    }
+}
+
+uint32_t GeometryArena::getVertexArray(const Range& range) const {
+    return range.page->vao;
+}
+
+GeometryArenaStats GeometryArena::stats() const {
+    GeometryArenaStats stats;
+    stats.repacks = m_repacks;
+    for (auto& page : m_pages) {
+        stats.pages++;
+        stats.allocations += static_cast<uint32_t>(page->ranges.size());
+        stats.vertexCapacity += page->vertexCapacity;
+        stats.verticesUsed += page->verticesUsed;
+        stats.indexCapacity += page->indexCapacity;
+        stats.indicesUsed += page->indicesUsed;
+        uint32_t largest = 0;
+        for (auto& [offset, size] : page->freeVertices) {
+            largest = std::max(largest, size);
+        }
+        stats.largestFreeVertices = std::max<size_t>(stats.largestFreeVertices, largest);
+        stats.strandedFreeVertices += page->vertexCapacity - page->verticesUsed - largest;
+        for (auto& [offset, size] : page->freeIndices) {
+            stats.largestFreeIndices = std::max<size_t>(stats.largestFreeIndices, size);
+        }
+        stats.freeBlocks += static_cast<uint32_t>(page->freeVertices.size() + page->freeIndices.size());
+    }
+    stats.gpuBytes = stats.vertexCapacity * sizeof(Vertex3D) + stats.indexCapacity * sizeof(uint32_t);
+    stats.usedGpuBytes = stats.verticesUsed * sizeof(Vertex3D) + stats.indicesUsed * sizeof(uint32_t);
+    return stats;
+}
+
+GeometryArena::Page* GeometryArena::createPage(uint32_t vertexCapacity, uint32_t indexCapacity) {
+    auto page = std::make_unique<Page>();
+    page->vertexCapacity = vertexCapacity;
+    page->indexCapacity = indexCapacity;
+    page->freeVertices.emplace(0, vertexCapacity);
+    page->freeIndices.emplace(0, indexCapacity);
+    page->vbo = createBuffer(GL_ARRAY_BUFFER, size_t(vertexCapacity) * sizeof(Vertex3D));
+    page->ebo = createBuffer(GL_COPY_WRITE_BUFFER, size_t(indexCapacity) * sizeof(uint32_t));
+    glGenVertexArrays(1, &page->vao);
+    configureVertexArray(page->vao, page->vbo, page->ebo);
+
+    m_pages.push_back(std::move(page));
+    return m_pages.back().get();
+}
+
+void GeometryArena::repack(Page& page, uint32_t vertexCapacity, uint32_t indexCapacity) {
+    uint32_t vbo = createBuffer(GL_COPY_WRITE_BUFFER, size_t(vertexCapacity) * sizeof(Vertex3D));
+    uint32_t ebo = createBuffer(GL_COPY_WRITE_BUFFER, size_t(indexCapacity) * sizeof(uint32_t));
+
+    // Copy both buffers on the GPU, keeping the ranges in the order they already have. Indices
+    // are relative to their range's first vertex, so they are copied unchanged.
+    std::vector<Range*> ranges;
+    for (auto& range : page.ranges) {
+        ranges.push_back(range.get());
+    }
+
+    std::sort(ranges.begin(), ranges.end(), [](Range* a, Range* b) {
+        return a->firstVertex < b->firstVertex;
+    });
+    glBindBuffer(GL_COPY_READ_BUFFER, page.vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    uint32_t next = 0;
+    for (Range* range : ranges) {
+        if (range->vertexCount > 0) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                static_cast<GLintptr>(range->firstVertex * sizeof(Vertex3D)),
+                static_cast<GLintptr>(next * sizeof(Vertex3D)),
+                static_cast<GLsizeiptr>(range->vertexCount * sizeof(Vertex3D)));
+        }
+        range->firstVertex = next;
+        next += range->vertexCount;
+    }
+
+    std::sort(ranges.begin(), ranges.end(), [](Range* a, Range* b) {
+        return a->firstIndex < b->firstIndex;
+    });
+    glBindBuffer(GL_COPY_READ_BUFFER, page.ebo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+    next = 0;
+    for (Range* range : ranges) {
+        if (range->indexCount > 0) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                static_cast<GLintptr>(range->firstIndex * sizeof(uint32_t)),
+                static_cast<GLintptr>(next * sizeof(uint32_t)),
+                static_cast<GLsizeiptr>(range->indexCount * sizeof(uint32_t)));
+        }
+        range->firstIndex = next;
+        next += range->indexCount;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &page.vbo);
+    glDeleteBuffers(1, &page.ebo);
+    page.vbo = vbo;
+    page.ebo = ebo;
+    page.vertexCapacity = vertexCapacity;
+    page.indexCapacity = indexCapacity;
+    page.freeVertices.clear();
+    page.freeIndices.clear();
+    if (page.verticesUsed < vertexCapacity) {
+        page.freeVertices.emplace(page.verticesUsed, vertexCapacity - page.verticesUsed);
+    }
+    if (page.indicesUsed < indexCapacity) {
+        page.freeIndices.emplace(page.indicesUsed, indexCapacity - page.indicesUsed);
+    }
+    // The vertex array keeps its name, so meshes and render queues holding it stay valid.
+    configureVertexArray(page.vao, page.vbo, page.ebo);
+    m_repacks++;
+}
+
+bool GeometryArena::fits(const Page& page, uint32_t vertexCount, uint32_t indexCount) const {
+    return hasBlock(page.freeVertices, vertexCount) && hasBlock(page.freeIndices, indexCount);
+}
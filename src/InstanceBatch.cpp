@@ -0,0 +1,90 @@
+#include "InstanceBatch.h"
+#include <algorithm>
+#include <utility>
+#include <glad/glad.h>
+
+InstanceBatch::InstanceBatch(const Object3D& model) {
+    model.forEachMesh([this](const MeshHandle& mesh, const glm::mat4& transform) {
+        m_parts.push_back({ mesh, transform });
+        m_sphere.expand(mesh->getBoundingSphere().transformed(transform));
+    });
+    glGenBuffers(1, &m_buffer);
+}
+
+InstanceBatch::InstanceBatch(MeshHandle mesh) {
+    m_sphere = mesh->getBoundingSphere();
+    m_parts.push_back({ std::move(mesh), glm::mat4(1) });
+    glGenBuffers(1, &m_buffer);
+}
+
+InstanceBatch::~InstanceBatch() {
+    if (m_buffer != 0) {
+        glDeleteBuffers(1, &m_buffer);
+    }
+}
+
+InstanceBatch::InstanceBatch(InstanceBatch&& other) noexcept
+    : m_parts(std::move(other.m_parts)), m_sphere(other.m_sphere), m_instances(std::move(other.m_instances)),
+    m_visible(std::move(other.m_visible)), m_buffer(std::exchange(other.m_buffer, 0)),
+    m_bufferCapacity(std::exchange(other.m_bufferCapacity, 0)) {
+}
+
+InstanceBatch& InstanceBatch::operator=(InstanceBatch&& other) noexcept {
+    if (this != &other) {
+        if (m_buffer != 0) {
+            glDeleteBuffers(1, &m_buffer);
+        }
+        m_parts = std::move(other.m_parts);
+        m_sphere = other.m_sphere;
+        m_instances = std::move(other.m_instances);
+        m_visible = std::move(other.m_visible);
+        m_buffer = std::exchange(other.m_buffer, 0);
+        m_bufferCapacity = std::exchange(other.m_bufferCapacity, 0);
+    }
+    return *this;
+}
+
+void InstanceBatch::add(const glm::mat4& model, const glm::vec4& material) {
+    m_instances.push_back({ model, material });
+}
+
+std::vector<InstanceData>& InstanceBatch::instances() {
+    return m_instances;
+}
+
+const std::vector<InstanceData>& InstanceBatch::instances() const {
+    return m_instances;
+}
+
+void InstanceBatch::render(ShaderProgram& program, const Frustum& frustum, CullStats& stats) {
+    m_visible.clear();
+    for (auto& instance : m_instances) {
+        stats.testedObjects++;
+        if (frustum.test(m_sphere.transformed(instance.model)) == Frustum::Result::Outside) {
+            stats.culledSubtrees++;
+            continue;
+        }
+        m_visible.push_back(instance);
+    }
+    if (m_visible.empty())
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    // Grow geometrically, so a slowly growing batch doesn't reallocate every frame.
+    if (m_visible.size() > m_bufferCapacity) {
+        m_bufferCapacity = std::max(m_visible.size(), m_bufferCapacity * 2);
+    }
+    // Respecifying the storage orphans last frame's, so the upload doesn't wait for draws
+    // that are still reading it.
+    glBufferData(GL_ARRAY_BUFFER, m_bufferCapacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_visible.size() * sizeof(InstanceData), m_visible.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    uint32_t count = static_cast<uint32_t>(m_visible.size());
+    for (auto& part : m_parts) {
+        program.setUniform("meshTransform", part.transform);
+        part.mesh->renderInstanced(program, m_buffer, count);
+    }
+    stats.visibleObjects += count;
+    stats.drawnMeshes += static_cast<uint32_t>(m_parts.size());
+}
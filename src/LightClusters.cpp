@@ -0,0 +1,280 @@
+#include "LightClusters.h"
+#include "GLState.h"
+#include "ShaderProgram.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glad/glad.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLUSTERS_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Lights whose ranges are found on one job.
+    constexpr size_t LIGHTS_PER_JOB = 256;
+
+    // The buffers and textures, in the order of their units.
+    constexpr uint32_t LIGHTS = 0;
+    constexpr uint32_t RANGES = 1;
+    constexpr uint32_t INDICES = 2;
+
+    // The distance from a value to a range, 0 inside it.
+    float outside(float value, float min, float max) {
+        return std::max(min - value, 0.f) + std::max(value - max, 0.f);
+    }
+
+    void stream(uint32_t buffer, size_t bytes, const void* data) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        // A new store each frame, so the driver need not wait for the last frame's draws.
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(bytes), data, GL_STREAM_DRAW);
+    }
+}
+
+LightClusters::LightClusters(ThreadPool& workers)
+    : m_workers(workers), m_clusterLights(CLUSTERS), m_clusterRanges(CLUSTERS) {
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    m_maxTexels = static_cast<uint32_t>(std::max(maxTexels, 1));
+
+    glGenBuffers(3, m_buffers);
+    glGenTextures(3, m_textures);
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    const SharedTextureUnit units[3] = { CLUSTER_LIGHTS_UNIT, CLUSTER_RANGES_UNIT, CLUSTER_INDICES_UNIT };
+    for (uint32_t i = 0; i < 3; i++) {
+        // A buffer texture needs a store before it can be attached.
+        stream(m_buffers[i], 16, nullptr);
+        GLState::shared().bindBufferTexture(units[i], m_textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_buffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters() {
+    for (uint32_t texture : m_textures) {
+        GLState::shared().deleteTexture(texture);
+    }
+    glDeleteBuffers(3, m_buffers);
+}
+
+void LightClusters::computeBounds(const glm::mat4& projection, uint32_t width, uint32_t height) {
+    m_projection = projection;
+    m_width = width;
+    m_height = height;
+    // The planes of a glm::perspective() projection.
+    m_near = projection[3][2] / (projection[2][2] - 1.f);
+    m_far = projection[3][2] / (projection[2][2] + 1.f);
+    // Tiles are whole pixels, so the last ones may reach past the edge.
+    m_tileWidth = std::ceil(float(width) / GRID_X);
+    m_tileHeight = std::ceil(float(height) / GRID_Y);
+    float logRatio = std::log(m_far / m_near);
+    m_sliceScale = GRID_Z / logRatio;
+    m_sliceBias = -m_sliceScale * std::log(m_near);
+
+    // A tile edge at a view depth, in view space, for each of the x and y axes.
+    float scaleX = 1.f / projection[0][0];
+    float scaleY = 1.f / projection[1][1];
+    auto edgeX = [&](uint32_t x) {
+        return (2.f * x * m_tileWidth / width - 1.f) * scaleX;
+    };
+    auto edgeY = [&](uint32_t y) {
+        return (2.f * y * m_tileHeight / height - 1.f) * scaleY;
+    };
+
+    m_rows.resize(GRID_Y * GRID_Z);
+    for (uint32_t z = 0; z < GRID_Z; z++) {
+        float nearDepth = m_near * std::pow(m_far / m_near, float(z) / GRID_Z);
+        float farDepth = m_near * std::pow(m_far / m_near, float(z + 1) / GRID_Z);
+        for (uint32_t y = 0; y < GRID_Y; y++) {
+            ClusterRow& row = m_rows[z * GRID_Y + y];
+            // Each edge is a plane through the eye, so a cluster's box spans the edges at both
+            // of its depths.
+            row.minY = std::min(edgeY(y) * nearDepth, edgeY(y) * farDepth);
+            row.maxY = std::max(edgeY(y + 1) * nearDepth, edgeY(y + 1) * farDepth);
+            row.minZ = -farDepth;
+            row.maxZ = -nearDepth;
+            for (uint32_t x = 0; x < GRID_X; x++) {
+                row.minX[x] = std::min(edgeX(x) * nearDepth, edgeX(x) * farDepth);
+                row.maxX[x] = std::max(edgeX(x + 1) * nearDepth, edgeX(x + 1) * farDepth);
+            }
+        }
+    }
+}
+
+uint32_t LightClusters::sliceOf(float depth) const {
+    float slice = std::floor(std::log(depth) * m_sliceScale + m_sliceBias);
+    return static_cast<uint32_t>(std::clamp(slice, 0.f, float(GRID_Z - 1)));
+}
+
+LightClusters::LightRange LightClusters::range(const glm::mat4& view, const glm::vec3& center, float radius) const {
+    LightRange range{};
+    range.center = glm::vec3(view * glm::vec4(center, 1.f));
+    range.radius = radius;
+    float depth = -range.center.z;
+    if (radius <= 0.f || depth + radius < m_near || depth - radius > m_far)
+        return range;
+
+    float minDepth = std::max(depth - radius, m_near);
+    float maxDepth = std::min(depth + radius, m_far);
+    range.minZ = sliceOf(minDepth);
+    range.maxZ = sliceOf(maxDepth);
+
+    // The sphere's box projects to within these tiles: the most extreme x / depth over the box
+    // pairs its least x with the least depth if negative, and with the greatest if not.
+    bool inView = true;
+    auto tiles = [&](float lo, float hi, float projectionScale, float tileSize, uint32_t size, uint32_t count,
+        uint32_t& first, uint32_t& last) {
+        float ndcLo = lo * projectionScale / (lo < 0.f ? minDepth : maxDepth);
+        float ndcHi = hi * projectionScale / (hi > 0.f ? minDepth : maxDepth);
+        if (ndcHi < -1.f || ndcLo > 1.f) {
+            inView = false;
+            return;
+        }
+        auto tile = [&](float ndc) {
+            float t = std::floor((std::clamp(ndc, -1.f, 1.f) + 1.f) * 0.5f * size / tileSize);
+            return static_cast<uint32_t>(std::clamp(t, 0.f, float(count - 1)));
+        };
+        first = tile(ndcLo);
+        last = tile(ndcHi);
+    };
+    tiles(range.center.x - radius, range.center.x + radius, m_projection[0][0], m_tileWidth, m_width, GRID_X,
+        range.minX, range.maxX);
+    tiles(range.center.y - radius, range.center.y + radius, m_projection[1][1], m_tileHeight, m_height, GRID_Y,
+        range.minY, range.maxY);
+    range.visible = inView;
+    return range;
+}
+
+void LightClusters::assignSlice(uint32_t slice) {
+    for (uint32_t i = slice * GRID_X * GRID_Y; i < (slice + 1) * GRID_X * GRID_Y; i++) {
+        m_clusterLights[i].clear();
+    }
+
+    for (uint32_t light = 0; light < m_ranges.size(); light++) {
+        const LightRange& range = m_ranges[light];
+        if (!range.visible || slice < range.minZ || slice > range.maxZ)
+            continue;
+
+        const glm::vec3& c = range.center;
+        float radius2 = range.radius * range.radius;
+        for (uint32_t y = range.minY; y <= range.maxY; y++) {
+            const ClusterRow& row = m_rows[slice * GRID_Y + y];
+            float dy = outside(c.y, row.minY, row.maxY);
+            float dz = outside(c.z, row.minZ, row.maxZ);
+            // What is left of the squared radius for the distance along x.
+            float rest = radius2 - dy * dy - dz * dz;
+            if (rest < 0.f)
+                continue;
+
+            uint32_t first = (slice * GRID_Y + y) * GRID_X;
+#ifdef CLUSTERS_SSE
+            const __m128 cx = _mm_set1_ps(c.x);
+            const __m128 rest4 = _mm_set1_ps(rest);
+            const __m128 zero = _mm_setzero_ps();
+            for (uint32_t x = range.minX & ~3u; x <= range.maxX; x += 4) {
+                __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(row.minX + x), cx), zero),
+                    _mm_max_ps(_mm_sub_ps(cx, _mm_load_ps(row.maxX + x)), zero));
+                int hits = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), rest4));
+                for (uint32_t lane = 0; lane < 4; lane++) {
+                    uint32_t tile = x + lane;
+                    if ((hits & (1 << lane)) && tile >= range.minX && tile <= range.maxX) {
+                        m_clusterLights[first + tile].push_back(light);
+                    }
+                }
+            }
+#else
+            for (uint32_t x = range.minX; x <= range.maxX; x++) {
+                float dx = outside(c.x, row.minX[x], row.maxX[x]);
+                if (dx * dx <= rest) {
+                    m_clusterLights[first + x].push_back(light);
+                }
+            }
+#endif
+        }
+    }
+}
+
+void LightClusters::build(FrameData& frame, uint32_t width, uint32_t height,
+    const std::vector<FramePointLight>& pointLights, const std::vector<FrameSpotLight>& spotLights) {
+    auto start = std::chrono::steady_clock::now();
+    if (frame.projection != m_projection || width != m_width || height != m_height) {
+        computeBounds(frame.projection, width, height);
+    }
+
+    m_lights.resize(pointLights.size() + spotLights.size());
+    m_ranges.resize(m_lights.size());
+    size_t jobs = (m_lights.size() + LIGHTS_PER_JOB - 1) / LIGHTS_PER_JOB;
+    m_workers.parallelFor(jobs, [&](size_t job) {
+        size_t end = std::min((job + 1) * LIGHTS_PER_JOB, m_lights.size());
+        for (size_t i = job * LIGHTS_PER_JOB; i < end; i++) {
+            ClusterLight& light = m_lights[i];
+            if (i < pointLights.size()) {
+                const FramePointLight& point = pointLights[i];
+                // A cone of every direction: theta is never below cutOff.
+                light = { point.position, lightRadius(point), glm::vec3(0.f, -1.f, 0.f), -1.f, point.ambient, -2.f,
+                    point.diffuse, point.constant, point.specular, point.linear, point.quadratic, {} };
+                m_ranges[i] = range(frame.view, light.position, light.radius);
+            }
+            else {
+                const FrameSpotLight& spot = spotLights[i - pointLights.size()];
+                glm::vec3 direction = glm::normalize(spot.direction);
+                light = { spot.position, lightRadius(spot), direction, spot.cutOff, spot.ambient, spot.outerCutOff,
+                    spot.diffuse, spot.constant, spot.specular, spot.linear, spot.quadratic, {} };
+                // The sphere through the cone's tip and the rim of its cap bounds the cone, and is
+                // smaller than the light's whole sphere for cones narrower than 120 degrees.
+                if (spot.outerCutOff > 0.5f) {
+                    float coneRadius = light.radius / (2.f * spot.outerCutOff);
+                    m_ranges[i] = range(frame.view, light.position + direction * coneRadius, coneRadius);
+                }
+                else {
+                    m_ranges[i] = range(frame.view, light.position, light.radius);
+                }
+            }
+        }
+    });
+
+    m_workers.parallelFor(GRID_Z, [&](size_t slice) {
+        assignSlice(static_cast<uint32_t>(slice));
+    });
+
+    m_stats = LightClusterStats();
+    m_stats.lights = static_cast<uint32_t>(m_lights.size());
+    for (auto& range : m_ranges) {
+        m_stats.visibleLights += range.visible;
+    }
+    m_indices.clear();
+    for (uint32_t cluster = 0; cluster < CLUSTERS; cluster++) {
+        const std::vector<uint32_t>& lights = m_clusterLights[cluster];
+        uint32_t offset = static_cast<uint32_t>(m_indices.size());
+        uint32_t count = std::min(static_cast<uint32_t>(lights.size()), m_maxTexels - offset);
+        m_indices.insert(m_indices.end(), lights.begin(), lights.begin() + count);
+        m_clusterRanges[cluster] = glm::uvec2(offset, count);
+        m_stats.maxClusterLights = std::max(m_stats.maxClusterLights, static_cast<uint32_t>(lights.size()));
+        m_stats.droppedIndices += static_cast<uint32_t>(lights.size()) - count;
+    }
+    m_stats.indices = static_cast<uint32_t>(m_indices.size());
+    m_stats.assignMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    upload();
+    frame.clusterGrid = glm::uvec4(GRID_X, GRID_Y, GRID_Z, 1);
+    frame.clusterScale = glm::vec4(m_tileWidth, m_tileHeight, m_sliceScale, m_sliceBias);
+}
+
+void LightClusters::upload() {
+    stream(m_buffers[LIGHTS], std::max<size_t>(m_lights.size(), 1) * sizeof(ClusterLight),
+        m_lights.empty() ? nullptr : m_lights.data());
+    stream(m_buffers[RANGES], m_clusterRanges.size() * sizeof(glm::uvec2), m_clusterRanges.data());
+    stream(m_buffers[INDICES], std::max<size_t>(m_indices.size(), 1) * sizeof(uint32_t),
+        m_indices.empty() ? nullptr : m_indices.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    GLState& state = GLState::shared();
+    state.bindBufferTexture(CLUSTER_LIGHTS_UNIT, m_textures[LIGHTS]);
+    state.bindBufferTexture(CLUSTER_RANGES_UNIT, m_textures[RANGES]);
+    state.bindBufferTexture(CLUSTER_INDICES_UNIT, m_textures[INDICES]);
+}
+
+const LightClusterStats& LightClusters::stats() const {
+    return m_stats;
+}
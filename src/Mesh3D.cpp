@@ -1,77 +1,200 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
 #include "Mesh3D.h"
+#include "GLState.h"
 #include <glad/glad.h>
 
+namespace {
+	uint32_t nextMeshId = 0;
+}
+
 Mesh3D::Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces,
-	Texture texture)
-	: Mesh3D(std::move(vertices), std::move(faces), std::vector<Texture>{texture}) {
+	Texture texture, bool keepGeometry)
+	: Mesh3D(std::move(vertices), std::move(faces), std::vector<Texture>{texture}, keepGeometry) {
 }
 
-Mesh3D::Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces, std::vector<Texture>&& textures)
-	: m_vertexCount(vertices.size()), m_faceCount(faces.size()), m_textures(textures) {
+Mesh3D::Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces, std::vector<Texture>&& textures,
+	bool keepGeometry)
+	: m_id(nextMeshId++), m_vertexCount(vertices.size()), m_faceCount(faces.size()), m_textures(std::move(textures)) {
 
-	// Generate a vertex array object on the GPU.
-	glGenVertexArrays(1, &m_vao);
-	// "Bind" the newly-generated vao, which makes future functions operate on that specific object.
-	glBindVertexArray(m_vao);
+	// Bounds are computed once, here, for imported meshes and squares alike. The sphere is
+	// centered on the box, with the radius of the farthest vertex from that center.
+	for (auto& v : vertices) {
+		m_bounds.expand(glm::vec3(v.x, v.y, v.z));
+	}
+	if (!m_bounds.isEmpty()) {
+		glm::vec3 center = m_bounds.center();
+		float radiusSq = 0;
+		for (auto& v : vertices) {
+			glm::vec3 d = glm::vec3(v.x, v.y, v.z) - center;
+			radiusSq = std::max(radiusSq, glm::dot(d, d));
+		}
+		m_sphere = BoundingSphere(center, std::sqrt(radiusSq));
+	}
 
-	// Generate a vertex buffer object on the GPU.
-	uint32_t vbo;
-	glGenBuffers(1, &vbo);
+	if (keepGeometry) {
+		auto geometry = std::make_shared<MeshGeometry>();
+		geometry->positions.reserve(vertices.size());
+		for (auto& v : vertices) {
+			geometry->positions.emplace_back(v.x, v.y, v.z);
+		}
+		geometry->indices = faces;
+		m_geometry = std::move(geometry);
+	}
 
-	// "Bind" the newly-generated vbo, which makes future functions operate on that specific object.
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	// This vbo is now associated with m_vao.
-	// Copy the contents of the vertices list to the buffer that lives on the GPU.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex3D), &vertices[0], GL_STATIC_DRAW);
-	// Inform OpenGL how to interpret the buffer: each vertex is 3 floats for position...
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex3D), 0);
-	glEnableVertexAttribArray(0);
+	// Upload the vertices and indices into the shared arena, next to other meshes' geometry.
+	m_range = GeometryArena::shared().allocate(vertices, faces);
+}
 
-	// Inform OpenGL how to interpret the buffer: ... then 3 floats for normal vector...
-	glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)12);
-	glEnableVertexAttribArray(1);
 
-	// Inform OpenGL how to interpret the buffer: ... the 2 floats for texture coordinate...
-	glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex3D), (void*)24);
-	glEnableVertexAttribArray(2);
+Mesh3D::~Mesh3D() {
+	if (m_range != nullptr) {
+		GeometryArena::shared().free(m_range);
+	}
+}
 
-	// Inform OpenGL how to interpret the buffer: ... the 3 floats for tangent vector.
-	glVertexAttribPointer(3, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)32);
-	glEnableVertexAttribArray(3);
+Mesh3D::Mesh3D(Mesh3D&& other) noexcept
+	: m_range(std::exchange(other.m_range, nullptr)), m_id(other.m_id), m_vertexCount(other.m_vertexCount), m_faceCount(other.m_faceCount),
+	m_textures(std::move(other.m_textures)), m_bounds(other.m_bounds), m_sphere(other.m_sphere),
+	m_geometry(std::move(other.m_geometry)) {
+}
 
+Mesh3D& Mesh3D::operator=(Mesh3D&& other) noexcept {
+	if (this != &other) {
+		if (m_range != nullptr) {
+			GeometryArena::shared().free(m_range);
+		}
+		m_range = std::exchange(other.m_range, nullptr);
+		m_id = other.m_id;
+		m_vertexCount = other.m_vertexCount;
+		m_faceCount = other.m_faceCount;
+		m_textures = std::move(other.m_textures);
+		m_bounds = other.m_bounds;
+		m_sphere = other.m_sphere;
+		m_geometry = std::move(other.m_geometry);
+	}
+	return *this;
+}
 
-	// Generate a second buffer, to store the indices of each triangle in the mesh.
-	uint32_t ebo;
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(uint32_t), &faces[0], GL_STATIC_DRAW);
+const AABB& Mesh3D::getBounds() const {
+	return m_bounds;
+}
 
-	// Unbind the vertex array, so no one else can accidentally mess with it.
-	glBindVertexArray(0);
+const BoundingSphere& Mesh3D::getBoundingSphere() const {
+	return m_sphere;
 }
 
+const MeshGeometry* Mesh3D::getGeometry() const {
+	return m_geometry.get();
+}
+
+std::shared_ptr<const MeshGeometry> Mesh3D::getSharedGeometry() const {
+	return m_geometry;
+}
+
+uint32_t Mesh3D::getId() const {
+	return m_id;
+}
+
+uint32_t Mesh3D::getVertexCount() const {
+	return m_vertexCount;
+}
+
+uint32_t Mesh3D::getIndexCount() const {
+	return m_faceCount;
+}
+
+uint32_t Mesh3D::getVertexArray() const {
+	return GeometryArena::shared().getVertexArray(*m_range);
+}
+
+const std::vector<Texture>& Mesh3D::getTextures() const {
+	return m_textures;
+}
 
-void Mesh3D::addTexture(Texture texture) {
-	m_textures.push_back(texture);
+size_t Mesh3D::gpuBytes() const {
+	return m_vertexCount * sizeof(Vertex3D) + m_faceCount * sizeof(uint32_t);
+}
+
+size_t Mesh3D::cpuBytes() const {
+	if (!m_geometry)
+		return 0;
+	return m_geometry->positions.size() * sizeof(glm::vec3) + m_geometry->indices.size() * sizeof(uint32_t);
 }
 
 void Mesh3D::render(ShaderProgram& program) const {
     // glm::vec4 material = glm::vec4(1);
     // program.setUniform("material", material);
 
-	glBindVertexArray(m_vao);
+	// Binds that are already in place are skipped, so consecutive meshes of one arena page
+	// share the vertex array bind.
+	GLState::shared().bindVertexArray(getVertexArray());
+	bindTextures(program);
+
+	// Draw the mesh's part of the vertex array, using its "element buffer" to identify the
+	// faces. Indices count from the mesh's first vertex.
+	glDrawElementsBaseVertex(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, indexOffset(), m_range->firstVertex);
+}
+
+void Mesh3D::draw() const {
+	glDrawElementsBaseVertex(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, indexOffset(), m_range->firstVertex);
+}
+
+void Mesh3D::draw(uint32_t baseInstance) const {
+	glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, indexOffset(), 1,
+		m_range->firstVertex, baseInstance);
+}
+
+DrawElementsIndirectCommand Mesh3D::indirectCommand(uint32_t baseInstance) const {
+	return { m_faceCount, 1, m_range->firstIndex, static_cast<int32_t>(m_range->firstVertex), baseInstance };
+}
+
+void Mesh3D::renderInstanced(ShaderProgram& program, uint32_t instanceBuffer, uint32_t instanceCount) const {
+	GLState::shared().bindVertexArray(getVertexArray());
+	bindTextures(program);
+
+	attachInstanceAttributes(instanceBuffer);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, indexOffset(), instanceCount,
+		m_range->firstVertex);
+
+	// Detach the instance attributes again, so plain render() calls don't see them.
+	detachInstanceAttributes();
+}
+
+void Mesh3D::attachInstanceAttributes(uint32_t instanceBuffer) {
+	// Each instance's model matrix takes four attribute slots, one per column; the attributes
+	// advance once per instance instead of once per vertex.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (uint32_t column = 0; column < 4; column++) {
+		glVertexAttribPointer(4 + column, 4, GL_FLOAT, false, sizeof(InstanceData),
+			(void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(4 + column, 1);
+		glEnableVertexAttribArray(4 + column);
+	}
+	glVertexAttribPointer(8, 4, GL_FLOAT, false, sizeof(InstanceData), (void*)offsetof(InstanceData, material));
+	glVertexAttribDivisor(8, 1);
+	glEnableVertexAttribArray(8);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh3D::detachInstanceAttributes() {
+	for (uint32_t location = 4; location <= 8; location++) {
+		glDisableVertexAttribArray(location);
+	}
+}
+
+const void* Mesh3D::indexOffset() const {
+	return reinterpret_cast<const void*>(size_t(m_range->firstIndex) * sizeof(uint32_t));
+}
+
+void Mesh3D::bindTextures(ShaderProgram& program) const {
 	for (auto i = 0; i < static_cast<int>(m_textures.size()); i++) {
 		program.setUniform(m_textures[i].samplerName, i);
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textures[i].textureId);
+		GLState::shared().bindTexture(i, m_textures[i].textureId);
 	}
-
-	// Draw the vertex array, using its "element buffer" to identify the faces.
-	glDrawElements(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr);
-	// Deactivate the mesh's vertex array and texture.
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 
@@ -87,6 +210,7 @@ Mesh3D Mesh3D::square(const std::vector<Texture>& textures) {
 			2, 1, 3,
 			3, 1, 0,
 		},
-		std::vector<Texture>(textures)
+		std::vector<Texture>(textures),
+		true
 	);
 }
@@ -0,0 +1,86 @@
+#include "MeshRegistry.h"
+#include <algorithm>
+
+MeshRegistry& MeshRegistry::shared() {
+    // Create the arena first so that it is destroyed last, after the meshes freeing into it.
+    GeometryArena::shared();
+    static MeshRegistry registry;
+    return registry;
+}
+
+MeshHandle MeshRegistry::insert(Mesh3D&& mesh, const std::string& key) {
+    MeshHandle handle = std::make_shared<const Mesh3D>(std::move(mesh));
+    m_meshes.push_back({ handle, key });
+    return handle;
+}
+
+MeshHandle MeshRegistry::add(Mesh3D&& mesh) {
+    return insert(std::move(mesh), "");
+}
+
+MeshHandle MeshRegistry::add(const std::string& key, Mesh3D&& mesh) {
+    if (MeshHandle existing = find(key))
+        return existing;
+    MeshHandle handle = insert(std::move(mesh), key);
+    // The key may still be there from a mesh that expired outside the registry's watch.
+    m_keyed.insert_or_assign(key, handle);
+    return handle;
+}
+
+MeshHandle MeshRegistry::find(const std::string& key) const {
+    auto it = m_keyed.find(key);
+    return it == m_keyed.end() ? nullptr : it->second.lock();
+}
+
+MeshHandle MeshRegistry::square(const std::vector<Texture>& textures) {
+    std::string key = "square";
+    for (auto& t : textures) {
+        key += ":" + std::to_string(t.textureId) + "=" + t.samplerName;
+    }
+    if (MeshHandle existing = find(key))
+        return existing;
+    return add(key, Mesh3D::square(textures));
+}
+
+size_t MeshRegistry::releaseUnused() {
+    size_t before = m_meshes.size();
+    // Partitioning keeps the unused entries intact past the used ones, keys included, where
+    // std::remove_if would leave them moved-from.
+    auto unused = std::stable_partition(m_meshes.begin(), m_meshes.end(), [](const Entry& entry) {
+        return entry.mesh.use_count() != 1;
+    });
+    for (auto it = unused; it != m_meshes.end(); ++it) {
+        if (!it->key.empty()) {
+            m_keyed.erase(it->key);
+        }
+    }
+    m_meshes.erase(unused, m_meshes.end());
+    size_t released = before - m_meshes.size();
+    // Close the holes the freed meshes left, so new meshes pack in at the end of the pages.
+    if (released > 0) {
+        GeometryArena::shared().compact();
+    }
+    return released;
+}
+
+void MeshRegistry::clear() {
+    m_meshes.clear();
+    m_keyed.clear();
+}
+
+MeshMemoryStats MeshRegistry::stats() const {
+    MeshMemoryStats stats;
+    for (auto& entry : m_meshes) {
+        size_t references = static_cast<size_t>(entry.mesh.use_count()) - 1;
+        stats.uniqueMeshes++;
+        stats.references += references;
+        stats.gpuBytes += entry.mesh->gpuBytes();
+        stats.cpuBytes += entry.mesh->cpuBytes();
+        stats.unsharedGpuBytes += references * entry.mesh->gpuBytes();
+    }
+    return stats;
+}
+
+size_t MeshRegistry::size() const {
+    return m_meshes.size();
+}
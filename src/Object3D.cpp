@@ -1,5 +1,7 @@
 #include "Object3D.h"
 #include "ShaderProgram.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
 #include <glm/ext.hpp>
 
 glm::mat4 Object3D::buildModelMatrix() const {
@@ -14,15 +16,19 @@ glm::mat4 Object3D::buildModelMatrix() const {
 	return m;
 }
 
-Object3D::Object3D(std::vector<Mesh3D>&& meshes)
+Object3D::Object3D(std::vector<MeshHandle>&& meshes)
 	: Object3D(std::move(meshes), glm::mat4(1)) {
 }
 
-Object3D::Object3D(std::vector<Mesh3D>&& meshes, const glm::mat4& baseTransform)
-	: m_meshes(meshes), m_position(), m_orientation(), m_scale(1.0),
-	m_center(), m_forward(), m_velocity(), m_acceleration(), m_rotVelocity(), m_rotAcceleration(), m_shininess(4), m_baseTransform(baseTransform),
-    m_display(true), m_gravityAffected(true)
+Object3D::Object3D(std::vector<MeshHandle>&& meshes, const glm::mat4& baseTransform)
+	: m_meshes(std::move(meshes)), m_position(), m_orientation(), m_scale(1.0),
+	m_center(), m_forward(), m_body(), m_shininess(4), m_baseTransform(baseTransform),
+    m_display(true), m_occluder(false), m_transparent(false), m_boundsDirty(true), m_subtreeTriangles(0)
 {
+	for (auto& mesh : m_meshes) {
+		m_meshBounds.expand(mesh->getBounds());
+		m_meshSphere.expand(mesh->getBoundingSphere());
+	}
 }
 
 const glm::vec3& Object3D::getPosition() const {
@@ -53,25 +59,37 @@ const std::string& Object3D::getName() const {
 }
 
 const glm::vec3& Object3D::getVelocity() const {
-    return m_velocity;
+    return m_body.velocity;
 }
 
 const glm::vec3& Object3D::getRotVelocity() const {
-    return m_rotVelocity;
+    return m_body.rotVelocity;
 }
 
 const glm::vec3& Object3D::getAcceleration() const {
-    return m_acceleration;
+    return m_body.acceleration;
 }
 
 const glm::vec3& Object3D::getRotAcceleration() const {
-    return m_rotAcceleration;
+    return m_body.rotAcceleration;
 }
 
 const glm::vec3& Object3D::getForward() const {
     return m_forward;
 }
 
+const PhysicsBody& Object3D::getBody() const {
+    return m_body;
+}
+
+const std::vector<MeshHandle>& Object3D::getMeshes() const {
+	return m_meshes;
+}
+
+const glm::mat4& Object3D::getBaseTransform() const {
+	return m_baseTransform;
+}
+
 const float Object3D::getShininess() const {
     return m_shininess;
 }
@@ -94,14 +112,17 @@ Object3D& Object3D::getChild(size_t index) {
 
 void Object3D::setPosition(const glm::vec3& position) {
 	m_position = position;
+	m_boundsDirty = true;
 }
 
 void Object3D::setOrientation(const glm::vec3& orientation) {
 	m_orientation = orientation;
+	m_boundsDirty = true;
 }
 
 void Object3D::setScale(const glm::vec3& scale) {
 	m_scale = scale;
+	m_boundsDirty = true;
 }
 
 /**
@@ -111,6 +132,7 @@ void Object3D::setScale(const glm::vec3& scale) {
 void Object3D::setCenter(const glm::vec3& center)
 {
 	m_center = center;
+	m_boundsDirty = true;
 }
 
 void Object3D::setName(const std::string& name) {
@@ -118,19 +140,19 @@ void Object3D::setName(const std::string& name) {
 }
 
 void Object3D::setVelocity(const glm::vec3& vec) {
-    m_velocity = vec;
+    m_body.velocity = vec;
 }
 
 void Object3D::setRotVelocity(const glm::vec3& vec) {
-    m_rotVelocity = vec;
+    m_body.rotVelocity = vec;
 }
 
 void Object3D::setAcceleration(const glm::vec3& accel) {
-    m_acceleration = accel;
+    m_body.acceleration = accel;
 }
 
 void Object3D::setRotAcceleration(const glm::vec3& accel) {
-    m_rotAcceleration = accel;
+    m_body.rotAcceleration = accel;
 }
 
 void Object3D::setForward(const glm::vec3& vec) {
@@ -147,22 +169,22 @@ void Object3D::setShininess(const float value) {
 
 void Object3D::move(const glm::vec3& offset) {
 	m_position = m_position + offset;
+	m_boundsDirty = true;
 }
 
 void Object3D::rotate(const glm::vec3& rotation) {
 	m_orientation = m_orientation + rotation;
+	m_boundsDirty = true;
 }
 
 void Object3D::grow(const glm::vec3& growth) {
 	m_scale = m_scale * growth;
+	m_boundsDirty = true;
 }
 
 void Object3D::addChild(Object3D&& child) {
 	m_children.emplace_back(child);
-}
-
-inline float signOf(float x) {
-    return (x > 0 ? 1 : (x < 0 ? -1 : 0));
+	m_boundsDirty = true;
 }
 
 const bool Object3D::getDisplay() const {
@@ -173,8 +195,24 @@ void Object3D::setDisplay(const bool v) {
     m_display = v;
 }
 
+bool Object3D::isOccluder() const {
+    return m_occluder;
+}
+
+void Object3D::setOccluder(bool occluder) {
+    m_occluder = occluder;
+}
+
+bool Object3D::isTransparent() const {
+    return m_transparent;
+}
+
+void Object3D::setTransparent(bool transparent) {
+    m_transparent = transparent;
+}
+
 void Object3D::toggleGravity() {
-    m_gravityAffected = not m_gravityAffected;
+    m_body.gravityAffected = not m_body.gravityAffected;
 }
 
 void Object3D::updateForward() {
@@ -188,75 +226,244 @@ void Object3D::updateForward() {
 }
 
 void Object3D::tick(float_t dt) {
-    const float_t friction = 1.25f;
-    const float_t weight = 4.0f;
-    const float_t gravity = 9.81f;
-    const float_t deceleration = 2.f; // natural deceleration of movement.
-    const float_t rubber = 0.5f; // how much velocity is retained during collision
     // updateForward();
+    glm::vec3 lastPosition = m_position;
+    glm::vec3 lastOrientation = m_orientation;
 
     // m_position.x += m_forward.x * m_velocity.x * dt;
     // m_position.z += m_forward.z * m_velocity.z * dt;
     // m_position.y += m_velocity.y * dt;
 
-    m_position += m_velocity * dt;
-    m_velocity += m_acceleration * dt;
-
-    m_orientation += m_rotVelocity * dt;
-    m_rotVelocity += m_rotAcceleration * dt;
+    m_body.step(m_position, m_orientation, dt);
 
-    // gravity when not accelerating upwards
-    if (m_gravityAffected) {
-        if (m_position.y > 0.0 and m_acceleration.y <= 0.0) {
-            m_velocity.y += -(weight + gravity) * dt;
-        }
+    if (m_position != lastPosition || m_orientation != lastOrientation) {
+        m_boundsDirty = true;
     }
 
-    // collision with ground.
-    if (m_position.y < 0.0) {
-        m_position.y = 0.0;
-        m_velocity.y = -(m_velocity.y * rubber);
+    for (auto& c : m_children) {
+        c.tick(dt);
     }
+}
 
-    // decelerate velocity over time when not accelerating.
-    if (not m_acceleration.x and m_velocity.x) {
-        m_velocity.x -= deceleration * friction * dt * signOf(m_velocity.x);
-    }
-    if (not m_acceleration.y and m_velocity.y) {
-        m_velocity.y -= deceleration * friction * dt * signOf(m_velocity.y);
-    }
-    if (not m_acceleration.z and m_velocity.z) {
-        m_velocity.z -= deceleration * friction * dt * signOf(m_velocity.z);
-    }
+/**
+ * @brief Rebuilds the cached bounds of this object and any descendants that moved since
+ * the last call. Subtrees that have not changed are left alone.
+ * @return true if this object's bounds were rebuilt.
+ */
+bool Object3D::updateBounds() {
+	bool childChanged = false;
+	for (auto& child : m_children) {
+		if (child.updateBounds()) {
+			childChanged = true;
+		}
+	}
+	if (!m_boundsDirty && !childChanged) {
+		return false;
+	}
 
-    for (auto& c : m_children) {
-        c.tick(dt);
+	AABB local = m_meshBounds;
+	BoundingSphere localSphere = m_meshSphere;
+	m_subtreeTriangles = 0;
+	for (auto& mesh : m_meshes) {
+		m_subtreeTriangles += mesh->getIndexCount() / 3;
+	}
+	for (auto& child : m_children) {
+		local.expand(child.m_bounds);
+		localSphere.expand(child.m_sphere);
+		m_subtreeTriangles += child.m_subtreeTriangles;
+	}
+
+	// Merged spheres can grow loose over deep hierarchies; the box's circumsphere is
+	// sometimes tighter, and either one is conservative.
+	if (!local.isEmpty()) {
+		float boxRadius = glm::length(local.extents());
+		if (localSphere.isEmpty() || boxRadius < localSphere.radius) {
+			localSphere = BoundingSphere(local.center(), boxRadius);
+		}
+	}
+
+	glm::mat4 model = buildModelMatrix();
+	m_bounds = local.transformed(model);
+	m_sphere = localSphere.transformed(model);
+	m_boundsDirty = false;
+	return true;
+}
+
+/**
+ * @brief Gets the box enclosing the object's own meshes, in local space.
+ */
+const AABB& Object3D::getLocalBounds() const {
+	return m_meshBounds;
+}
+
+/**
+ * @brief Gets the box enclosing the object and its children, in its parent's space
+ * (world space, for objects at the root of the hierarchy).
+ */
+const AABB& Object3D::getBounds() const {
+	return m_bounds;
+}
+
+/**
+ * @brief Gets the sphere enclosing the object and its children, in its parent's space.
+ */
+const BoundingSphere& Object3D::getBoundingSphere() const {
+	return m_sphere;
+}
+
+/**
+ * @brief Gets the box enclosing the object and its children in world space.
+ * @param parentMatrix the model matrix of this object's parent in the model hierarchy.
+ */
+AABB Object3D::getWorldBounds(const glm::mat4& parentMatrix) const {
+	return m_bounds.transformed(parentMatrix);
+}
+
+BoundingSphere Object3D::getWorldBoundingSphere(const glm::mat4& parentMatrix) const {
+	return m_sphere.transformed(parentMatrix);
+}
+
+uint32_t Object3D::getSubtreeTriangles() const {
+	return m_subtreeTriangles;
+}
+
+glm::mat4 Object3D::getModelMatrix(const glm::mat4& parentMatrix) const {
+	return parentMatrix * buildModelMatrix();
+}
+
+namespace {
+    // The queue the immediate render() overloads fill and submit, kept so its packet list and
+    // id maps are not rebuilt on every call. It streams no draw data, so it owns no GL objects
+    // and may outlive the context.
+    RenderQueue& immediateQueue() {
+        static RenderQueue queue;
+        queue.begin(glm::mat4(1));
+        return queue;
     }
 }
 
 void Object3D::render(ShaderProgram& shaderProgram) const {
-    if (m_display)
-        renderRecursive(shaderProgram, glm::mat4(1));
+    if (!m_display)
+        return;
+    RenderQueue& queue = immediateQueue();
+    renderRecursive(queue, shaderProgram, glm::mat4(1));
+    RenderQueueStats queueStats;
+    queue.submit(queueStats);
 }
 
 /**
- * @brief Renders the object and its children, recursively.
+ * @brief Queues the meshes of the object and its children, recursively.
  * @param parentMatrix the model matrix of this object's parent in the model hierarchy.
  */
-void Object3D::renderRecursive(ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const {
+void Object3D::renderRecursive(RenderQueue& queue, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const {
 	// This object's true model matrix is the combination of its parent's matrix and the object's matrix.
 	glm::mat4 trueModel = parentMatrix * buildModelMatrix();
-	shaderProgram.setUniform("model", trueModel);
+	RenderPass pass = m_transparent ? RenderPass::Transparent : RenderPass::Opaque;
+
+	// Queue each mesh in the object.
+	for (auto& mesh : m_meshes) {
+		queue.push(*mesh, shaderProgram, trueModel, m_shininess, pass);
+	}
+	// Queue the children of the object.
+	for (auto& child : m_children) {
+		child.renderRecursive(queue, shaderProgram, trueModel);
+	}
+}
+
+void Object3D::render(ShaderProgram& shaderProgram, const Frustum& frustum, CullStats& stats,
+    const OcclusionCuller* occlusion) const {
+    // Without a camera there is no depth to order by, but meshes are still grouped by state.
+    RenderQueue& queue = immediateQueue();
+    render(queue, shaderProgram, frustum, stats, occlusion);
+    RenderQueueStats queueStats;
+    queue.submit(queueStats);
+}
+
+void Object3D::render(RenderQueue& queue, ShaderProgram& shaderProgram, const Frustum& frustum, CullStats& stats,
+    const OcclusionCuller* occlusion) const {
+    if (m_display)
+        renderRecursive(queue, shaderProgram, glm::mat4(1), frustum, stats, occlusion, false);
+}
+
+/**
+ * @brief Queues the meshes of the object and its children, skipping any subtree whose bounds
+ * lie outside the frustum or behind the occluders.
+ * @param parentMatrix the model matrix of this object's parent in the model hierarchy.
+ * @param occlusion the occlusion buffer for this frame, or nullptr to skip occlusion tests.
+ * @param insideFrustum true if an ancestor was found to be entirely inside the frustum,
+ * in which case this subtree needs no further tests.
+ */
+void Object3D::renderRecursive(RenderQueue& queue, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix,
+	const Frustum& frustum, CullStats& stats, const OcclusionCuller* occlusion, bool insideFrustum) const {
+	if (!insideFrustum) {
+		stats.testedObjects++;
+
+		// The sphere test is cheapest, so it goes first; boxes are tighter for the long,
+		// flat objects (floors, walls) that spheres fit poorly.
+		auto result = frustum.test(getWorldBoundingSphere(parentMatrix));
+		if (result == Frustum::Result::Intersects) {
+			result = frustum.test(getWorldBounds(parentMatrix));
+		}
+		if (result == Frustum::Result::Outside) {
+			stats.culledSubtrees++;
+			return;
+		}
+		insideFrustum = result == Frustum::Result::Inside;
+	}
+
+	// Occluders would hide themselves, so they are never tested.
+	if (occlusion != nullptr && !m_occluder && !occlusion->isVisible(getWorldBounds(parentMatrix))) {
+		stats.occludedSubtrees++;
+		return;
+	}
+
+	glm::mat4 trueModel = parentMatrix * buildModelMatrix();
+	renderMeshes(queue, shaderProgram, trueModel, stats);
 
-    shaderProgram.setUniform("material.shininess", m_shininess);
-    /*shaderProgram.setUniform("material", m_material);*/
+	for (auto& child : m_children) {
+		child.renderRecursive(queue, shaderProgram, trueModel, frustum, stats, occlusion, insideFrustum);
+	}
+}
 
-	// Render each mesh in the object.
+void Object3D::renderMeshes(RenderQueue& queue, ShaderProgram& shaderProgram, const glm::mat4& model,
+	CullStats& stats) const {
+	if (m_meshes.empty())
+		return;
+	RenderPass pass = m_transparent ? RenderPass::Transparent : RenderPass::Opaque;
+	for (auto& mesh : m_meshes) {
+		queue.push(*mesh, shaderProgram, model, m_shininess, pass);
+	}
+	stats.visibleObjects++;
+	stats.drawnMeshes += static_cast<uint32_t>(m_meshes.size());
+}
+
+void Object3D::addOccluders(OcclusionCuller& culler, const glm::mat4& parentMatrix) const {
+	if (!m_display)
+		return;
+
+	glm::mat4 trueModel = parentMatrix * buildModelMatrix();
+	if (m_occluder) {
+		for (auto& mesh : m_meshes) {
+			if (auto* geometry = mesh->getGeometry()) {
+				culler.addOccluder(*geometry, trueModel);
+			}
+		}
+	}
+	for (auto& child : m_children) {
+		child.addOccluders(culler, trueModel);
+	}
+}
+
+void Object3D::forEachMesh(const std::function<void(const MeshHandle&, const glm::mat4&)>& visit,
+	const glm::mat4& parentMatrix) const {
+	if (!m_display)
+		return;
+
+	glm::mat4 trueModel = parentMatrix * buildModelMatrix();
 	for (auto& mesh : m_meshes) {
-		mesh.render(shaderProgram);
+		visit(mesh, trueModel);
 	}
-	// Render the children of the object.
 	for (auto& child : m_children) {
-		child.renderRecursive(shaderProgram, trueModel);
+		child.forEachMesh(visit, trueModel);
 	}
 }
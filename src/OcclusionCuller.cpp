@@ -0,0 +1,281 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+OcclusionCuller::OcclusionCuller(ThreadPool& pool)
+    : m_pool(pool), m_viewProjection(1), m_bins(TILES_X * TILES_Y),
+    m_depth(WIDTH * HEIGHT, 1.f), m_tileMaxDepth(TILES_X * TILES_Y, 1.f) {
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4& viewProjection) {
+    m_viewProjection = viewProjection;
+    m_triangles.clear();
+    for (auto& bin : m_bins) {
+        bin.clear();
+    }
+    m_stats = Stats();
+}
+
+void OcclusionCuller::addOccluder(const MeshGeometry& geometry, const glm::mat4& model) {
+    glm::mat4 toClip = m_viewProjection * model;
+
+    m_clip.clear();
+    for (auto& p : geometry.positions) {
+        m_clip.push_back(toClip * glm::vec4(p, 1.f));
+    }
+
+    for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+        addClippedTriangle(m_clip[geometry.indices[i]], m_clip[geometry.indices[i + 1]],
+            m_clip[geometry.indices[i + 2]]);
+    }
+}
+
+/**
+ * @brief Clips a clip-space triangle against the near plane (z >= -w), then projects the
+ * remaining polygon to the screen and bins it.
+ */
+void OcclusionCuller::addClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+    const glm::vec4 in[3] = { a, b, c };
+    glm::vec4 out[4];
+    int outCount = 0;
+
+    for (int i = 0; i < 3; i++) {
+        const glm::vec4& cur = in[i];
+        const glm::vec4& next = in[(i + 1) % 3];
+        float dCur = cur.z + cur.w;
+        float dNext = next.z + next.w;
+
+        if (dCur >= 0) {
+            out[outCount++] = cur;
+        }
+        if ((dCur >= 0) != (dNext >= 0)) {
+            float t = dCur / (dCur - dNext);
+            out[outCount++] = cur + (next - cur) * t;
+        }
+    }
+    if (outCount < 3)
+        return;
+
+    glm::vec3 screen[4];
+    for (int i = 0; i < outCount; i++) {
+        float invW = 1.f / out[i].w;
+        screen[i].x = (out[i].x * invW * 0.5f + 0.5f) * WIDTH;
+        screen[i].y = (out[i].y * invW * 0.5f + 0.5f) * HEIGHT;
+        screen[i].z = std::min(out[i].z * invW * 0.5f + 0.5f, 1.f);
+    }
+
+    // The clipped polygon is convex, so it can be drawn as a fan.
+    for (int i = 1; i + 1 < outCount; i++) {
+        const glm::vec3* verts[3] = { &screen[0], &screen[i], &screen[i + 1] };
+        ScreenTriangle tri;
+        for (int v = 0; v < 3; v++) {
+            tri.x[v] = verts[v]->x;
+            tri.y[v] = verts[v]->y;
+            tri.z[v] = verts[v]->z;
+        }
+        m_triangles.push_back(tri);
+        binTriangle(static_cast<uint32_t>(m_triangles.size() - 1));
+    }
+}
+
+void OcclusionCuller::binTriangle(uint32_t index) {
+    const ScreenTriangle& t = m_triangles[index];
+    float minX = std::min({ t.x[0], t.x[1], t.x[2] });
+    float maxX = std::max({ t.x[0], t.x[1], t.x[2] });
+    float minY = std::min({ t.y[0], t.y[1], t.y[2] });
+    float maxY = std::max({ t.y[0], t.y[1], t.y[2] });
+    if (maxX < 0 || maxY < 0 || minX >= WIDTH || minY >= HEIGHT)
+        return;
+
+    int tx0 = std::max(0, static_cast<int>(minX) / TILE_WIDTH);
+    int tx1 = std::min(TILES_X - 1, static_cast<int>(maxX) / TILE_WIDTH);
+    int ty0 = std::max(0, static_cast<int>(minY) / TILE_HEIGHT);
+    int ty1 = std::min(TILES_Y - 1, static_cast<int>(maxY) / TILE_HEIGHT);
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            m_bins[ty * TILES_X + tx].push_back(index);
+        }
+    }
+}
+
+void OcclusionCuller::rasterize() {
+    auto start = std::chrono::steady_clock::now();
+
+    m_pool.parallelFor(m_bins.size(), [this](size_t tile) {
+        rasterizeTile(static_cast<int>(tile));
+    });
+
+    m_stats.occluderTriangles = static_cast<uint32_t>(m_triangles.size());
+    m_stats.rasterizeMs = std::chrono::duration<float, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Clears one tile and rasterizes every triangle binned to it. Tiles do not share
+ * pixels, so tiles can be rasterized in parallel without synchronization.
+ */
+void OcclusionCuller::rasterizeTile(int tile) {
+    const int tileX0 = (tile % TILES_X) * TILE_WIDTH;
+    const int tileY0 = (tile / TILES_X) * TILE_HEIGHT;
+
+    for (int y = tileY0; y < tileY0 + TILE_HEIGHT; y++) {
+        std::fill_n(&m_depth[y * WIDTH + tileX0], TILE_WIDTH, 1.f);
+    }
+
+    for (uint32_t index : m_bins[tile]) {
+        const ScreenTriangle& t = m_triangles[index];
+
+        // Twice the signed area; flip back-facing triangles so every edge function is
+        // positive inside. Occluders block the view whichever way they face.
+        float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+        if (area == 0)
+            continue;
+        float sign = area > 0 ? 1.f : -1.f;
+
+        // Edge k runs from vertex k to vertex k+1: E(x, y) = a * x + b * y + c.
+        float ea[3], eb[3], ec[3];
+        for (int k = 0; k < 3; k++) {
+            int n = (k + 1) % 3;
+            ea[k] = -(t.y[n] - t.y[k]) * sign;
+            eb[k] = (t.x[n] - t.x[k]) * sign;
+            ec[k] = -(ea[k] * t.x[k] + eb[k] * t.y[k]);
+        }
+
+        // Depth is affine in screen space: z = z0 + dzdx * (x - x0) + dzdy * (y - y0).
+        float dzdx = ((t.z[1] - t.z[0]) * (t.y[2] - t.y[0]) - (t.z[2] - t.z[0]) * (t.y[1] - t.y[0])) / area;
+        float dzdy = ((t.z[2] - t.z[0]) * (t.x[1] - t.x[0]) - (t.z[1] - t.z[0]) * (t.x[2] - t.x[0])) / area;
+        float zc = t.z[0] - dzdx * t.x[0] - dzdy * t.y[0];
+
+        int minX = std::max(tileX0, static_cast<int>(std::floor(std::min({ t.x[0], t.x[1], t.x[2] }))));
+        int maxX = std::min(tileX0 + TILE_WIDTH - 1, static_cast<int>(std::ceil(std::max({ t.x[0], t.x[1], t.x[2] }))));
+        int minY = std::max(tileY0, static_cast<int>(std::floor(std::min({ t.y[0], t.y[1], t.y[2] }))));
+        int maxY = std::min(tileY0 + TILE_HEIGHT - 1, static_cast<int>(std::ceil(std::max({ t.y[0], t.y[1], t.y[2] }))));
+        if (minX > maxX || minY > maxY)
+            continue;
+        // Step in aligned groups of four; tiles are a multiple of four pixels wide.
+        minX &= ~3;
+
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float* row = &m_depth[y * WIDTH];
+#ifdef OCCLUSION_SSE
+            const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.f);
+            for (int x = minX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+
+                // Pixels exactly on an edge are left uncovered, so occluders never claim
+                // more of the screen than they really cover.
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int k = 0; k < 3; k++) {
+                    __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[k]), px),
+                        _mm_set1_ps(eb[k] * py + ec[k]));
+                    inside = _mm_and_ps(inside, _mm_cmpgt_ps(e, zero));
+                }
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy * py + zc));
+                z = _mm_min_ps(_mm_max_ps(z, zero), one);
+
+                __m128 depth = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(depth, z);
+                depth = _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, depth));
+                _mm_storeu_ps(row + x, depth);
+            }
+#else
+            for (int x = minX; x <= maxX; x++) {
+                float px = x + 0.5f;
+                bool inside = true;
+                for (int k = 0; k < 3; k++) {
+                    inside = inside && ea[k] * px + eb[k] * py + ec[k] > 0;
+                }
+                if (!inside)
+                    continue;
+
+                float z = std::min(std::max(dzdx * px + dzdy * py + zc, 0.f), 1.f);
+                row[x] = std::min(row[x], z);
+            }
+#endif
+        }
+    }
+
+    float maxDepth = 0.f;
+    for (int y = tileY0; y < tileY0 + TILE_HEIGHT; y++) {
+        const float* row = &m_depth[y * WIDTH + tileX0];
+        maxDepth = std::max(maxDepth, *std::max_element(row, row + TILE_WIDTH));
+    }
+    m_tileMaxDepth[tile] = maxDepth;
+}
+
+bool OcclusionCuller::isVisible(const AABB& worldBounds) const {
+    m_stats.testedBoxes++;
+
+    float minX = WIDTH, maxX = 0, minY = HEIGHT, maxY = 0, minZ = 1.f;
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner(
+            (i & 1) ? worldBounds.max.x : worldBounds.min.x,
+            (i & 2) ? worldBounds.max.y : worldBounds.min.y,
+            (i & 4) ? worldBounds.max.z : worldBounds.min.z);
+        glm::vec4 clip = m_viewProjection * glm::vec4(corner, 1.f);
+
+        // The box reaches past the near plane, so nothing can be in front of all of it.
+        if (clip.w <= 1e-5f || clip.z < -clip.w)
+            return true;
+
+        float invW = 1.f / clip.w;
+        float sx = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+        float sy = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+        minX = std::min(minX, sx);
+        maxX = std::max(maxX, sx);
+        minY = std::min(minY, sy);
+        maxY = std::max(maxY, sy);
+        minZ = std::min(minZ, clip.z * invW * 0.5f + 0.5f);
+    }
+
+    int x0 = std::max(0, static_cast<int>(std::floor(minX)));
+    int x1 = std::min(WIDTH - 1, static_cast<int>(std::ceil(maxX)));
+    int y0 = std::max(0, static_cast<int>(std::floor(minY)));
+    int y1 = std::min(HEIGHT - 1, static_cast<int>(std::ceil(maxY)));
+    // Off-screen boxes are the frustum culler's business, not ours.
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    for (int ty = y0 / TILE_HEIGHT; ty <= y1 / TILE_HEIGHT; ty++) {
+        for (int tx = x0 / TILE_WIDTH; tx <= x1 / TILE_WIDTH; tx++) {
+            // Every pixel in the tile is nearer than the box.
+            if (minZ > m_tileMaxDepth[ty * TILES_X + tx])
+                continue;
+
+            int px0 = std::max(x0, tx * TILE_WIDTH);
+            int px1 = std::min(x1, tx * TILE_WIDTH + TILE_WIDTH - 1);
+            int py0 = std::max(y0, ty * TILE_HEIGHT);
+            int py1 = std::min(y1, ty * TILE_HEIGHT + TILE_HEIGHT - 1);
+            for (int y = py0; y <= py1; y++) {
+                const float* row = &m_depth[y * WIDTH];
+                for (int x = px0; x <= px1; x++) {
+                    if (row[x] >= minZ)
+                        return true;
+                }
+            }
+        }
+    }
+
+    m_stats.occludedBoxes++;
+    return false;
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::getStats() const {
+    return m_stats;
+}
+
+const std::vector<float>& OcclusionCuller::getDepthBuffer() const {
+    return m_depth;
+}
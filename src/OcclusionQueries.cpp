@@ -0,0 +1,259 @@
+#include "OcclusionQueries.h"
+#include "GLState.h"
+
+// A unit cube centered at the origin, scaled and moved onto each object's bounds.
+static const float cubeVertices[] = {
+    -0.5f, -0.5f, -0.5f,
+     0.5f, -0.5f, -0.5f,
+     0.5f,  0.5f, -0.5f,
+    -0.5f,  0.5f, -0.5f,
+    -0.5f, -0.5f,  0.5f,
+     0.5f, -0.5f,  0.5f,
+     0.5f,  0.5f,  0.5f,
+    -0.5f,  0.5f,  0.5f,
+};
+
+static const uint32_t cubeIndices[] = {
+    0, 2, 1, 0, 3, 2, // back
+    4, 5, 6, 4, 6, 7, // front
+    0, 4, 7, 0, 7, 3, // left
+    1, 2, 6, 1, 6, 5, // right
+    0, 1, 5, 0, 5, 4, // bottom
+    3, 7, 6, 3, 6, 2, // top
+};
+
+OcclusionQueries::OcclusionQueries(ShaderProgram proxyProgram, Mode mode)
+    : m_proxyProgram(proxyProgram), m_mode(mode) {
+    glGenVertexArrays(1, &m_cubeVao);
+    GLState::shared().bindVertexArray(m_cubeVao);
+
+    glGenBuffers(1, &m_cubeVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_cubeVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, false, 3 * sizeof(float), 0);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &m_cubeEbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_cubeEbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+}
+
+OcclusionQueries::~OcclusionQueries() {
+    for (auto& slot : m_slots) {
+        for (auto& q : slot.queries) {
+            glDeleteQueries(1, &q.query);
+        }
+    }
+    glDeleteBuffers(1, &m_cubeEbo);
+    glDeleteBuffers(1, &m_cubeVbo);
+    GLState::shared().deleteVertexArray(m_cubeVao);
+}
+
+void OcclusionQueries::setMode(Mode mode) {
+    if (mode == m_mode)
+        return;
+
+    m_mode = mode;
+    for (auto& slot : m_slots) {
+        for (auto& q : slot.queries) {
+            q.pending = false;
+            q.visible = true;
+        }
+    }
+}
+
+OcclusionQueries::Mode OcclusionQueries::getMode() const {
+    return m_mode;
+}
+
+void OcclusionQueries::drawProxy(const AABB& bounds) {
+    glm::mat4 model = glm::translate(glm::mat4(1), bounds.center());
+    model = glm::scale(model, bounds.max - bounds.min);
+    m_proxyProgram.setUniform("model", model);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+}
+
+void OcclusionQueries::collectUnits(const Object3D& object, const glm::mat4& parentMatrix, uint32_t slot) {
+    bool hasHeavyChild = false;
+    for (size_t i = 0; i < object.numberOfChildren(); i++) {
+        if (object.getChild(i).getSubtreeTriangles() >= HEAVY_TRIANGLES) {
+            hasHeavyChild = true;
+            break;
+        }
+    }
+    if (!hasHeavyChild) {
+        m_units.push_back({ &object, parentMatrix, object.getWorldBounds(parentMatrix), false, slot, 0 });
+        return;
+    }
+
+    // The object's own meshes and light children make one unit, and each heavy child its own.
+    glm::mat4 model = object.getModelMatrix(parentMatrix);
+    AABB rest = object.getLocalBounds().transformed(model);
+    for (size_t i = 0; i < object.numberOfChildren(); i++) {
+        const Object3D& child = object.getChild(i);
+        if (child.getSubtreeTriangles() < HEAVY_TRIANGLES) {
+            rest.expand(child.getWorldBounds(model));
+        }
+    }
+    if (!rest.isEmpty()) {
+        m_units.push_back({ &object, parentMatrix, rest, true, slot, 0 });
+    }
+    for (size_t i = 0; i < object.numberOfChildren(); i++) {
+        const Object3D& child = object.getChild(i);
+        if (child.getSubtreeTriangles() >= HEAVY_TRIANGLES) {
+            collectUnits(child, model, slot);
+        }
+    }
+}
+
+void OcclusionQueries::renderUnit(const Unit& unit, ShaderProgram& program, const Frustum& frustum,
+    CullStats& stats) {
+    m_queue.begin(glm::mat4(1));
+    if (unit.split) {
+        glm::mat4 model = unit.object->getModelMatrix(unit.parentMatrix);
+        unit.object->renderMeshes(m_queue, program, model, stats);
+        for (size_t i = 0; i < unit.object->numberOfChildren(); i++) {
+            const Object3D& child = unit.object->getChild(i);
+            if (child.getSubtreeTriangles() < HEAVY_TRIANGLES) {
+                child.renderRecursive(m_queue, program, model, frustum, stats, nullptr, false);
+            }
+        }
+    }
+    else {
+        unit.object->renderRecursive(m_queue, program, unit.parentMatrix, frustum, stats, nullptr, false);
+    }
+    RenderQueueStats queueStats;
+    m_queue.submit(queueStats);
+}
+
+void OcclusionQueries::render(const ObjectPool& objects, ShaderProgram& program, const Frustum& frustum,
+    CullStats& stats, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition) {
+    if (m_slots.size() < objects.capacity()) {
+        m_slots.resize(objects.capacity());
+    }
+
+    // Occluders go first, so their depth is in place before any proxy is tested.
+    for (auto& o : objects) {
+        if (o.isOccluder()) {
+            o.render(program, frustum, stats);
+        }
+    }
+
+    // Split the other objects into units, each with a query of its slot.
+    m_units.clear();
+    for (auto it = objects.begin(); it != objects.end(); ++it) {
+        const Object3D& o = *it;
+        if (!o.getDisplay() || o.isOccluder())
+            continue;
+
+        ObjectHandle handle = it.handle();
+        size_t first = m_units.size();
+        collectUnits(o, glm::mat4(1), handle.index);
+        uint32_t units = static_cast<uint32_t>(m_units.size() - first);
+
+        // Forget the answers of a destroyed object whose slot now holds another, or of an
+        // object whose hierarchy changed how it splits.
+        SlotQueries& slot = m_slots[handle.index];
+        if (slot.generation != handle.generation || slot.units != units) {
+            slot.generation = handle.generation;
+            slot.units = units;
+            for (auto& q : slot.queries) {
+                q.pending = false;
+                q.visible = true;
+            }
+        }
+        while (slot.queries.size() < units) {
+            UnitQuery q;
+            glGenQueries(1, &q.query);
+            slot.queries.push_back(q);
+        }
+        for (uint32_t i = 0; i < units; i++) {
+            m_units[first + i].query = i;
+        }
+    }
+
+    // Collect answers that have arrived since last frame.
+    if (m_mode == Mode::LastFrame) {
+        for (auto& slot : m_slots) {
+            for (auto& q : slot.queries) {
+                if (!q.pending)
+                    continue;
+
+                GLint available = 0;
+                glGetQueryObjectiv(q.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available) {
+                    GLuint anySamples = 0;
+                    glGetQueryObjectuiv(q.query, GL_QUERY_RESULT, &anySamples);
+                    q.visible = anySamples != 0;
+                    q.pending = false;
+                }
+            }
+        }
+    }
+
+    // Draw the proxies without touching the color or depth buffers. Back faces are kept,
+    // so a box whose front faces are clipped away still registers.
+    m_proxyProgram.activate();
+    m_proxyProgram.setUniform("view", view);
+    m_proxyProgram.setUniform("projection", projection);
+    GLState& state = GLState::shared();
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    state.depthMask(false);
+    state.disable(GL_CULL_FACE);
+    state.bindVertexArray(m_cubeVao);
+
+    for (auto& unit : m_units) {
+        UnitQuery& q = m_slots[unit.slot].queries[unit.query];
+        q.issued = false;
+
+        // Off-screen units are drawn as soon as they come back, rather than trusting an
+        // answer from whenever they were last on screen.
+        if (frustum.test(unit.bounds) == Frustum::Result::Outside) {
+            q.visible = true;
+            continue;
+        }
+
+        // A camera inside the box (or close enough for the near plane to cut it) sees the
+        // unit no matter what the query says.
+        AABB padded(unit.bounds.min - glm::vec3(0.5f), unit.bounds.max + glm::vec3(0.5f));
+        if (padded.contains(cameraPosition)) {
+            q.pending = false;
+            q.visible = true;
+            continue;
+        }
+
+        if (m_mode == Mode::LastFrame && q.pending)
+            continue;
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, q.query);
+        drawProxy(unit.bounds);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        q.issued = true;
+        q.pending = m_mode == Mode::LastFrame;
+    }
+
+    state.enable(GL_CULL_FACE);
+    state.depthMask(true);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // Draw everything else, letting the query answers skip hidden units.
+    program.activate();
+    for (auto& unit : m_units) {
+        const UnitQuery& q = m_slots[unit.slot].queries[unit.query];
+        if (m_mode == Mode::LastFrame) {
+            if (!q.visible) {
+                stats.occludedSubtrees++;
+                continue;
+            }
+            renderUnit(unit, program, frustum, stats);
+        }
+        else if (q.issued) {
+            glBeginConditionalRender(q.query, GL_QUERY_NO_WAIT);
+            renderUnit(unit, program, frustum, stats);
+            glEndConditionalRender();
+        }
+        else {
+            renderUnit(unit, program, frustum, stats);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#include "PhysicsBody.h"
+
+inline float signOf(float x) {
+    return (x > 0 ? 1 : (x < 0 ? -1 : 0));
+}
+
+void PhysicsBody::step(glm::vec3& position, glm::vec3& orientation, float dt) {
+    const float friction = 1.25f;
+    const float weight = 4.0f;
+    const float gravity = 9.81f;
+    const float deceleration = 2.f; // natural deceleration of movement.
+    const float rubber = 0.5f; // how much velocity is retained during collision
+
+    position += velocity * dt;
+    velocity += acceleration * dt;
+
+    orientation += rotVelocity * dt;
+    rotVelocity += rotAcceleration * dt;
+
+    // gravity when not accelerating upwards
+    if (gravityAffected) {
+        if (position.y > 0.0 and acceleration.y <= 0.0) {
+            velocity.y += -(weight + gravity) * dt;
+        }
+    }
+
+    // collision with ground.
+    if (position.y < 0.0) {
+        position.y = 0.0;
+        velocity.y = -(velocity.y * rubber);
+    }
+
+    // decelerate velocity over time when not accelerating.
+    if (not acceleration.x and velocity.x) {
+        velocity.x -= deceleration * friction * dt * signOf(velocity.x);
+    }
+    if (not acceleration.y and velocity.y) {
+        velocity.y -= deceleration * friction * dt * signOf(velocity.y);
+    }
+    if (not acceleration.z and velocity.z) {
+        velocity.z -= deceleration * friction * dt * signOf(velocity.z);
+    }
+}
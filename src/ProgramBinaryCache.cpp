@@ -0,0 +1,169 @@
+#include "ProgramBinaryCache.h"
+#include "GLState.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <glad/glad.h>
+
+namespace {
+    constexpr char MAGIC[4] = { 'G', 'P', 'P', 'B' };
+
+    // 64-bit FNV-1a, continued from the given hash.
+    uint64_t fnv1a(std::string_view data, uint64_t hash = 0xcbf29ce484222325ull) {
+        for (char c : data) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    std::string glString(GLenum name) {
+        const GLubyte* value = glGetString(name);
+        return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+    }
+}
+
+ProgramBinaryCache& ProgramBinaryCache::shared() {
+    static ProgramBinaryCache cache("shader_cache");
+    return cache;
+}
+
+ProgramBinaryCache::ProgramBinaryCache(std::filesystem::path directory)
+    : m_directory(std::move(directory)) {
+}
+
+void ProgramBinaryCache::loadEntryPoints(void* (*getFunction)(const char* name)) {
+    // The extension's functions have the core names, so glad's pointers take them as they are.
+    if (glGetProgramBinary == nullptr) {
+        glGetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>(getFunction("glGetProgramBinary"));
+        glProgramBinary = reinterpret_cast<PFNGLPROGRAMBINARYPROC>(getFunction("glProgramBinary"));
+        glProgramParameteri = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>(getFunction("glProgramParameteri"));
+    }
+}
+
+bool ProgramBinaryCache::isAvailable() {
+    if (!m_checked) {
+        m_checked = true;
+        // Below 4.1, the calls come from GL_ARB_get_program_binary, and glad leaves them null
+        // unless loadEntryPoints() found them. A driver may support the calls but no binary
+        // formats at all.
+        bool supported = GLAD_GL_VERSION_4_1 || GLState::hasExtension("GL_ARB_get_program_binary");
+        supported = supported && glGetProgramBinary != nullptr && glProgramBinary != nullptr
+            && glProgramParameteri != nullptr;
+        GLint formats = 0;
+        if (supported) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        m_available = formats > 0;
+        m_driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+    }
+    return m_available;
+}
+
+uint64_t ProgramBinaryCache::key(std::string_view vertexSource, std::string_view fragmentSource,
+    std::string_view defines) {
+    isAvailable();
+    // Separators keep text from moving between the parts without changing the key.
+    uint64_t hash = fnv1a(m_driver);
+    hash = fnv1a(std::string_view("\0", 1), hash);
+    hash = fnv1a(defines, hash);
+    hash = fnv1a(std::string_view("\0", 1), hash);
+    hash = fnv1a(vertexSource, hash);
+    hash = fnv1a(std::string_view("\0", 1), hash);
+    return fnv1a(fragmentSource, hash);
+}
+
+uint32_t ProgramBinaryCache::load(uint64_t key) {
+    if (!isAvailable()) {
+        m_stats.misses++;
+        return 0;
+    }
+
+    std::filesystem::path path = pathOf(key);
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    std::ifstream in(path, std::ios::binary);
+    if (ec || !in) {
+        m_stats.misses++;
+        return 0;
+    }
+    ProgramBinaryHeader header{};
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    std::vector<char> binary;
+    if (in && std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == PROGRAM_BINARY_VERSION
+        && header.key == key && header.length == size - sizeof(header)) {
+        binary.resize(header.length);
+        in.read(binary.data(), header.length);
+    }
+    in.close();
+    if (binary.empty() || !in) {
+        // Written by another version, or damaged.
+        std::filesystem::remove(path, ec);
+        m_stats.misses++;
+        return 0;
+    }
+
+    uint32_t program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        std::filesystem::remove(path, ec);
+        m_stats.rejected++;
+        m_stats.misses++;
+        return 0;
+    }
+    m_stats.hits++;
+    return program;
+}
+
+void ProgramBinaryCache::prepare(uint32_t program) {
+    if (isAvailable()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+void ProgramBinaryCache::store(uint64_t key, uint32_t program) {
+    if (!isAvailable())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    ProgramBinaryHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = PROGRAM_BINARY_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = static_cast<uint32_t>(length);
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+    std::filesystem::path path = pathOf(key);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(binary.data(), length);
+    if (!out) {
+        std::cerr << "Could not cache the program binary at " << path.string() << std::endl;
+        return;
+    }
+    m_stats.stored++;
+}
+
+const ProgramCacheStats& ProgramBinaryCache::stats() const {
+    return m_stats;
+}
+
+std::filesystem::path ProgramBinaryCache::pathOf(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.progbin", static_cast<unsigned long long>(key));
+    return m_directory / name;
+}
@@ -0,0 +1,445 @@
+#include "Raycast.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAYCAST_SSE 1
+#include <emmintrin.h>
+#endif
+
+static_assert(sizeof(BVHNode) == 32, "BVH nodes should pack into 32 bytes");
+
+// SAH build parameters. Costs are relative to one ray-triangle (or ray-instance) test.
+static const int SAH_BINS = 16;
+static const float TRAVERSAL_COST = 1.f;
+static const uint32_t MAX_LEAF_SIZE = 8;
+// Traversal keeps a fixed-size stack, so the tree may not be deeper than this.
+static const int MAX_DEPTH = 64;
+
+static float surfaceArea(const AABB& box) {
+    if (box.isEmpty())
+        return 0.f;
+    glm::vec3 d = box.max - box.min;
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+void BVH::build(const std::vector<AABB>& primitiveBounds) {
+    uint32_t count = static_cast<uint32_t>(primitiveBounds.size());
+    m_nodes.clear();
+    m_primitives.resize(count);
+    std::iota(m_primitives.begin(), m_primitives.end(), 0);
+    if (count == 0)
+        return;
+
+    std::vector<glm::vec3> centroids(count);
+    for (uint32_t i = 0; i < count; i++) {
+        centroids[i] = primitiveBounds[i].center();
+    }
+
+    m_nodes.reserve(2 * count);
+    m_nodes.push_back({ glm::vec3(0), 0, glm::vec3(0), count });
+
+    // Split nodes depth-first with an explicit stack of (node, depth).
+    std::vector<std::pair<uint32_t, int>> pending{ { 0, 0 } };
+    while (!pending.empty()) {
+        auto [nodeIndex, depth] = pending.back();
+        pending.pop_back();
+
+        uint32_t first = m_nodes[nodeIndex].first;
+        uint32_t n = m_nodes[nodeIndex].count;
+        AABB bounds, centroidBounds;
+        for (uint32_t i = first; i < first + n; i++) {
+            bounds.expand(primitiveBounds[m_primitives[i]]);
+            centroidBounds.expand(centroids[m_primitives[i]]);
+        }
+        m_nodes[nodeIndex].min = bounds.min;
+        m_nodes[nodeIndex].max = bounds.max;
+
+        if (n <= 2 || depth >= MAX_DEPTH - 1)
+            continue;
+
+        // Bin the centroids along each axis, and find the cheapest split between bins.
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = centroidBounds.min[axis];
+            float extent = centroidBounds.max[axis] - lo;
+            if (extent <= 0.f)
+                continue;
+
+            AABB binBounds[SAH_BINS];
+            uint32_t binCounts[SAH_BINS] = {};
+            float scale = SAH_BINS / extent;
+            for (uint32_t i = first; i < first + n; i++) {
+                uint32_t p = m_primitives[i];
+                int bin = std::min(SAH_BINS - 1, static_cast<int>((centroids[p][axis] - lo) * scale));
+                binBounds[bin].expand(primitiveBounds[p]);
+                binCounts[bin]++;
+            }
+
+            // Sweep from the right to get the cost of every right side, then from the left.
+            float rightCost[SAH_BINS];
+            AABB right;
+            uint32_t rightCount = 0;
+            for (int b = SAH_BINS - 1; b > 0; b--) {
+                right.expand(binBounds[b]);
+                rightCount += binCounts[b];
+                rightCost[b] = surfaceArea(right) * rightCount;
+            }
+            AABB left;
+            uint32_t leftCount = 0;
+            for (int b = 0; b < SAH_BINS - 1; b++) {
+                left.expand(binBounds[b]);
+                leftCount += binCounts[b];
+                float cost = surfaceArea(left) * leftCount + rightCost[b + 1];
+                if (leftCount > 0 && leftCount < n && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b + 1;
+                }
+            }
+        }
+
+        // Every centroid is in the same place; there is nothing to split.
+        if (bestAxis < 0)
+            continue;
+
+        float leafCost = static_cast<float>(n);
+        float splitCost = TRAVERSAL_COST + bestCost / surfaceArea(bounds);
+        if (splitCost >= leafCost && n <= MAX_LEAF_SIZE)
+            continue;
+
+        float lo = centroidBounds.min[bestAxis];
+        float scale = SAH_BINS / (centroidBounds.max[bestAxis] - lo);
+        auto middle = std::partition(m_primitives.begin() + first, m_primitives.begin() + first + n,
+            [&](uint32_t p) {
+                int bin = std::min(SAH_BINS - 1, static_cast<int>((centroids[p][bestAxis] - lo) * scale));
+                return bin < bestSplit;
+            });
+        uint32_t leftCount = static_cast<uint32_t>(middle - m_primitives.begin()) - first;
+
+        uint32_t leftIndex = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.push_back({ glm::vec3(0), first, glm::vec3(0), leftCount });
+        m_nodes.push_back({ glm::vec3(0), first + leftCount, glm::vec3(0), n - leftCount });
+        m_nodes[nodeIndex].first = leftIndex;
+        m_nodes[nodeIndex].count = 0;
+
+        pending.push_back({ leftIndex + 1, depth + 1 });
+        pending.push_back({ leftIndex, depth + 1 });
+    }
+}
+
+const std::vector<BVHNode>& BVH::getNodes() const {
+    return m_nodes;
+}
+
+const std::vector<uint32_t>& BVH::getPrimitives() const {
+    return m_primitives;
+}
+
+namespace {
+    /**
+     * @brief A ray with its reciprocal direction precomputed for the slab test.
+     */
+    struct Ray {
+        glm::vec3 origin;
+        glm::vec3 direction;
+        glm::vec3 invDirection;
+#ifdef RAYCAST_SSE
+        __m128 origin4;
+        __m128 invDirection4;
+#endif
+
+        Ray(const glm::vec3& o, const glm::vec3& d)
+            : origin(o), direction(d), invDirection(1.f / d.x, 1.f / d.y, 1.f / d.z) {
+#ifdef RAYCAST_SSE
+            origin4 = _mm_setr_ps(origin.x, origin.y, origin.z, 0.f);
+            invDirection4 = _mm_setr_ps(invDirection.x, invDirection.y, invDirection.z, 0.f);
+#endif
+        }
+    };
+
+    const float NO_HIT = std::numeric_limits<float>::infinity();
+
+    /**
+     * @brief The distance at which the ray enters the node's box, or NO_HIT if it misses the
+     * box or only reaches it past maxT.
+     */
+    inline float enterNode(const Ray& ray, const BVHNode& node, float maxT) {
+#ifdef RAYCAST_SSE
+        // The fourth lane holds first/count; only the first three are reduced.
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&node.min.x), ray.origin4), ray.invDirection4);
+        __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&node.max.x), ray.origin4), ray.invDirection4);
+        __m128 tNear = _mm_min_ps(t1, t2);
+        __m128 tFar = _mm_max_ps(t1, t2);
+        tNear = _mm_max_ss(_mm_max_ss(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 1, 1, 1))),
+            _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 2, 2, 2)));
+        tFar = _mm_min_ss(_mm_min_ss(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 1, 1, 1))),
+            _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 2, 2, 2)));
+        float enter = std::max(_mm_cvtss_f32(tNear), 0.f);
+        float exit = _mm_cvtss_f32(tFar);
+#else
+        glm::vec3 t1 = (node.min - ray.origin) * ray.invDirection;
+        glm::vec3 t2 = (node.max - ray.origin) * ray.invDirection;
+        glm::vec3 tNear = glm::min(t1, t2);
+        glm::vec3 tFar = glm::max(t1, t2);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+        float exit = std::min(tFar.x, std::min(tFar.y, tFar.z));
+#endif
+        return enter <= exit && enter < maxT ? enter : NO_HIT;
+    }
+
+    /**
+     * @brief Walks the nodes that the ray enters before maxT, nearest child first, calling
+     * visitLeaf(first, count) for each leaf. visitLeaf may lower maxT when it finds a hit, and
+     * returns true to stop the walk.
+     */
+    template <typename LeafVisitor>
+    void traverse(const std::vector<BVHNode>& nodes, const Ray& ray, float& maxT, LeafVisitor&& visitLeaf) {
+        if (nodes.empty() || enterNode(ray, nodes[0], maxT) == NO_HIT)
+            return;
+
+        struct Entry {
+            uint32_t node;
+            float enter;
+        };
+        Entry stack[MAX_DEPTH];
+        int top = 0;
+        uint32_t index = 0;
+        while (true) {
+            const BVHNode& node = nodes[index];
+            if (node.count > 0) {
+                if (visitLeaf(node.first, node.count))
+                    return;
+            }
+            else {
+                uint32_t nearIndex = node.first;
+                uint32_t farIndex = node.first + 1;
+                float nearT = enterNode(ray, nodes[nearIndex], maxT);
+                float farT = enterNode(ray, nodes[farIndex], maxT);
+                if (farT < nearT) {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(nearT, farT);
+                }
+                if (nearT != NO_HIT) {
+                    if (farT != NO_HIT) {
+                        stack[top++] = { farIndex, farT };
+                    }
+                    index = nearIndex;
+                    continue;
+                }
+            }
+
+            // Pop the next subtree, skipping any that a hit has since put out of reach.
+            do {
+                if (top == 0)
+                    return;
+                top--;
+            } while (stack[top].enter >= maxT);
+            index = stack[top].node;
+        }
+    }
+}
+
+/**
+ * @brief A BVH over one mesh's triangles, in the mesh's local space. The triangles are copied
+ * in tree order, as a vertex and two edges each, so a leaf's triangles are contiguous.
+ */
+class MeshBVH {
+public:
+    explicit MeshBVH(const MeshGeometry& geometry) {
+        size_t triangles = geometry.indices.size() / 3;
+        std::vector<AABB> bounds(triangles);
+        for (size_t t = 0; t < triangles; t++) {
+            for (int k = 0; k < 3; k++) {
+                bounds[t].expand(geometry.positions[geometry.indices[3 * t + k]]);
+            }
+        }
+        m_bvh.build(bounds);
+
+        auto& order = m_bvh.getPrimitives();
+        m_triangles.reserve(triangles);
+        for (uint32_t t : order) {
+            const glm::vec3& a = geometry.positions[geometry.indices[3 * t]];
+            const glm::vec3& b = geometry.positions[geometry.indices[3 * t + 1]];
+            const glm::vec3& c = geometry.positions[geometry.indices[3 * t + 2]];
+            m_triangles.push_back({ a, b - a, c - a });
+        }
+    }
+
+    size_t triangleCount() const {
+        return m_triangles.size();
+    }
+
+    /**
+     * @brief Finds the nearest triangle between minT and maxT (lowering maxT), writing the
+     * triangle and barycentrics to hit. With anyHit, stops at the first triangle found instead.
+     */
+    bool intersect(const Ray& ray, float minT, float& maxT, RayHit& hit, bool anyHit) const {
+        bool found = false;
+        traverse(m_bvh.getNodes(), ray, maxT, [&](uint32_t first, uint32_t count) {
+            for (uint32_t i = first; i < first + count; i++) {
+                // Moller-Trumbore, two-sided.
+                const Triangle& tri = m_triangles[i];
+                glm::vec3 p = glm::cross(ray.direction, tri.edge2);
+                float det = glm::dot(tri.edge1, p);
+                if (det == 0.f)
+                    continue;
+                float invDet = 1.f / det;
+                glm::vec3 s = ray.origin - tri.vertex;
+                float u = glm::dot(s, p) * invDet;
+                if (u < 0.f || u > 1.f)
+                    continue;
+                glm::vec3 q = glm::cross(s, tri.edge1);
+                float v = glm::dot(ray.direction, q) * invDet;
+                if (v < 0.f || u + v > 1.f)
+                    continue;
+                float t = glm::dot(tri.edge2, q) * invDet;
+                if (t < minT || t >= maxT)
+                    continue;
+
+                maxT = t;
+                hit.triangle = m_bvh.getPrimitives()[i];
+                hit.barycentric = glm::vec2(u, v);
+                found = true;
+                if (anyHit)
+                    return true;
+            }
+            return false;
+        });
+        return found;
+    }
+
+private:
+    struct Triangle {
+        glm::vec3 vertex;
+        glm::vec3 edge1;
+        glm::vec3 edge2;
+    };
+
+    BVH m_bvh;
+    std::vector<Triangle> m_triangles;
+};
+
+Raycaster::Raycaster(ThreadPool& pool)
+    : m_pool(pool) {
+}
+
+Raycaster::~Raycaster() = default;
+
+void Raycaster::build(const ObjectPool& objects) {
+    m_instances.clear();
+    m_triangleCount = 0;
+
+    // Gather the instances, and the geometry that has no BVH yet.
+    std::vector<AABB> instanceBounds;
+    std::vector<CachedBVH*> unbuilt;
+    std::vector<const MeshGeometry*> instanceGeometry;
+    for (auto it = objects.begin(); it != objects.end(); ++it) {
+        ObjectHandle handle = it.handle();
+        uint32_t meshIndex = 0;
+        it->forEachMesh([&](const MeshHandle& mesh, const glm::mat4& model) {
+            uint32_t index = meshIndex++;
+            auto geometry = mesh->getSharedGeometry();
+            if (!geometry)
+                return;
+
+            auto& cached = m_meshBVHs[geometry.get()];
+            if (!cached.geometry) {
+                cached.geometry = geometry;
+                unbuilt.push_back(&cached);
+            }
+            m_instances.push_back({ glm::inverse(model), nullptr, handle, index });
+            instanceGeometry.push_back(geometry.get());
+            instanceBounds.push_back(mesh->getBounds().transformed(model));
+        });
+    }
+
+    m_pool.parallelFor(unbuilt.size(), [&](size_t i) {
+        unbuilt[i]->bvh = std::make_unique<MeshBVH>(*unbuilt[i]->geometry);
+    });
+
+    for (size_t i = 0; i < m_instances.size(); i++) {
+        m_instances[i].bvh = m_meshBVHs[instanceGeometry[i]].bvh.get();
+        m_triangleCount += m_instances[i].bvh->triangleCount();
+    }
+    m_topLevel.build(instanceBounds);
+
+    // Forget the BVHs of meshes that no longer exist anywhere else.
+    for (auto it = m_meshBVHs.begin(); it != m_meshBVHs.end();) {
+        if (it->second.geometry.use_count() == 1) {
+            it = m_meshBVHs.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+RayHit Raycaster::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const {
+    RayHit result;
+    float length = glm::length(direction);
+    if (length == 0.f)
+        return result;
+
+    glm::vec3 dir = direction / length;
+    Ray ray(origin, dir);
+    float maxT = maxDistance;
+    auto& order = m_topLevel.getPrimitives();
+    traverse(m_topLevel.getNodes(), ray, maxT, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            const Instance& instance = m_instances[order[i]];
+            // The direction is not renormalized in local space, so local t is world distance.
+            Ray local(glm::vec3(instance.worldToLocal * glm::vec4(origin, 1.f)),
+                glm::vec3(instance.worldToLocal * glm::vec4(dir, 0.f)));
+            if (instance.bvh->intersect(local, 0.f, maxT, result, false)) {
+                result.hit = true;
+                result.object = instance.object;
+                result.mesh = instance.mesh;
+            }
+        }
+        return false;
+    });
+
+    if (result.hit) {
+        result.distance = maxT;
+        result.point = origin + dir * maxT;
+    }
+    return result;
+}
+
+bool Raycaster::lineOfSight(const glm::vec3& from, const glm::vec3& to) const {
+    glm::vec3 dir = to - from;
+    // Triangles at the very ends (e.g., the surfaces being tested from and to) don't block.
+    const float epsilon = 1e-4f;
+    float maxT = 1.f - epsilon;
+    Ray ray(from, dir);
+    bool blocked = false;
+    RayHit scratch;
+    auto& order = m_topLevel.getPrimitives();
+    traverse(m_topLevel.getNodes(), ray, maxT, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            const Instance& instance = m_instances[order[i]];
+            Ray local(glm::vec3(instance.worldToLocal * glm::vec4(from, 1.f)),
+                glm::vec3(instance.worldToLocal * glm::vec4(dir, 0.f)));
+            float t = maxT;
+            if (instance.bvh->intersect(local, epsilon, t, scratch, true)) {
+                blocked = true;
+                return true;
+            }
+        }
+        return false;
+    });
+    return !blocked;
+}
+
+size_t Raycaster::instanceCount() const {
+    return m_instances.size();
+}
+
+size_t Raycaster::triangleCount() const {
+    return m_triangleCount;
+}
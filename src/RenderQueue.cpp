@@ -0,0 +1,420 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstring>
+#include <glad/glad.h>
+#include "GLState.h"
+
+namespace {
+    constexpr uint32_t PASS_BITS = 2;
+    constexpr uint32_t SHADER_BITS = 6;
+    constexpr uint32_t TEXTURE_BITS = 14;
+    constexpr uint32_t MESH_BITS = 16;
+    constexpr uint32_t DEPTH_BITS = 26;
+    static_assert(PASS_BITS + SHADER_BITS + TEXTURE_BITS + MESH_BITS + DEPTH_BITS == 64, "sort keys fill 64 bits");
+
+    constexpr uint64_t mask(uint32_t bits) {
+        return (uint64_t(1) << bits) - 1;
+    }
+
+    // The bits of a non-negative float order the same way as its value, so the top bits of
+    // the distance make a depth key without having to know the far plane.
+    uint64_t quantizeDepth(float depth) {
+        depth = std::max(depth, 0.f);
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> (32 - DEPTH_BITS);
+    }
+
+    constexpr uint32_t UNKNOWN = UINT32_MAX;
+
+    // Room for this many draws per frame before the draw data buffer has to grow.
+    constexpr size_t INITIAL_DRAW_DATA = 1024;
+}
+
+RenderQueue::RenderQueue(bool streamDrawData)
+    : m_streamDrawData(streamDrawData) {
+}
+
+void RenderQueue::begin(const glm::mat4& view) {
+    // A frame that left a pass undrawn has not fenced its sections yet.
+    fenceDrawData();
+    m_view = view;
+    m_packets.clear();
+    m_sorted = false;
+}
+
+void RenderQueue::replaceOpaqueProgram(const ShaderProgram& program, ShaderProgram* replacement) {
+    m_replacedProgram = program;
+    m_opaqueReplacement = replacement;
+}
+
+void RenderQueue::addVariants(ShaderVariants& variants) {
+    if (std::find(m_variants.begin(), m_variants.end(), &variants) == m_variants.end()) {
+        m_variants.push_back(&variants);
+    }
+}
+
+void RenderQueue::removeVariants(ShaderVariants& variants) {
+    m_variants.erase(std::remove(m_variants.begin(), m_variants.end(), &variants), m_variants.end());
+}
+
+void RenderQueue::push(const Mesh3D& mesh, ShaderProgram& program, const glm::mat4& model, float shininess,
+    RenderPass pass) {
+    // The distance along the view direction to the center of the mesh's bounds.
+    glm::vec4 center = m_view * model * glm::vec4(mesh.getBoundingSphere().center, 1.f);
+    uint64_t depth = quantizeDepth(-center.z);
+
+    const MeshIds& ids = meshIds(mesh);
+    ShaderProgram* drawProgram = &program;
+    if (pass == RenderPass::Opaque && m_opaqueReplacement != nullptr && program == m_replacedProgram) {
+        drawProgram = m_opaqueReplacement;
+    }
+    for (ShaderVariants* variants : m_variants) {
+        if (variants->program() == *drawProgram) {
+            // The full program is drawn as pushed, so it keeps a single program id.
+            ShaderProgram& variant = variants->select(ids.features);
+            if (!(variant == *drawProgram)) {
+                drawProgram = &variant;
+            }
+            break;
+        }
+    }
+    uint64_t shader = programInfo(*drawProgram).id & mask(SHADER_BITS);
+    uint64_t textures = ids.textures & mask(TEXTURE_BITS);
+    uint64_t meshId = ids.mesh & mask(MESH_BITS);
+
+    uint64_t key = uint64_t(pass) << (64 - PASS_BITS);
+    if (pass == RenderPass::Opaque) {
+        key |= shader << (TEXTURE_BITS + MESH_BITS + DEPTH_BITS);
+        key |= textures << (MESH_BITS + DEPTH_BITS);
+        key |= meshId << DEPTH_BITS;
+        key |= depth;
+    }
+    else {
+        // Inverting the depth sorts the farthest meshes first.
+        key |= (~depth & mask(DEPTH_BITS)) << (SHADER_BITS + TEXTURE_BITS + MESH_BITS);
+        key |= shader << (TEXTURE_BITS + MESH_BITS);
+        key |= textures << MESH_BITS;
+        key |= meshId;
+    }
+
+    m_packets.push_back({ key, &mesh, drawProgram, model, shininess });
+    m_sorted = false;
+}
+
+void RenderQueue::submit(RenderQueueStats& stats) {
+    sort();
+    draw(stats, 0, static_cast<uint32_t>(m_order.size()));
+}
+
+void RenderQueue::submit(RenderQueueStats& stats, RenderPass pass) {
+    sort();
+    // Passes are the most significant bits of the keys, so each is one run of the order.
+    auto passOf = [](const SortEntry& entry) {
+        return entry.key >> (64 - PASS_BITS);
+    };
+    auto first = std::partition_point(m_order.begin(), m_order.end(),
+        [&](const SortEntry& entry) { return passOf(entry) < uint64_t(pass); });
+    auto end = std::partition_point(first, m_order.end(),
+        [&](const SortEntry& entry) { return passOf(entry) == uint64_t(pass); });
+    draw(stats, static_cast<uint32_t>(first - m_order.begin()), static_cast<uint32_t>(end - m_order.begin()));
+}
+
+void RenderQueue::sort() {
+    if (m_sorted)
+        return;
+    // Packets pushed after a pass was drawn change the order, so the draw data is written again.
+    fenceDrawData();
+    m_written = false;
+    m_drawnPackets = 0;
+    m_order.resize(m_packets.size());
+    for (uint32_t i = 0; i < m_packets.size(); i++) {
+        m_order[i] = { m_packets[i].key, i };
+    }
+    radixSort();
+    m_sorted = true;
+}
+
+void RenderQueue::writeDrawData() {
+    uint32_t count = static_cast<uint32_t>(m_order.size());
+
+    // Every sorted packet's model matrix and material go into a fresh section of the draw data
+    // buffer, in sort order, so packet i of the order reads record m_firstRecord + i. All the
+    // passes draw from the one section.
+    if (!m_drawData) {
+        m_drawData = std::make_unique<RingBuffer>(GL_ARRAY_BUFFER, INITIAL_DRAW_DATA * sizeof(InstanceData));
+    }
+    auto* records = static_cast<InstanceData*>(m_drawData->beginWrite(count * sizeof(InstanceData)));
+    for (uint32_t i = 0; i < count; i++) {
+        const DrawPacket& packet = m_packets[m_order[i].packet];
+        records[i] = { packet.model, glm::vec4(1.f, 1.f, 1.f, packet.shininess) };
+    }
+    m_firstRecord = static_cast<uint32_t>(m_drawData->endWrite() / sizeof(InstanceData));
+
+    // An indirect command per packet too, so that any run of packets can be drawn at once.
+    m_wroteCommands = GLAD_GL_VERSION_4_3;
+    if (m_wroteCommands) {
+        if (!m_commands) {
+            m_commands = std::make_unique<RingBuffer>(GL_DRAW_INDIRECT_BUFFER,
+                INITIAL_DRAW_DATA * sizeof(DrawElementsIndirectCommand));
+        }
+        auto* commands = static_cast<DrawElementsIndirectCommand*>(
+            m_commands->beginWrite(count * sizeof(DrawElementsIndirectCommand)));
+        for (uint32_t i = 0; i < count; i++) {
+            commands[i] = m_packets[m_order[i].packet].mesh->indirectCommand(m_firstRecord + i);
+        }
+        m_commandOffset = m_commands->endWrite();
+    }
+    m_written = true;
+    m_fenced = false;
+}
+
+void RenderQueue::fenceDrawData() {
+    if (m_fenced)
+        return;
+    m_drawData->fence();
+    if (m_wroteCommands) {
+        m_commands->fence();
+    }
+    m_fenced = true;
+}
+
+void RenderQueue::draw(RenderQueueStats& stats, uint32_t first, uint32_t end) {
+    uint32_t count = end - first;
+
+    bool streaming = m_streamDrawData && GLAD_GL_VERSION_4_2 && count > 0;
+    if (streaming && !m_written) {
+        writeDrawData();
+    }
+    bool indirect = streaming && m_wroteCommands;
+    if (indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands->getId());
+    }
+    const uint32_t firstRecord = m_firstRecord;
+    const size_t commandOffset = m_commandOffset;
+
+    // What is bound right now, as far as the queue knows. Nothing is assumed on entry. The
+    // queue keeps its own record to count and batch draws by; the binds go through GLState.
+    GLState& state = GLState::shared();
+    ShaderProgram* boundProgram = nullptr;
+    bool readsDrawData = false;
+    UniformHandle modelUniform;
+    UniformHandle shininessUniform;
+    uint32_t boundVertexArray = UNKNOWN;
+    // Whether the bound vertex array's draw data attributes point at the draw data buffer.
+    bool attached = false;
+    std::vector<uint32_t> boundTextures;
+    // The sampler each texture unit was assigned to in the bound program.
+    std::vector<const std::string*> unitSamplers;
+    float boundShininess = 0.f;
+    bool blending = false;
+
+    // The streamed packets not drawn yet, all drawable with the state in place. Anything that
+    // is about to change that state draws them first.
+    uint32_t runStart = 0;
+    uint32_t runLength = 0;
+    auto flush = [&]() {
+        if (runLength == 0)
+            return;
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+            reinterpret_cast<const void*>(commandOffset + runStart * sizeof(DrawElementsIndirectCommand)),
+            static_cast<GLsizei>(runLength), 0);
+        stats.drawCalls++;
+        stats.multiDraws++;
+        runLength = 0;
+    };
+
+    for (uint32_t i = first; i < end; i++) {
+        const DrawPacket& packet = m_packets[m_order[i].packet];
+        stats.packets++;
+
+        if (!blending && (packet.key >> (64 - PASS_BITS)) == uint64_t(RenderPass::Transparent)) {
+            flush();
+            state.enable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            state.depthMask(false);
+            blending = true;
+        }
+
+        bool programChanged = packet.program != boundProgram;
+        if (programChanged) {
+            flush();
+            packet.program->activate();
+            boundProgram = packet.program;
+            readsDrawData = programInfo(*boundProgram).readsDrawData;
+            modelUniform = boundProgram->uniform("model");
+            shininessUniform = boundProgram->uniform("material.shininess");
+            unitSamplers.clear();
+            stats.programBinds++;
+        }
+        else {
+            stats.skippedProgramBinds++;
+        }
+
+        uint32_t vertexArray = packet.mesh->getVertexArray();
+        if (vertexArray != boundVertexArray) {
+            flush();
+            // Leave vertex arrays as renderInstanced() does, with the instance attributes off.
+            if (attached) {
+                Mesh3D::detachInstanceAttributes();
+                attached = false;
+            }
+            state.bindVertexArray(vertexArray);
+            boundVertexArray = vertexArray;
+            stats.vertexArrayBinds++;
+        }
+        else {
+            stats.skippedVertexArrayBinds++;
+        }
+        if (streaming && readsDrawData && !attached) {
+            Mesh3D::attachInstanceAttributes(m_drawData->getId());
+            attached = true;
+        }
+
+        const std::vector<Texture>& textures = packet.mesh->getTextures();
+        if (boundTextures.size() < textures.size()) {
+            boundTextures.resize(textures.size(), UNKNOWN);
+        }
+        if (unitSamplers.size() < textures.size()) {
+            unitSamplers.resize(textures.size(), nullptr);
+        }
+        for (size_t unit = 0; unit < textures.size(); unit++) {
+            const Texture& texture = textures[unit];
+            if (unitSamplers[unit] == nullptr || *unitSamplers[unit] != texture.samplerName) {
+                flush();
+                packet.program->setUniform(texture.samplerName, static_cast<int32_t>(unit));
+                unitSamplers[unit] = &texture.samplerName;
+            }
+            if (boundTextures[unit] != texture.textureId) {
+                flush();
+                state.bindTexture(static_cast<uint32_t>(unit), texture.textureId);
+                boundTextures[unit] = texture.textureId;
+                stats.textureBinds++;
+            }
+            else {
+                stats.skippedTextureBinds++;
+            }
+        }
+
+        if (readsDrawData && indirect) {
+            if (runLength == 0) {
+                runStart = i;
+            }
+            runLength++;
+            stats.streamedDraws++;
+            continue;
+        }
+        if (readsDrawData && streaming) {
+            packet.mesh->draw(firstRecord + i);
+            stats.streamedDraws++;
+            stats.drawCalls++;
+            continue;
+        }
+        if (readsDrawData) {
+            // The attributes are disabled, so the shader reads their constant values.
+            for (int column = 0; column < 4; column++) {
+                glVertexAttrib4fv(4 + column, &packet.model[column][0]);
+            }
+            glVertexAttrib4f(8, 1.f, 1.f, 1.f, packet.shininess);
+            packet.mesh->draw();
+            stats.drawCalls++;
+            continue;
+        }
+
+        if (programChanged || packet.shininess != boundShininess) {
+            packet.program->setUniform(shininessUniform, packet.shininess);
+            boundShininess = packet.shininess;
+            stats.materialUniforms++;
+        }
+        else {
+            stats.skippedMaterialUniforms++;
+        }
+
+        packet.program->setUniform(modelUniform, packet.model);
+        packet.mesh->draw();
+        stats.drawCalls++;
+    }
+    flush();
+
+    if (attached) {
+        Mesh3D::detachInstanceAttributes();
+    }
+    if (indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    // The sections are fenced once, after the last pass that reads them.
+    m_drawnPackets += count;
+    if (m_drawnPackets >= m_order.size()) {
+        fenceDrawData();
+    }
+
+    if (blending) {
+        state.depthMask(true);
+        state.disable(GL_BLEND);
+    }
+}
+
+size_t RenderQueue::size() const {
+    return m_packets.size();
+}
+
+const std::vector<DrawPacket>& RenderQueue::packets() const {
+    return m_packets;
+}
+
+const RenderQueue::ProgramInfo& RenderQueue::programInfo(const ShaderProgram& program) {
+    auto it = m_programs.find(&program);
+    if (it == m_programs.end()) {
+        it = m_programs.emplace(&program, ProgramInfo{ static_cast<uint32_t>(m_programs.size()), 0, false }).first;
+    }
+    if (it->second.glProgram != program.getId()) {
+        it->second.glProgram = program.getId();
+        it->second.readsDrawData = program.attributeLocation("drawModel") >= 0;
+    }
+    return it->second;
+}
+
+const RenderQueue::MeshIds& RenderQueue::meshIds(const Mesh3D& mesh) {
+    auto it = m_meshIds.find(mesh.getId());
+    if (it != m_meshIds.end())
+        return it->second;
+
+    std::vector<uint32_t> textureSet;
+    for (auto& texture : mesh.getTextures()) {
+        textureSet.push_back(texture.textureId);
+    }
+    auto set = m_textureSetIds.find(textureSet);
+    if (set == m_textureSetIds.end()) {
+        set = m_textureSetIds.emplace(std::move(textureSet), static_cast<uint32_t>(m_textureSetIds.size())).first;
+    }
+    MeshIds ids{ static_cast<uint32_t>(m_meshIds.size()), set->second,
+        ShaderVariants::materialFeatures(mesh.getTextures()) };
+    return m_meshIds.emplace(mesh.getId(), ids).first->second;
+}
+
+void RenderQueue::radixSort() {
+    size_t n = m_order.size();
+    m_scratch.resize(n);
+
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (auto& entry : m_order) {
+            counts[(entry.key >> shift) & 0xFF]++;
+        }
+        // Every key has the same byte here (e.g., the pass bits, or unused shader ids), so the
+        // pass would not move anything.
+        if (counts[(m_order.empty() ? 0 : (m_order[0].key >> shift) & 0xFF)] == n)
+            continue;
+
+        size_t offset = 0;
+        for (auto& count : counts) {
+            size_t c = count;
+            count = offset;
+            offset += c;
+        }
+        for (auto& entry : m_order) {
+            m_scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+        }
+        m_order.swap(m_scratch);
+    }
+}
@@ -0,0 +1,114 @@
+#include "RingBuffer.h"
+#include <algorithm>
+
+RingBuffer::RingBuffer(GLenum target, size_t sectionBytes)
+    : m_target(target), m_sectionBytes(std::max<size_t>(sectionBytes, 1)),
+    m_persistent(GLAD_GL_VERSION_4_4 && glBufferStorage != nullptr) {
+    allocate();
+}
+
+RingBuffer::~RingBuffer() {
+    release();
+}
+
+void RingBuffer::allocate() {
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(m_target, m_buffer);
+    GLsizeiptr size = static_cast<GLsizeiptr>(m_sectionBytes * SECTIONS);
+    if (m_persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(m_target, size, nullptr, flags);
+        m_mapping = static_cast<std::byte*>(glMapBufferRange(m_target, 0, size, flags));
+    }
+    else {
+        glBufferData(m_target, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(m_target, 0);
+}
+
+void RingBuffer::release() {
+    for (uint32_t section = 0; section < SECTIONS; section++) {
+        wait(section);
+    }
+    if (m_buffer != 0) {
+        if (m_persistent && m_mapping != nullptr) {
+            glBindBuffer(m_target, m_buffer);
+            glUnmapBuffer(m_target);
+            glBindBuffer(m_target, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+    m_mapping = nullptr;
+}
+
+void RingBuffer::wait(uint32_t section) {
+    GLsync& fence = m_fences[section];
+    if (fence == nullptr)
+        return;
+    // The first wait flushes the commands the fence follows, so later ones cannot deadlock.
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+        GLenum result = glClientWaitSync(fence, flags, 1000000);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+            break;
+        flags = 0;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void* RingBuffer::beginWrite(size_t bytes) {
+    if (bytes > m_sectionBytes) {
+        release();
+        while (m_sectionBytes < bytes) {
+            m_sectionBytes *= 2;
+        }
+        allocate();
+    }
+
+    m_section = (m_section + 1) % SECTIONS;
+    wait(m_section);
+
+    size_t offset = m_section * m_sectionBytes;
+    if (m_persistent)
+        return m_mapping + offset;
+
+    // The fence already guarantees the GPU is done with this section, so there is nothing for
+    // the driver to synchronize.
+    glBindBuffer(m_target, m_buffer);
+    m_mapping = static_cast<std::byte*>(glMapBufferRange(m_target, static_cast<GLintptr>(offset),
+        static_cast<GLsizeiptr>(m_sectionBytes),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    glBindBuffer(m_target, 0);
+    return m_mapping;
+}
+
+size_t RingBuffer::endWrite() {
+    if (!m_persistent) {
+        glBindBuffer(m_target, m_buffer);
+        glUnmapBuffer(m_target);
+        glBindBuffer(m_target, 0);
+        m_mapping = nullptr;
+    }
+    return m_section * m_sectionBytes;
+}
+
+void RingBuffer::fence() {
+    if (m_fences[m_section] != nullptr) {
+        glDeleteSync(m_fences[m_section]);
+    }
+    m_fences[m_section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+uint32_t RingBuffer::getId() const {
+    return m_buffer;
+}
+
+size_t RingBuffer::getSectionBytes() const {
+    return m_sectionBytes;
+}
+
+bool RingBuffer::isPersistent() const {
+    return m_persistent;
+}
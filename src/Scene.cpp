@@ -1,14 +1,18 @@
 
 #include "AssimpImport.h"
 #include "Mesh3D.h"
+#include "MeshRegistry.h"
 #include "Object3D.h"
 #include "Camera.h"
+#include <optional>
 
 #include "Animator.h"
 #include "RotationAnimation.h"
 #include "TranslationAnimation.h"
 #include "PauseAnimation.h"
 #include "BezierTranslationAnimation.h"
+#include "SceneFile.h"
+#include "FrameUniforms.h"
 
 #include "Shader.cpp"
 
@@ -55,8 +59,10 @@ struct SpotLight {
 
 struct Scene {
     ShaderProgram program;
-    std::vector<Object3D> objects;
+    ObjectPool objects;
     std::vector<Animator> animators;
+    // Handles of objects that gameplay code looks up by name.
+    std::unordered_map<std::string, ObjectHandle> named;
 
     Camera camera = Camera();
 
@@ -65,257 +71,280 @@ struct Scene {
     SpotLight slight;
 };
 
-void GLSetCameraUniform(Scene& scene) {
-    Camera& camera = scene.camera;
-    ShaderProgram& program = scene.program;
+/**
+ * @brief The scene's camera and lights, laid out for the frame uniform buffer that lighting
+ * shaders read them from.
+ */
+FrameData sceneFrameData(const Scene& scene) {
+    const Camera& camera = scene.camera;
+    FrameData data{};
 
-    program.setUniform("view", camera.view);
-    program.setUniform("projection", camera.perspective);
-    program.setUniform("viewPos", camera.position);
+    data.projection = camera.perspective;
+    data.view = camera.view;
+    data.viewPos = camera.position;
 
-    program.setUniform("ambientColor", glm::vec3(0.1f));
+    data.ambientColor = glm::vec3(0.1f);
 
     /// lighting
     // directional light
-    program.setUniform("dirLight.direction", scene.dlight.direction);
-    program.setUniform("dirLight.ambient", scene.dlight.ambient);
-    program.setUniform("dirLight.diffuse", scene.dlight.diffuse);
-    program.setUniform("dirLight.specular", scene.dlight.specular);
+    data.dirLight.direction = scene.dlight.direction;
+    data.dirLight.ambient = scene.dlight.ambient;
+    data.dirLight.diffuse = scene.dlight.diffuse;
+    data.dirLight.specular = scene.dlight.specular;
 
     // point light
-    program.setUniform("pointLight.position", scene.plight.position);
+    data.pointLight.position = scene.plight.position;
 
-    program.setUniform("pointLight.constant", scene.plight.constant);
-    program.setUniform("pointLight.linear", scene.plight.linear);
-    program.setUniform("pointLight.quadratic", scene.plight.quadratic);
+    data.pointLight.constant = scene.plight.constant;
+    data.pointLight.linear = scene.plight.linear;
+    data.pointLight.quadratic = scene.plight.quadratic;
 
-    program.setUniform("pointLight.ambient", scene.plight.ambient);
-    program.setUniform("pointLight.diffuse", scene.plight.diffuse);
-    program.setUniform("pointLight.specular", scene.plight.specular);
+    data.pointLight.ambient = scene.plight.ambient;
+    data.pointLight.diffuse = scene.plight.diffuse;
+    data.pointLight.specular = scene.plight.specular;
 
     // spotlight
-    /*program.setUniform("spotLight.direction", scene.slight.direction);*/
-    /*program.setUniform("spotLight.position", scene.slight.position);*/
+    /*data.spotLight.direction = scene.slight.direction;*/
+    /*data.spotLight.position = scene.slight.position;*/
 
     // flashlight
-    program.setUniform("spotLight.direction", camera.front);
-    program.setUniform("spotLight.position", camera.position);
+    data.spotLight.direction = camera.front;
+    data.spotLight.position = camera.position;
 
-    program.setUniform("spotLight.cutOff", glm::cos(glm::radians(scene.slight.cutOff)));
-    program.setUniform("spotLight.outerCutOff", glm::cos(glm::radians(scene.slight.outerCutOff)));
+    data.spotLight.cutOff = glm::cos(glm::radians(scene.slight.cutOff));
+    data.spotLight.outerCutOff = glm::cos(glm::radians(scene.slight.outerCutOff));
 
-    program.setUniform("spotLight.constant", scene.slight.constant);
-    program.setUniform("spotLight.linear", scene.slight.linear);
-    program.setUniform("spotLight.quadratic", scene.slight.quadratic);
+    data.spotLight.constant = scene.slight.constant;
+    data.spotLight.linear = scene.slight.linear;
+    data.spotLight.quadratic = scene.slight.quadratic;
 
-    program.setUniform("spotLight.ambient", scene.slight.ambient);
-    program.setUniform("spotLight.diffuse", scene.slight.diffuse);
-    program.setUniform("spotLight.specular", scene.slight.specular);
+    data.spotLight.ambient = scene.slight.ambient;
+    data.spotLight.diffuse = scene.slight.diffuse;
+    data.spotLight.specular = scene.slight.specular;
+    return data;
 }
 
 /**
- * @brief Loads an image from the given path into an OpenGL texture.
+ * @brief Sets the camera uniforms of a program that does not read the FrameData block, such
+ * as the texturing and simple presets. For other programs this does nothing.
  */
-Texture loadTexture(const std::filesystem::path& path, const std::string& samplerName = "material.diffuse") {
-	StbImage i;
-	i.loadFromFile(path.string());
-	return Texture::loadImage(i, samplerName);
-}
-
-
-Scene bunny() {
-	Scene scene{ texturingShader() };
-
-	// We assume that (0,0) in texture space is the upper left corner, but some artists use (0,0) in the lower
-	// left corner. In that case, we have to flip the V-coordinate of each UV texture location. The last parameter
-	// to assimpLoad controls this. If you load a model and it looks very strange, try changing the last parameter.
-	auto bunny = assimpLoad("models/bunny_textured.obj", true);
-	bunny.grow(glm::vec3(9, 9, 9));
-	bunny.move(glm::vec3(0.2, -1, 0));
-
-	// Move all objects into the scene's objects list.
-	scene.objects.push_back(std::move(bunny));
-	// Now the "bunny" variable is empty; if we want to refer to the bunny object, we need to reference
-	// scene.objects[0]
-
-	Animator spinBunny;
-	// Spin the bunny 360 degrees over 10 seconds.
-	spinBunny.addAnimation(
-        [&] () {
-        return std::make_unique<RotationAnimation>(scene.objects[0], 10.0, glm::vec3(0, 2 * M_PI, 0));
-        }
-    );
-
-	// Move all animators into the scene's animators list.
-	scene.animators.push_back(std::move(spinBunny));
+void GLSetCameraUniform(Scene& scene, ShaderProgram& program) {
+    Camera& camera = scene.camera;
 
-	return scene;
+    program.setUniform("view", camera.view);
+    program.setUniform("projection", camera.perspective);
+    program.setUniform("viewPos", camera.position);
 }
 
+void GLSetCameraUniform(Scene& scene) {
+    GLSetCameraUniform(scene, scene.program);
+}
 
 /**
- * @brief Demonstrates loading a square, oriented as the "floor", with a manually-specified texture
- * that does not come from Assimp.
+ * @brief Submits the scene's shader, given by a preset name or a pair of shader paths.
  */
-Scene marbleSquare() {
-	Scene scene{ toonLightingShader() };
-
-	std::vector<Texture> textures = {
-		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "material.diffuse"),
-		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_specular.tga", "material.specular"),
-	};
-	auto mesh = Mesh3D::square(textures);
-	auto floor = Object3D(std::vector<Mesh3D>{mesh});
-	floor.grow(glm::vec3(5, 5, 5));
-	floor.move(glm::vec3(0, -1.5, 0));
-	floor.rotate(glm::vec3(-M_PI / 2, 0, 0));
-
-	scene.objects.push_back(std::move(floor));
-	return scene;
-}
-
-Scene testSquare() {
-	Scene scene{ toonLightingShader() };
-
-	std::vector<Texture> textures = {
-		loadTexture("models/Tiles/Tiles_057_basecolor.png", "material.diffuse"),
-		loadTexture("models/Tiles/Tiles_057_normal.png", "material.normal"),
-        loadTexture("models/Tiles/Tiles_057_ambientOcclusion.png", "material.specular"),
-	};
-	auto mesh = Mesh3D::square(textures);
-	auto floor = Object3D(std::vector<Mesh3D>{mesh});
-	floor.grow(glm::vec3(5, 5, 5));
-	floor.move(glm::vec3(0, -1.5, 0));
-	floor.rotate(glm::vec3(-M_PI / 2, 0, 0));
-
-	scene.objects.push_back(std::move(floor));
-	return scene;
+ShaderProgram sceneShader(const SceneFile& file) {
+	const SceneFileHeader& header = file.header();
+	std::string vertex(file.string(header.vertexShader));
+	if (header.fragmentShader == SCENE_FILE_NONE) {
+		static const std::unordered_map<std::string, ShaderProgram(*)()> presets = {
+			{ "toon", toonLightingShader },
+			{ "phong", phongLightingShader },
+			{ "texturing", texturingShader },
+			{ "simple", simpleShader },
+			{ "toon_instanced", toonLightingInstancedShader },
+		};
+		auto preset = presets.find(vertex);
+		if (preset == presets.end()) {
+			throw std::runtime_error("Unknown shader preset '" + vertex + "'");
+		}
+		return preset->second();
+	}
+
+	return ShaderManager::shared().request(vertex, std::string(file.string(header.fragmentShader)));
 }
 
 /**
- * @brief Loads a cube with a cube map texture.
+ * @brief Builds a scene from a compiled scene file. Models and textures come from the asset
+ * cache, so only the first scene to use an asset pays for loading it.
  */
-Scene cube() {
-	Scene scene{ toonLightingShader() };
-
-	auto cube = assimpLoad("models/cube.obj", true);
-
-	Texture tilemap = loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "material.diffuse");
-    /*cube.addTexture(tilemap);*/
-
-	scene.objects.push_back(std::move(cube));
-
-	Animator spinCube;
-	spinCube.addAnimation(
-        [&] () {
-        return std::make_unique<RotationAnimation>(scene.objects[0], 10.0, glm::vec3(0, M_PI, 0));
-        }
-    );
-	// Then spin around the x axis.
-	spinCube.addAnimation(
-        [&] () {
-        return std::make_unique<RotationAnimation>(scene.objects[0], 10.0, glm::vec3(M_PI, 0, 0));
-        }
-    );
-
-	scene.animators.push_back(std::move(spinCube));
-
-	return scene;
-}
-
-Scene lightCube() {
-    Scene scene { toonLightingShader() };
-
-	auto cube = assimpLoad("models/cube.obj", true);
+Scene loadScene(const SceneFile& file, SceneAssets& assets) {
+	Scene scene{ sceneShader(file) };
+
+	auto nodes = file.nodes();
+	auto textures = file.textures();
+	std::vector<std::optional<Object3D>> built(nodes.size());
+	std::vector<uint32_t> depth(nodes.size(), 0);
+	uint32_t maxDepth = 0;
+
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		const SceneFileNode& node = nodes[i];
+		if (node.flags & NODE_SQUARE) {
+			std::vector<Texture> squareTextures;
+			for (uint32_t t = node.firstTexture; t < node.firstTexture + node.textureCount; t++) {
+				squareTextures.push_back(assets.texture(std::string(file.string(textures[t].path)),
+					std::string(file.string(textures[t].sampler))));
+			}
+			built[i].emplace(std::vector<MeshHandle>{ MeshRegistry::shared().square(squareTextures) });
+		}
+		else {
+			built[i].emplace(assets.model(std::string(file.string(node.model)),
+				node.flags & NODE_FLIP_UVS, node.flags & NODE_KEEP_GEOMETRY));
+		}
+
+		Object3D& object = *built[i];
+		object.setPosition(node.position);
+		object.setOrientation(node.rotation);
+		object.setScale(node.scale);
+		object.setCenter(node.center);
+		object.setVelocity(node.velocity);
+		object.setAcceleration(node.acceleration);
+		if (node.flags & NODE_SHININESS) {
+			object.setShininess(node.shininess);
+		}
+		if (node.flags & NODE_OCCLUDER) {
+			object.setOccluder(true);
+		}
+		if (node.flags & NODE_NO_GRAVITY) {
+			object.toggleGravity();
+		}
+		if (node.flags & NODE_HIDDEN) {
+			object.setDisplay(false);
+		}
+		if (node.flags & NODE_TRANSPARENT) {
+			object.setTransparent(true);
+		}
+		if (node.name != SCENE_FILE_NONE) {
+			object.setName(std::string(file.string(node.name)));
+		}
+
+		if (node.parent != SCENE_FILE_NONE) {
+			depth[i] = depth[node.parent] + 1;
+			maxDepth = std::max(maxDepth, depth[i]);
+		}
+	}
+
+	// Children are moved into their parents deepest first, so a child is complete before it
+	// moves. Each one lands after its parent's existing (e.g., imported) children.
+	std::vector<size_t> childIndex(nodes.size(), 0);
+	for (uint32_t d = maxDepth; d > 0; d--) {
+		for (uint32_t i = 0; i < nodes.size(); i++) {
+			if (depth[i] == d) {
+				Object3D& parent = *built[nodes[i].parent];
+				childIndex[i] = parent.numberOfChildren();
+				parent.addChild(std::move(*built[i]));
+				built[i].reset();
+			}
+		}
+	}
+
+	// How animations find each node: its root's handle, and the path down to it.
+	std::vector<ObjectRef> refs;
+	refs.reserve(nodes.size());
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i].parent == SCENE_FILE_NONE) {
+			ObjectHandle handle = scene.objects.create(std::move(*built[i]));
+			refs.emplace_back(handle);
+			if (nodes[i].name != SCENE_FILE_NONE) {
+				scene.named[std::string(file.string(nodes[i].name))] = handle;
+			}
+		}
+		else {
+			// Parents come first, so the parent's reference is already known.
+			ObjectRef ref = refs[nodes[i].parent];
+			ref.childPath.push_back(childIndex[i]);
+			refs.push_back(std::move(ref));
+		}
+	}
+
+	auto animations = file.animations();
+	for (const SceneFileAnimator& a : file.animators()) {
+		Animator animator;
+		for (uint32_t j = a.firstAnimation; j < a.firstAnimation + a.animationCount; j++) {
+			const SceneFileAnimation anim = animations[j];
+			ObjectRef ref = refs[anim.node];
+			switch (anim.type) {
+			case SceneAnimationType::Pause:
+				animator.addAnimation([ref, anim]() {
+					return std::make_unique<PauseAnimation>(ref, anim.duration);
+				});
+				break;
+			case SceneAnimationType::Rotation:
+				animator.addAnimation([ref, anim]() {
+					return std::make_unique<RotationAnimation>(ref, anim.duration, anim.points[0]);
+				});
+				break;
+			case SceneAnimationType::Translation:
+				animator.addAnimation([ref, anim]() {
+					return std::make_unique<TranslationAnimation>(ref, anim.duration, anim.points[0]);
+				});
+				break;
+			case SceneAnimationType::Bezier:
+				animator.addAnimation([ref, anim]() {
+					return std::make_unique<BezierTranslationAnimation>(ref, anim.duration,
+						anim.points[0], anim.points[1], anim.points[2], anim.points[3]);
+				});
+				break;
+			}
+		}
+		scene.animators.push_back(std::move(animator));
+	}
+
+	for (const SceneFileLight& l : file.lights()) {
+		switch (l.type) {
+		case SceneLightType::Directional: {
+			DirLight& light = scene.dlight;
+			if (l.fields & LIGHT_DIRECTION) light.direction = l.direction;
+			if (l.fields & LIGHT_AMBIENT) light.ambient = l.ambient;
+			if (l.fields & LIGHT_DIFFUSE) light.diffuse = l.diffuse;
+			if (l.fields & LIGHT_SPECULAR) light.specular = l.specular;
+			if (l.fields & LIGHT_HIDDEN) light.display = false;
+			break;
+		}
+		case SceneLightType::Point: {
+			PointLight& light = scene.plight;
+			if (l.fields & LIGHT_POSITION) light.position = l.position;
+			if (l.fields & LIGHT_AMBIENT) light.ambient = l.ambient;
+			if (l.fields & LIGHT_DIFFUSE) light.diffuse = l.diffuse;
+			if (l.fields & LIGHT_SPECULAR) light.specular = l.specular;
+			if (l.fields & LIGHT_ATTENUATION) {
+				light.constant = l.constant;
+				light.linear = l.linear;
+				light.quadratic = l.quadratic;
+			}
+			if (l.fields & LIGHT_HIDDEN) light.display = false;
+			break;
+		}
+		case SceneLightType::Spot: {
+			SpotLight& light = scene.slight;
+			if (l.fields & LIGHT_POSITION) light.position = l.position;
+			if (l.fields & LIGHT_DIRECTION) light.direction = l.direction;
+			if (l.fields & LIGHT_AMBIENT) light.ambient = l.ambient;
+			if (l.fields & LIGHT_DIFFUSE) light.diffuse = l.diffuse;
+			if (l.fields & LIGHT_SPECULAR) light.specular = l.specular;
+			if (l.fields & LIGHT_ATTENUATION) {
+				light.constant = l.constant;
+				light.linear = l.linear;
+				light.quadratic = l.quadratic;
+			}
+			if (l.fields & LIGHT_CUTOFF) {
+				light.cutOff = l.cutOff;
+				light.outerCutOff = l.outerCutOff;
+			}
+			if (l.fields & LIGHT_HIDDEN) light.display = false;
+			break;
+		}
+		}
+	}
 
-	scene.objects.push_back(std::move(cube));
 	return scene;
 }
 
 /**
- * @brief Constructs a scene of a tiger sitting in a boat, where the tiger is the child object
- * of the boat.
- * @return
+ * @brief Loads a scene from a text (.scene) or compiled (.sceneb) scene file.
  */
-Scene lifeOfPi() {
-	// This scene is more complicated; it has child objects, as well as animators.
-	Scene scene{ toonLightingShader() };
-
-	auto boat = assimpLoad("models/boat/boat.fbx", true);
-	boat.move(glm::vec3(0, -0.5, 0));
-	boat.grow(glm::vec3(0.01, 0.01, 0.01));
-	auto tiger = assimpLoad("models/tiger/scene.gltf", true);
-	tiger.move(glm::vec3(0, -5, 10));
-	// Move the tiger to be a child of the boat.
-	boat.addChild(std::move(tiger));
-
-    boat.setAcceleration(glm::vec3(0.f, -1.0f, 0.f));
-	// Move the boat into the scene list.
-	scene.objects.push_back(std::move(boat));
-
-	std::vector<Texture> textures = {
-		// loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "material.diffuse"),
-		// loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_specular.tga", "material.specular"),
-		// loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_normal.tga", "material.normal"),
-		loadTexture("models/Tiles/Tiles_057_basecolor.png", "material.diffuse"),
-		// loadTexture("models/Tiles/Tiles_057_normal.png", "material.normal"),
-	};
-	auto mesh = Mesh3D::square(textures);
-	auto floor = Object3D(std::vector<Mesh3D>{mesh});
-	floor.grow(glm::vec3(5, 5, 5));
-	floor.move(glm::vec3(0, 0, 0));
-	floor.rotate(glm::vec3(-M_PI / 2, 0, 0));
-
-	scene.objects.push_back(std::move(floor));
-
-	// We want these animations to referenced the *moved* objects, which are no longer
-	// in the variables named "tiger" and "boat". "boat" is now in the "objects" list at
-	// index 0, and "tiger" is the index-1 child of the boat.
-	Animator animBoat;
-	animBoat.addAnimation(
-        [&] () {
-        return std::make_unique<RotationAnimation>(scene.objects[0], 10, glm::vec3(0, 2 * M_PI, 0));
-        }
-    );
-
-	Animator animTiger;
-	animTiger.addAnimation(
-        [&] () {
-        return std::make_unique<RotationAnimation>(scene.objects[0].getChild(1), 10, glm::vec3(0, 2 * M_PI, 0));
-        }
-    );
-
-	// The Animators will be destroyed when leaving this function, so we move them into
-	// a list to be returned.
-	scene.animators.push_back(std::move(animBoat));
-	scene.animators.push_back(std::move(animTiger));
-
-	// Transfer ownership of the objects and animators back to the main.
-	return scene;
-}
-
-Scene Room() {
-	Scene scene{ toonLightingShader() };
-
-    /*scene.plight.position = {2.f, 2.f, -3.f};*/
-
-	auto room = assimpLoad("models/cube.obj", true);
-
-	room.grow(glm::vec3(0.5f));
-	/*lady.grow(glm::vec3(0.25));*/
-	/*lady.move(glm::vec3(0, -25, -50));*/
-
-	/*auto cube = assimpLoad("models/cube.obj", true);*/
-	/*cube.move(glm::vec3(0.2, -1, -10));*/
-
-	scene.objects.push_back(std::move(room));
-
-	/*Animator animLady;*/
-	/*animLady.addAnimation(std::make_unique<RotationAnimation>(scene.objects[0], 10, glm::vec3(2 * M_PI, 2 * M_PI, 0)));*/
-
-	/*scene.animators.push_back(std::move(animLady));*/
-
-    return scene;
+Scene loadScene(const std::filesystem::path& path, SceneAssets& assets) {
+	return loadScene(SceneFile::load(path), assets);
 }
 
 void printObjectTree(const Object3D& obj, int& counter, const std::string& prefix = "", bool isLast = true) {
@@ -342,92 +371,3 @@ void printObjectHierarchy(const Object3D& root) {
     int counter = 1;
     printObjectTree(root, counter);
 }
-
-Scene Sanders() {
-    Scene scene{ toonLightingShader() };
-
-	std::vector<Texture> textures = {
-		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "material.diffuse"),
-		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_specular.tga", "material.specular"),
-		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_normal.tga", "material.normal"),
-		// loadTexture("models/Tiles/Tiles_057_basecolor.png", "material.diffuse"),
-		// loadTexture("models/Tiles/Tiles_057_normal.png", "material.normal"),
-		// loadTexture("models/Tiles/Tiles_057_ambientOcclusion.png", "material.specular"),
-	};
-	auto mesh = Mesh3D::square(textures);
-	auto floor = Object3D(std::vector<Mesh3D>{mesh});
-	auto wall1 = Object3D(std::vector<Mesh3D>{mesh});
-
-    floor.setShininess(0.9);
-	floor.grow(glm::vec3(100));
-	floor.move(glm::vec3(0, 0, 0));
-	floor.rotate(glm::vec3(-M_PI / 2, 0, 0));
-
-	wall1.grow(glm::vec3(100));
-	wall1.move(glm::vec3(100, 0, 0));
-	wall1.rotate(glm::vec3(M_PI, 0, M_PI));
-
-	scene.objects.push_back(std::move(floor));
-	scene.objects.push_back(std::move(wall1));
-
-    auto brr = assimpLoad("models/brr/scene.gltf", true);
-    auto trala = assimpLoad("models/trala/scene.gltf", true);
-    auto thung = assimpLoad("models/thung/scene.gltf", true);
-	auto tiger = assimpLoad("models/tiger/scene.gltf", true);
-
-    brr.move(glm::vec3(0, 5, 0));
-
-    trala.move(glm::vec3(5, 7.5f, -5));
-    trala.grow(glm::vec3(0.75));
-    trala.toggleGravity();
-
-    thung.move(glm::vec3(-10, 10, -10));
-    thung.grow(glm::vec3(0.75));
-
-	tiger.move(glm::vec3(0, -5, 22.5));
-	tiger.grow(glm::vec3(0.1));
-    tiger.rotate(glm::vec3(0.f, M_PI, 0.f));
-
-    scene.objects.push_back(std::move(brr));
-    scene.objects.push_back(std::move(trala));
-    scene.objects.push_back(std::move(thung));
-    scene.objects.push_back(std::move(tiger));
-
-    // printObjectHierarchy(scene.objects[1]);
-    // printObjectHierarchy(scene.objects[2]);
-
-    auto& player = scene.objects[2];
-
-    // auto& first_1 = first.getChild(0);
-    // auto& first_2 = first.getChild(0).getChild(0);
-    auto& first = player.getChild(0).getChild(0).getChild(0);
-
-    auto& first_1 = first.getChild(0);
-    // auto& first_3 = first.getChild(2);
-
-	Animator animThung;
-
-    // backflip
-	animThung.addAnimation(
-	    [&player] () {
-        return std::make_unique<PauseAnimation>(player, 1.5f);
-	    }
-    );
-	animThung.addAnimation(
-	    [&player] () {
-        return std::make_unique<RotationAnimation>(player, 1, glm::vec3(2 * M_PI, 0.f, 0.f));
-	    }
-    );
-
-	// animBrr.addAnimation(
-	//     [&] () {
-	//        return std::make_unique<RotationAnimation>(first_2, 10, glm::vec3(5.0f));
-	//     }
-	//    );
-
-
-	scene.animators.push_back(std::move(animThung));
-
-    return scene;
-}
-
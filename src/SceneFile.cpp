@@ -0,0 +1,677 @@
+#include "SceneFile.h"
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "AssimpImport.h"
+#include "StbImage.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char MAGIC[4] = { 'G', 'P', 'S', 'C' };
+
+    /**
+     * @brief Compiles one text scene. Records are gathered in vectors, then laid out after
+     * the header in the order the header lists them.
+     */
+    class SceneCompiler {
+    public:
+        SceneCompiler(std::string_view text, const std::string& sourceName)
+            : m_text(text), m_sourceName(sourceName) {
+        }
+
+        std::vector<std::byte> compile() {
+            m_header.vertexShader = addString("toon");
+            m_header.fragmentShader = SCENE_FILE_NONE;
+
+            while (nextLine()) {
+                const std::string& keyword = m_tokens[0];
+                if (keyword == "shader") {
+                    parseShader();
+                }
+                else if (keyword == "object") {
+                    parseObject();
+                }
+                else if (keyword == "animator") {
+                    expectArguments(0);
+                    parseAnimator();
+                }
+                else if (keyword == "light") {
+                    parseLight();
+                }
+                else {
+                    error("unknown keyword '" + keyword + "'");
+                }
+            }
+            return layout();
+        }
+
+    private:
+        std::string_view m_text;
+        const std::string& m_sourceName;
+        size_t m_position = 0;
+        uint32_t m_lineNumber = 0;
+        std::vector<std::string> m_tokens;
+
+        SceneFileHeader m_header{};
+        std::vector<SceneFileNode> m_nodes;
+        std::vector<SceneFileTexture> m_textures;
+        std::vector<SceneFileAnimator> m_animators;
+        std::vector<SceneFileAnimation> m_animations;
+        std::vector<SceneFileLight> m_lights;
+        std::string m_strings;
+        std::unordered_map<std::string, uint32_t> m_stringOffsets;
+        std::unordered_map<std::string, uint32_t> m_nodeNames;
+
+        [[noreturn]] void error(const std::string& message) const {
+            throw std::runtime_error(m_sourceName + ":" + std::to_string(m_lineNumber) + ": " + message);
+        }
+
+        /**
+         * @brief Splits the next non-empty line into tokens. Double quotes group a token that
+         * has spaces, and # starts a comment.
+         */
+        bool nextLine() {
+            while (m_position < m_text.size()) {
+                size_t end = m_text.find('\n', m_position);
+                if (end == std::string_view::npos)
+                    end = m_text.size();
+                std::string_view line = m_text.substr(m_position, end - m_position);
+                m_position = end + 1;
+                m_lineNumber++;
+
+                m_tokens.clear();
+                size_t i = 0;
+                while (i < line.size()) {
+                    char c = line[i];
+                    if (c == '#')
+                        break;
+                    if (std::isspace(static_cast<unsigned char>(c))) {
+                        i++;
+                    }
+                    else if (c == '"') {
+                        size_t close = line.find('"', i + 1);
+                        if (close == std::string_view::npos)
+                            error("unterminated string");
+                        m_tokens.emplace_back(line.substr(i + 1, close - i - 1));
+                        i = close + 1;
+                    }
+                    else {
+                        size_t start = i;
+                        while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i])) && line[i] != '#') {
+                            i++;
+                        }
+                        m_tokens.emplace_back(line.substr(start, i - start));
+                    }
+                }
+                if (!m_tokens.empty())
+                    return true;
+            }
+            return false;
+        }
+
+        void expectArguments(size_t count) const {
+            if (m_tokens.size() != count + 1)
+                error("'" + m_tokens[0] + "' takes " + std::to_string(count) + " argument(s)");
+        }
+
+        float number(size_t token) const {
+            const std::string& s = m_tokens[token];
+            char* end = nullptr;
+            float value = std::strtof(s.c_str(), &end);
+            if (s.empty() || *end != '\0')
+                error("expected a number, got '" + s + "'");
+            return value;
+        }
+
+        glm::vec3 vector(size_t token) const {
+            return { number(token), number(token + 1), number(token + 2) };
+        }
+
+        uint32_t addString(const std::string& s) {
+            auto [it, added] = m_stringOffsets.emplace(s, static_cast<uint32_t>(m_strings.size()));
+            if (added) {
+                m_strings += s;
+                m_strings += '\0';
+            }
+            return it->second;
+        }
+
+        uint32_t node(const std::string& name) const {
+            auto it = m_nodeNames.find(name);
+            if (it == m_nodeNames.end())
+                error("no object named '" + name + "' before this line");
+            return it->second;
+        }
+
+        /**
+         * @brief Reads lines up to "end", calling parse for each one.
+         */
+        template <typename F>
+        void parseBlock(const std::string& block, F parse) {
+            uint32_t start = m_lineNumber;
+            while (nextLine()) {
+                if (m_tokens[0] == "end") {
+                    expectArguments(0);
+                    return;
+                }
+                parse(m_tokens[0]);
+            }
+            m_lineNumber = start;
+            error("'" + block + "' has no matching 'end'");
+        }
+
+        void parseShader() {
+            if (m_tokens.size() == 2) {
+                m_header.vertexShader = addString(m_tokens[1]);
+                m_header.fragmentShader = SCENE_FILE_NONE;
+            }
+            else if (m_tokens.size() == 3) {
+                m_header.vertexShader = addString(m_tokens[1]);
+                m_header.fragmentShader = addString(m_tokens[2]);
+            }
+            else {
+                error("'shader' takes a preset name, or a vertex and a fragment shader path");
+            }
+        }
+
+        void parseObject() {
+            if (m_tokens.size() > 2)
+                error("'object' takes at most a name");
+
+            SceneFileNode n{};
+            n.name = SCENE_FILE_NONE;
+            n.parent = SCENE_FILE_NONE;
+            n.model = SCENE_FILE_NONE;
+            n.firstTexture = static_cast<uint32_t>(m_textures.size());
+            n.scale = glm::vec3(1);
+            n.shininess = 4;
+
+            uint32_t index = static_cast<uint32_t>(m_nodes.size());
+            if (m_tokens.size() == 2) {
+                if (m_nodeNames.count(m_tokens[1]))
+                    error("there is already an object named '" + m_tokens[1] + "'");
+                n.name = addString(m_tokens[1]);
+                m_nodeNames[m_tokens[1]] = index;
+            }
+
+            parseBlock("object", [&](const std::string& keyword) {
+                if (keyword == "model") {
+                    if (m_tokens.size() < 2)
+                        error("'model' takes a path");
+                    n.model = addString(m_tokens[1]);
+                    for (size_t i = 2; i < m_tokens.size(); i++) {
+                        if (m_tokens[i] == "flip_uvs")
+                            n.flags |= NODE_FLIP_UVS;
+                        else if (m_tokens[i] == "keep_geometry")
+                            n.flags |= NODE_KEEP_GEOMETRY;
+                        else
+                            error("unknown model option '" + m_tokens[i] + "'");
+                    }
+                }
+                else if (keyword == "square") {
+                    expectArguments(0);
+                    n.flags |= NODE_SQUARE;
+                }
+                else if (keyword == "texture") {
+                    expectArguments(2);
+                    m_textures.push_back({ addString(m_tokens[1]), addString(m_tokens[2]) });
+                    n.textureCount++;
+                }
+                else if (keyword == "position") {
+                    expectArguments(3);
+                    n.position = vector(1);
+                }
+                else if (keyword == "rotation") {
+                    expectArguments(3);
+                    n.rotation = glm::radians(vector(1));
+                }
+                else if (keyword == "scale") {
+                    if (m_tokens.size() == 2)
+                        n.scale = glm::vec3(number(1));
+                    else {
+                        expectArguments(3);
+                        n.scale = vector(1);
+                    }
+                }
+                else if (keyword == "center") {
+                    expectArguments(3);
+                    n.center = vector(1);
+                }
+                else if (keyword == "velocity") {
+                    expectArguments(3);
+                    n.velocity = vector(1);
+                }
+                else if (keyword == "acceleration") {
+                    expectArguments(3);
+                    n.acceleration = vector(1);
+                }
+                else if (keyword == "shininess") {
+                    expectArguments(1);
+                    n.shininess = number(1);
+                    n.flags |= NODE_SHININESS;
+                }
+                else if (keyword == "occluder") {
+                    expectArguments(0);
+                    n.flags |= NODE_OCCLUDER;
+                }
+                else if (keyword == "no_gravity") {
+                    expectArguments(0);
+                    n.flags |= NODE_NO_GRAVITY;
+                }
+                else if (keyword == "hidden") {
+                    expectArguments(0);
+                    n.flags |= NODE_HIDDEN;
+                }
+                else if (keyword == "transparent") {
+                    expectArguments(0);
+                    n.flags |= NODE_TRANSPARENT;
+                }
+                else if (keyword == "parent") {
+                    expectArguments(1);
+                    n.parent = node(m_tokens[1]);
+                    if (n.parent == index)
+                        error("an object can't be its own parent");
+                }
+                else {
+                    error("unknown object property '" + keyword + "'");
+                }
+            });
+
+            bool square = (n.flags & NODE_SQUARE) != 0;
+            if (square == (n.model != SCENE_FILE_NONE))
+                error("an object needs exactly one of 'model' and 'square'");
+            if (!square && n.textureCount > 0)
+                error("only squares take textures; models bring their own");
+            m_nodes.push_back(n);
+        }
+
+        void parseAnimator() {
+            SceneFileAnimator a{ static_cast<uint32_t>(m_animations.size()), 0 };
+            parseBlock("animator", [&](const std::string& keyword) {
+                SceneFileAnimation anim{};
+                if (keyword == "pause") {
+                    expectArguments(2);
+                    anim.type = SceneAnimationType::Pause;
+                }
+                else if (keyword == "rotate") {
+                    expectArguments(5);
+                    anim.type = SceneAnimationType::Rotation;
+                    anim.points[0] = glm::radians(vector(3));
+                }
+                else if (keyword == "translate") {
+                    expectArguments(5);
+                    anim.type = SceneAnimationType::Translation;
+                    anim.points[0] = vector(3);
+                }
+                else if (keyword == "bezier") {
+                    expectArguments(14);
+                    anim.type = SceneAnimationType::Bezier;
+                    for (size_t i = 0; i < 4; i++) {
+                        anim.points[i] = vector(3 + 3 * i);
+                    }
+                }
+                else {
+                    error("unknown animation '" + keyword + "'");
+                }
+                anim.node = node(m_tokens[1]);
+                anim.duration = number(2);
+                if (anim.duration <= 0)
+                    error("animations must last more than 0 seconds");
+                m_animations.push_back(anim);
+                a.animationCount++;
+            });
+            m_animators.push_back(a);
+        }
+
+        void parseLight() {
+            expectArguments(1);
+            SceneFileLight l{};
+            if (m_tokens[1] == "directional")
+                l.type = SceneLightType::Directional;
+            else if (m_tokens[1] == "point")
+                l.type = SceneLightType::Point;
+            else if (m_tokens[1] == "spot")
+                l.type = SceneLightType::Spot;
+            else
+                error("lights are 'directional', 'point' or 'spot'");
+
+            parseBlock("light", [&](const std::string& keyword) {
+                auto readVector = [&](glm::vec3& field, uint32_t flag) {
+                    expectArguments(3);
+                    field = vector(1);
+                    l.fields |= flag;
+                };
+                if (keyword == "position")
+                    readVector(l.position, LIGHT_POSITION);
+                else if (keyword == "direction")
+                    readVector(l.direction, LIGHT_DIRECTION);
+                else if (keyword == "ambient")
+                    readVector(l.ambient, LIGHT_AMBIENT);
+                else if (keyword == "diffuse")
+                    readVector(l.diffuse, LIGHT_DIFFUSE);
+                else if (keyword == "specular")
+                    readVector(l.specular, LIGHT_SPECULAR);
+                else if (keyword == "attenuation") {
+                    expectArguments(3);
+                    l.constant = number(1);
+                    l.linear = number(2);
+                    l.quadratic = number(3);
+                    l.fields |= LIGHT_ATTENUATION;
+                }
+                else if (keyword == "cutoff") {
+                    expectArguments(2);
+                    l.cutOff = number(1);
+                    l.outerCutOff = number(2);
+                    l.fields |= LIGHT_CUTOFF;
+                }
+                else if (keyword == "hidden") {
+                    expectArguments(0);
+                    l.fields |= LIGHT_HIDDEN;
+                }
+                else {
+                    error("unknown light property '" + keyword + "'");
+                }
+            });
+            m_lights.push_back(l);
+        }
+
+        template <typename T>
+        static SceneFileSection append(std::vector<std::byte>& out, const T* data, size_t count) {
+            // Keep every section 4-byte aligned, so records can be read in place.
+            out.resize((out.size() + 3) & ~size_t(3));
+            SceneFileSection s{ static_cast<uint32_t>(out.size()), static_cast<uint32_t>(count) };
+            out.resize(out.size() + count * sizeof(T));
+            if (count > 0)
+                std::memcpy(out.data() + s.offset, data, count * sizeof(T));
+            return s;
+        }
+
+        std::vector<std::byte> layout() {
+            std::vector<std::byte> out(sizeof(SceneFileHeader));
+            std::memcpy(m_header.magic, MAGIC, sizeof(MAGIC));
+            m_header.version = SCENE_FILE_VERSION;
+            m_header.nodes = append(out, m_nodes.data(), m_nodes.size());
+            m_header.textures = append(out, m_textures.data(), m_textures.size());
+            m_header.animators = append(out, m_animators.data(), m_animators.size());
+            m_header.animations = append(out, m_animations.data(), m_animations.size());
+            m_header.lights = append(out, m_lights.data(), m_lights.size());
+            m_header.strings = append(out, m_strings.data(), m_strings.size());
+            std::memcpy(out.data(), &m_header, sizeof(m_header));
+            return out;
+        }
+    };
+}
+
+std::vector<std::byte> compileSceneText(std::string_view text, const std::string& sourceName) {
+    return SceneCompiler(text, sourceName).compile();
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view) {
+            m_file = file;
+            m_mapping = mapping;
+            m_data = static_cast<const std::byte*>(view);
+            m_size = static_cast<size_t>(size.QuadPart);
+            m_mapped = true;
+            return;
+        }
+        if (mapping)
+            CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            // The mapping stays valid after the descriptor is closed.
+            close(fd);
+            m_data = static_cast<const std::byte*>(view);
+            m_size = static_cast<size_t>(info.st_size);
+            m_mapped = true;
+            return;
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+#endif
+
+    // Mapping isn't possible (e.g., empty files), so read the file instead.
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Could not open " + path.string());
+    in.seekg(0, std::ios::end);
+    m_buffer.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_mapped = other.m_mapped;
+#ifdef _WIN32
+        m_file = other.m_file;
+        m_mapping = other.m_mapping;
+        other.m_file = nullptr;
+        other.m_mapping = nullptr;
+#endif
+        // Moving a vector keeps its storage, so m_data stays valid for read-in files.
+        m_buffer = std::move(other.m_buffer);
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_mapped = false;
+    }
+    return *this;
+}
+
+void MappedFile::unmap() {
+    if (m_mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+#else
+        munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+        m_mapped = false;
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_buffer.clear();
+}
+
+const std::byte* MappedFile::data() const {
+    return m_data;
+}
+
+size_t MappedFile::size() const {
+    return m_size;
+}
+
+SceneFile::SceneFile(MappedFile file) : m_file(std::move(file)) {
+    m_data = m_file->data();
+    m_size = m_file->size();
+    validate();
+}
+
+SceneFile::SceneFile(std::vector<std::byte> data) : m_buffer(std::move(data)) {
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    validate();
+}
+
+SceneFile SceneFile::load(const std::filesystem::path& path) {
+    if (path.extension() == ".sceneb")
+        return SceneFile(MappedFile(path));
+
+    std::filesystem::path compiled = path;
+    compiled.replace_extension(".sceneb");
+    std::error_code ec;
+    auto textTime = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        throw std::runtime_error("Could not open " + path.string());
+    auto compiledTime = std::filesystem::last_write_time(compiled, ec);
+    if (!ec && compiledTime >= textTime) {
+        try {
+            return SceneFile(MappedFile(compiled));
+        }
+        catch (std::runtime_error&) {
+            // Written by another version, or damaged; compile it again below.
+        }
+    }
+
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    std::vector<std::byte> data = compileSceneText(text.str(), path.string());
+
+    std::ofstream out(compiled, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!out) {
+        std::cerr << "Could not cache the compiled scene at " << compiled.string() << std::endl;
+    }
+    return SceneFile(std::move(data));
+}
+
+void SceneFile::validate() const {
+    auto fail = [](const std::string& why) {
+        throw std::runtime_error("Invalid scene file: " + why);
+    };
+
+    if (m_size < sizeof(SceneFileHeader) || std::memcmp(m_data, MAGIC, sizeof(MAGIC)) != 0)
+        fail("not a compiled scene");
+    const SceneFileHeader& h = header();
+    if (h.version != SCENE_FILE_VERSION)
+        fail("version " + std::to_string(h.version) + ", expected " + std::to_string(SCENE_FILE_VERSION));
+
+    auto checkSection = [&](const SceneFileSection& s, size_t recordSize) {
+        if (s.offset % 4 != 0 || s.offset > m_size || (m_size - s.offset) / recordSize < s.count)
+            fail("a section lies outside the file");
+    };
+    checkSection(h.nodes, sizeof(SceneFileNode));
+    checkSection(h.textures, sizeof(SceneFileTexture));
+    checkSection(h.animators, sizeof(SceneFileAnimator));
+    checkSection(h.animations, sizeof(SceneFileAnimation));
+    checkSection(h.lights, sizeof(SceneFileLight));
+    checkSection(h.strings, 1);
+    if (h.strings.count == 0 || m_data[h.strings.offset + h.strings.count - 1] != std::byte(0))
+        fail("the string table is not terminated");
+
+    auto checkString = [&](uint32_t offset, bool optional) {
+        if (offset == SCENE_FILE_NONE ? !optional : offset >= h.strings.count)
+            fail("a string lies outside the string table");
+    };
+    checkString(h.vertexShader, false);
+    checkString(h.fragmentShader, true);
+
+    auto nodeList = nodes();
+    for (uint32_t i = 0; i < nodeList.size(); i++) {
+        const SceneFileNode& n = nodeList[i];
+        checkString(n.name, true);
+        checkString(n.model, (n.flags & NODE_SQUARE) != 0);
+        if (n.parent != SCENE_FILE_NONE && n.parent >= i)
+            fail("a node comes before its parent");
+        if (n.firstTexture > h.textures.count || h.textures.count - n.firstTexture < n.textureCount)
+            fail("a node's textures lie outside the texture list");
+    }
+    for (const SceneFileTexture& t : textures()) {
+        checkString(t.path, false);
+        checkString(t.sampler, false);
+    }
+    for (const SceneFileAnimator& a : animators()) {
+        if (a.firstAnimation > h.animations.count || h.animations.count - a.firstAnimation < a.animationCount)
+            fail("an animator's animations lie outside the animation list");
+    }
+    for (const SceneFileAnimation& a : animations()) {
+        if (a.node >= h.nodes.count || a.type > SceneAnimationType::Bezier)
+            fail("an animation has an unknown node or type");
+    }
+    for (const SceneFileLight& l : lights()) {
+        if (l.type > SceneLightType::Spot)
+            fail("a light has an unknown type");
+    }
+}
+
+const SceneFileHeader& SceneFile::header() const {
+    return *reinterpret_cast<const SceneFileHeader*>(m_data);
+}
+
+SceneFileArray<SceneFileNode> SceneFile::nodes() const {
+    return section<SceneFileNode>(header().nodes);
+}
+
+SceneFileArray<SceneFileTexture> SceneFile::textures() const {
+    return section<SceneFileTexture>(header().textures);
+}
+
+SceneFileArray<SceneFileAnimator> SceneFile::animators() const {
+    return section<SceneFileAnimator>(header().animators);
+}
+
+SceneFileArray<SceneFileAnimation> SceneFile::animations() const {
+    return section<SceneFileAnimation>(header().animations);
+}
+
+SceneFileArray<SceneFileLight> SceneFile::lights() const {
+    return section<SceneFileLight>(header().lights);
+}
+
+std::string_view SceneFile::string(uint32_t offset) const {
+    if (offset == SCENE_FILE_NONE)
+        return {};
+    return reinterpret_cast<const char*>(m_data + header().strings.offset + offset);
+}
+
+const Object3D& SceneAssets::model(const std::string& path, bool flipUVCoords, bool keepGeometry) {
+    std::string key = path + (flipUVCoords ? "|flip" : "|") + (keepGeometry ? "|keep" : "|");
+    auto it = m_models.find(key);
+    if (it == m_models.end()) {
+        it = m_models.emplace(key, assimpLoad(path, flipUVCoords, keepGeometry)).first;
+    }
+    return it->second;
+}
+
+Texture SceneAssets::texture(const std::string& path, const std::string& samplerName) {
+    auto it = m_textures.find(path);
+    if (it == m_textures.end()) {
+        StbImage image;
+        image.loadFromFile(path);
+        it = m_textures.emplace(path, Texture::loadImage(image, samplerName)).first;
+    }
+    return Texture{ it->second.textureId, samplerName };
+}
@@ -1,90 +1,41 @@
-#include "ShaderProgram.h"
+#include "ShaderManager.h"
 
 ShaderProgram toonLightingShader() {
-	ShaderProgram shader;
-	try {
-		shader.load("shaders/light_perspective.vert", "shaders/gl_cell_lighting.frag");
-	}
-	catch (std::runtime_error& e) {
-		std::cout << "ERROR: " << e.what() << std::endl;
-		exit(1);
-	}
-	return shader;
+	return ShaderManager::shared().request("shaders/light_perspective.vert", "shaders/gl_cell_lighting.frag");
+}
+
+/**
+ * @brief The toon lighting shader, for drawing InstanceBatches.
+ */
+ShaderProgram toonLightingInstancedShader() {
+	return ShaderManager::shared().request("shaders/light_perspective_instanced.vert", "shaders/gl_cell_lighting.frag");
 }
 
 ShaderProgram FB_simpleShader() {
-    ShaderProgram shader;
-    try {
-        shader.load("shaders/post_process/fb_simple.vert", "shaders/post_process/fb_simple.frag");
-    }
-    catch (std::runtime_error& e) {
-		std::cout << "ERROR: " << e.what() << std::endl;
-        exit(1);
-    }
-    return shader;
+    return ShaderManager::shared().request("shaders/post_process/fb_simple.vert", "shaders/post_process/fb_simple.frag");
 }
 
 ShaderProgram FB_sharpenShader() {
-    ShaderProgram shader;
-    try {
-        shader.load("shaders/post_process/fb_simple.vert", "shaders/post_process/fb_kernel_edge.frag");
-    }
-    catch (std::runtime_error& e) {
-		std::cout << "ERROR: " << e.what() << std::endl;
-        exit(1);
-    }
-    return shader;
+    return ShaderManager::shared().request("shaders/post_process/fb_simple.vert", "shaders/post_process/fb_kernel_edge.frag");
 }
 
 ShaderProgram simpleDepthShader() {
-	ShaderProgram shader;
-	try {
-		shader.load("shaders/simple_depth.vert", "shaders/simple_depth.frag");
-	}
-	catch (std::runtime_error& e) {
-		std::cout << "ERROR: " << e.what() << std::endl;
-		exit(1);
-	}
-	return shader;
+	return ShaderManager::shared().request("shaders/simple_depth.vert", "shaders/simple_depth.frag");
 }
 /**
  * @brief Constructs a shader program that applies the Phong reflection model.
  */
 ShaderProgram phongLightingShader() {
-	ShaderProgram shader;
-	try {
-		shader.load("shaders/light_perspective.vert", "shaders/gl_phong_lighting.frag");
-	}
-	catch (std::runtime_error& e) {
-		std::cout << "ERROR: " << e.what() << std::endl;
-		exit(1);
-	}
-	return shader;
+	return ShaderManager::shared().request("shaders/light_perspective.vert", "shaders/gl_phong_lighting.frag");
 }
 
 /**
  * @brief Constructs a shader program that performs texture mapping with no lighting.
  */
 ShaderProgram texturingShader() {
-	ShaderProgram shader;
-	try {
-		shader.load("shaders/texture_perspective.vert", "shaders/texturing.frag");
-	}
-	catch (std::runtime_error& e) {
-		std::cout << "ERROR: " << e.what() << std::endl;
-		exit(1);
-	}
-	return shader;
+	return ShaderManager::shared().request("shaders/texture_perspective.vert", "shaders/texturing.frag");
 }
 
 ShaderProgram simpleShader() {
-	ShaderProgram shader;
-	try {
-		shader.load("shaders/simple_perspective.vert", "shaders/uniform_color.frag");
-	}
-	catch (std::runtime_error& e) {
-		std::cout << "ERROR: " << e.what() << std::endl;
-		exit(1);
-	}
-	return shader;
+	return ShaderManager::shared().request("shaders/simple_perspective.vert", "shaders/uniform_color.frag");
 }
@@ -0,0 +1,237 @@
+#include "ShaderManager.h"
+#include "ProgramBinaryCache.h"
+#include "GLState.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <glad/glad.h>
+
+namespace {
+    // From GL_KHR_parallel_shader_compile, which glad was not generated with. The ARB version
+    // of the extension uses the same value.
+    constexpr GLenum COMPLETION_STATUS = 0x91B1;
+
+    uint32_t compile(GLenum type, const std::string& source) {
+        uint32_t shader = glCreateShader(type);
+        const char* code = source.c_str();
+        glShaderSource(shader, 1, &code, nullptr);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    std::string shaderLog(uint32_t shader) {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::string log(std::max(length, 1), '\0');
+        glGetShaderInfoLog(shader, static_cast<GLsizei>(log.size()), &length, log.data());
+        log.resize(length);
+        return log;
+    }
+
+    std::string programLog(uint32_t program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string log(std::max(length, 1), '\0');
+        glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), &length, log.data());
+        log.resize(length);
+        return log;
+    }
+
+    std::filesystem::file_time_type writeTime(const std::string& path) {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(path, ec);
+        // A file that is missing for a moment, as while an editor saves it, counts as changed
+        // once it is back.
+        return ec ? std::filesystem::file_time_type::min() : time;
+    }
+}
+
+ShaderManager& ShaderManager::shared() {
+    static ShaderManager manager;
+    return manager;
+}
+
+ShaderProgram ShaderManager::request(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+    const std::string& defines) {
+    Entry& entry = m_entries.emplace_back();
+    entry.vertexPath = vertexShaderPath;
+    entry.fragmentPath = fragmentShaderPath;
+    entry.defines = defines;
+    submit(entry);
+    return entry.program;
+}
+
+ShaderProgram ShaderManager::requestVariant(const ShaderProgram& program, const std::string& defines) {
+    auto it = std::find_if(m_entries.begin(), m_entries.end(), [&](const Entry& entry) {
+        return entry.program == program;
+    });
+    if (it == m_entries.end())
+        throw std::runtime_error("Only programs from the shader manager have variants");
+    // The request may move the entries.
+    std::string vertexPath = it->vertexPath;
+    std::string fragmentPath = it->fragmentPath;
+    return request(vertexPath, fragmentPath, defines);
+}
+
+std::vector<std::string> ShaderManager::files(const ShaderProgram& program) const {
+    for (auto& entry : m_entries) {
+        if (entry.program == program)
+            return entry.files;
+    }
+    return {};
+}
+
+void ShaderManager::update() {
+    auto now = std::chrono::steady_clock::now();
+    if (m_watching && now - m_lastWatch >= WATCH_INTERVAL) {
+        m_lastWatch = now;
+        for (auto& entry : m_entries) {
+            if (!entry.building && changed(entry)) {
+                std::cout << "Reloading " << entry.vertexPath << " + " << entry.fragmentPath << std::endl;
+                m_reloads++;
+                submit(entry);
+            }
+        }
+    }
+
+    // Without the extension, every result waits for the driver, so take one per frame.
+    bool parallel = isParallel();
+    for (auto& entry : m_entries) {
+        if (entry.building && isComplete(entry)) {
+            complete(entry);
+            if (!parallel)
+                break;
+        }
+    }
+}
+
+void ShaderManager::finish() {
+    for (auto& entry : m_entries) {
+        if (entry.building) {
+            complete(entry);
+        }
+    }
+}
+
+void ShaderManager::setWatching(bool watching) {
+    m_watching = watching;
+}
+
+bool ShaderManager::isWatching() const {
+    return m_watching;
+}
+
+ShaderManagerStats ShaderManager::stats() const {
+    ShaderManagerStats stats;
+    stats.programs = static_cast<uint32_t>(m_entries.size());
+    for (auto& entry : m_entries) {
+        stats.pending += entry.building;
+    }
+    stats.reloads = m_reloads;
+    stats.failures = m_failures;
+    return stats;
+}
+
+bool ShaderManager::isParallel() {
+    if (!m_checked) {
+        m_checked = true;
+        // The driver picks how many compiler threads to use.
+        m_parallel = GLState::hasExtension("GL_KHR_parallel_shader_compile")
+            || GLState::hasExtension("GL_ARB_parallel_shader_compile");
+    }
+    return m_parallel;
+}
+
+void ShaderManager::submit(Entry& entry) {
+    std::vector<std::string> files;
+    std::string vertexCode;
+    std::string fragmentCode;
+    bool read = true;
+    try {
+        vertexCode = ShaderProgram::readSource(entry.vertexPath, &files, entry.defines);
+        fragmentCode = ShaderProgram::readSource(entry.fragmentPath, &files, entry.defines);
+    }
+    catch (std::runtime_error& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        m_failures++;
+        read = false;
+        // Watch both shaders, in case the one that failed is missing.
+        files.push_back(entry.vertexPath);
+        files.push_back(entry.fragmentPath);
+    }
+    entry.files = std::move(files);
+    entry.writeTimes.clear();
+    for (auto& file : entry.files) {
+        entry.writeTimes.push_back(writeTime(file));
+    }
+    if (!read)
+        return;
+
+    ProgramBinaryCache& cache = ProgramBinaryCache::shared();
+    uint64_t cacheKey = cache.key(vertexCode, fragmentCode, entry.defines);
+    uint32_t cachedId = cache.load(cacheKey);
+    if (cachedId != 0) {
+        entry.program.adopt(cachedId);
+        return;
+    }
+
+    // Nothing here asks for a result, so the driver can work on it while other builds are
+    // submitted.
+    Build build{ compile(GL_VERTEX_SHADER, vertexCode), compile(GL_FRAGMENT_SHADER, fragmentCode),
+        glCreateProgram(), cacheKey };
+    glAttachShader(build.program, build.vertex);
+    glAttachShader(build.program, build.fragment);
+    cache.prepare(build.program);
+    glLinkProgram(build.program);
+    entry.build = build;
+    entry.building = true;
+}
+
+bool ShaderManager::isComplete(const Entry& entry) const {
+    if (!m_parallel)
+        return true;
+    GLint complete = GL_FALSE;
+    glGetProgramiv(entry.build.program, COMPLETION_STATUS, &complete);
+    return complete;
+}
+
+void ShaderManager::complete(Entry& entry) {
+    const Build& build = entry.build;
+    entry.building = false;
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+    if (linked) {
+        // The shaders go with the program.
+        glDeleteShader(build.vertex);
+        glDeleteShader(build.fragment);
+        ProgramBinaryCache::shared().store(build.cacheKey, build.program);
+        entry.program.adopt(build.program);
+        return;
+    }
+
+    std::string log;
+    for (uint32_t shader : { build.vertex, build.fragment }) {
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            log += shaderLog(shader);
+        }
+    }
+    if (log.empty()) {
+        log = programLog(build.program);
+    }
+    std::cout << "ERROR: " << entry.vertexPath << " + " << entry.fragmentPath << ": " << log << std::endl;
+    m_failures++;
+    glDeleteShader(build.vertex);
+    glDeleteShader(build.fragment);
+    glDeleteProgram(build.program);
+}
+
+bool ShaderManager::changed(const Entry& entry) const {
+    for (size_t i = 0; i < entry.files.size(); i++) {
+        if (writeTime(entry.files[i]) != entry.writeTimes[i])
+            return true;
+    }
+    return false;
+}
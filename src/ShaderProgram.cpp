@@ -1,11 +1,126 @@
 #include "ShaderProgram.h"
+#include "GLState.h"
+#include "ProgramBinaryCache.h"
 #include <glad/glad.h>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+    // The program most recently made current by activate(); uniforms are only shadowed for it.
+    uint32_t activeProgram = static_cast<uint32_t>(-1);
+
+    // Uniform blocks shared between programs, bound by name to their fixed binding points
+    // whenever a program is linked.
+    const std::pair<const char*, UniformBlockBinding> sharedBlocks[] = {
+        { "FrameData", FRAME_UNIFORMS_BINDING },
+    };
+
+    // Likewise for samplers shared between programs, set to their fixed units.
+    const std::pair<const char*, SharedTextureUnit> sharedSamplers[] = {
+        { "clusterLights", CLUSTER_LIGHTS_UNIT },
+        { "clusterRanges", CLUSTER_RANGES_UNIT },
+        { "clusterIndices", CLUSTER_INDICES_UNIT },
+        { "shadowAtlas", SHADOW_ATLAS_UNIT },
+    };
+
+    /**
+     * @brief Replaces each `#include "file"` line, which GLSL itself lacks, with the contents
+     * of the file, relative to the including shader's directory.
+     */
+    std::string expandIncludes(const std::string& source, const std::filesystem::path& path,
+        std::vector<std::string>* files, int depth = 0)
+    {
+        if (depth > 8)
+            throw std::runtime_error("Shader includes nested too deeply in " + path.string());
+
+        std::istringstream lines(source);
+        std::string expanded;
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+                size_t open = line.find('"', start);
+                size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+                if (close == std::string::npos)
+                    throw std::runtime_error("Malformed #include in " + path.string() + ": " + line);
+
+                std::filesystem::path included = path.parent_path() / line.substr(open + 1, close - open - 1);
+                std::ifstream file(included);
+                if (!file)
+                    throw std::runtime_error("Failed to locate shader include " + included.string());
+                std::stringstream contents;
+                contents << file.rdbuf();
+                if (files != nullptr) {
+                    files->push_back(included.string());
+                }
+                expanded += expandIncludes(contents.str(), included, files, depth + 1);
+            }
+            else {
+                expanded += line;
+                expanded += '\n';
+            }
+        }
+        return expanded;
+    }
+
+    void uploadValue(int32_t location, int32_t value) {
+        glUniform1i(location, value);
+    }
+
+    void uploadValue(int32_t location, float value) {
+        glUniform1f(location, value);
+    }
+
+    void uploadValue(int32_t location, const glm::vec2& value) {
+        glUniform2fv(location, 1, &value[0]);
+    }
+
+    void uploadValue(int32_t location, const glm::vec3& value) {
+        glUniform3fv(location, 1, &value[0]);
+    }
+
+    void uploadValue(int32_t location, const glm::vec4& value) {
+        glUniform4fv(location, 1, &value[0]);
+    }
+
+    void uploadValue(int32_t location, const glm::mat2& value) {
+        glUniformMatrix2fv(location, 1, false, &value[0][0]);
+    }
+
+    void uploadValue(int32_t location, const glm::mat3& value) {
+        glUniformMatrix3fv(location, 1, false, &value[0][0]);
+    }
+
+    void uploadValue(int32_t location, const glm::mat4& value) {
+        glUniformMatrix4fv(location, 1, false, &value[0][0]);
+    }
+
+    // Uploads a shadowed value, as the type GL reports for its uniform.
+    void uploadStored(int32_t location, uint32_t type, const std::byte* value) {
+        auto as = [value](auto stored) {
+            std::memcpy(&stored, value, sizeof(stored));
+            return stored;
+        };
+        switch (type) {
+        case GL_FLOAT: uploadValue(location, as(float())); break;
+        case GL_FLOAT_VEC2: uploadValue(location, as(glm::vec2())); break;
+        case GL_FLOAT_VEC3: uploadValue(location, as(glm::vec3())); break;
+        case GL_FLOAT_VEC4: uploadValue(location, as(glm::vec4())); break;
+        case GL_FLOAT_MAT2: uploadValue(location, as(glm::mat2())); break;
+        case GL_FLOAT_MAT3: uploadValue(location, as(glm::mat3())); break;
+        case GL_FLOAT_MAT4: uploadValue(location, as(glm::mat4())); break;
+        // Ints, bools and samplers, which are all set with glUniform1i.
+        default: uploadValue(location, as(int32_t())); break;
+        }
+    }
+}
 
 ShaderProgram::ShaderProgram()
-    : m_programId(-1) {
+    : m_state(std::make_shared<State>()) {
 
 }
 
@@ -13,32 +128,17 @@ ShaderProgram::ShaderProgram()
 
 void ShaderProgram::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath)
 {
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-        // open files
-        vShaderFile.open(vertexShaderPath);
-        fShaderFile.open(fragmentShaderPath);
-        std::stringstream vShaderStream, fShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    }
-    catch (std::ifstream::failure& e)
-    {
-        throw std::runtime_error("Failed to locate vertex or fragment shader files");
+    std::string vertexCode = readSource(vertexShaderPath);
+    std::string fragmentCode = readSource(fragmentShaderPath);
+
+    // A program linked from these exact sources before, by this driver, may be cached.
+    ProgramBinaryCache& cache = ProgramBinaryCache::shared();
+    uint64_t cacheKey = cache.key(vertexCode, fragmentCode, "");
+    uint32_t cachedId = cache.load(cacheKey);
+    if (cachedId != 0) {
+        m_state->programId = cachedId;
+        buildUniformTable();
+        return;
     }
 
     const char* vShaderCode = vertexCode.c_str();
@@ -73,69 +173,343 @@ void ShaderProgram::load(const std::string& vertexShaderPath, const std::string&
     };
 
     // shader Program
-    m_programId = glCreateProgram();
-    glAttachShader(m_programId, vertex);
-    glAttachShader(m_programId, fragment);
-    glLinkProgram(m_programId);
+    uint32_t programId = glCreateProgram();
+    m_state->programId = programId;
+    glAttachShader(programId, vertex);
+    glAttachShader(programId, fragment);
+    cache.prepare(programId);
+    glLinkProgram(programId);
     // print linking errors if any
-    glGetProgramiv(m_programId, GL_LINK_STATUS, &success);
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
     if (!success)
     {
-        glGetProgramInfoLog(m_programId, 512, NULL, infoLog);
+        glGetProgramInfoLog(programId, 512, NULL, infoLog);
         throw std::runtime_error(infoLog);
     }
 
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    cache.store(cacheKey, programId);
+    buildUniformTable();
+}
+
+std::string ShaderProgram::readSource(const std::string& path, std::vector<std::string>* files,
+    std::string_view defines)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Failed to locate shader file " + path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    if (files != nullptr) {
+        files->push_back(path);
+    }
+    std::string source = expandIncludes(contents.str(), path, files);
+    if (!defines.empty()) {
+        // GLSL only allows comments and whitespace before #version.
+        // Every line of an expanded source ends in a newline.
+        size_t version = source.find("#version");
+        size_t insert = version == std::string::npos ? 0 : source.find('\n', version) + 1;
+        std::string lines(defines);
+        if (lines.back() != '\n') {
+            lines += '\n';
+        }
+        source.insert(insert, lines);
+    }
+    return source;
+}
+
+void ShaderProgram::adopt(uint32_t programId)
+{
+    State& state = *m_state;
+    // The values set so far, to set again in the new program.
+    std::vector<std::pair<std::string, Uniform>> values;
+    for (auto& [name, index] : state.indices) {
+        if (state.uniforms[index].known) {
+            values.emplace_back(name, state.uniforms[index]);
+        }
+    }
+
+    // Building the table may make the program current.
+    uint32_t previous = activeProgram;
+    uint32_t oldId = state.programId;
+    state.programId = programId;
+    buildUniformTable();
+    if (oldId != 0 && oldId != programId) {
+        GLState::shared().deleteProgram(oldId);
+    }
+
+    if (!values.empty()) {
+        GLState::shared().useProgram(programId);
+        activeProgram = programId;
+        for (auto& [name, value] : values) {
+            auto it = state.indices.find(name);
+            if (it == state.indices.end() || state.uniforms[it->second].type != value.type)
+                continue;
+            Uniform& uniform = state.uniforms[it->second];
+            uploadStored(uniform.location, uniform.type, value.value);
+            std::memcpy(uniform.value, value.value, sizeof(uniform.value));
+            uniform.known = true;
+        }
+    }
+    // A program that was active stays active, as its replacement.
+    if (previous != oldId && previous != static_cast<uint32_t>(-1) && previous != activeProgram) {
+        GLState::shared().useProgram(previous);
+        activeProgram = previous;
+    }
+}
+
+/**
+ * @brief Enumerates the program's active uniforms into the table that setUniform() reads,
+ * and its attributes, and binds its shared uniform blocks and samplers. Uniforms inside blocks have no location and are left
+ * out of the table.
+ */
+void ShaderProgram::buildUniformTable()
+{
+    State& state = *m_state;
+    state.uniforms.clear();
+    state.indices.clear();
+    state.attributes.clear();
+
+    int32_t count = 0;
+    int32_t maxLength = 0;
+    glGetProgramiv(state.programId, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(state.programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> nameBuffer(std::max(maxLength, 1));
+
+    auto add = [&](const std::string& name, int32_t location, uint32_t type) {
+        state.indices.emplace(name, static_cast<int32_t>(state.uniforms.size()));
+        state.uniforms.push_back({ location, type, false, {} });
+    };
+
+    int32_t attributeCount = 0;
+    int32_t maxAttributeLength = 0;
+    glGetProgramiv(state.programId, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+    glGetProgramiv(state.programId, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxAttributeLength);
+    std::vector<char> attributeName(std::max(maxAttributeLength, 1));
+    for (int32_t i = 0; i < attributeCount; i++) {
+        int32_t size = 0;
+        GLenum type = 0;
+        GLsizei length = 0;
+        glGetActiveAttrib(state.programId, i, static_cast<GLsizei>(attributeName.size()), &length, &size, &type,
+            attributeName.data());
+        std::string name(attributeName.data(), length);
+        state.attributes.emplace(name, glGetAttribLocation(state.programId, name.c_str()));
+    }
+
+    int32_t blockCount = 0;
+    int32_t maxBlockLength = 0;
+    glGetProgramiv(state.programId, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    glGetProgramiv(state.programId, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockLength);
+    std::vector<char> blockName(std::max(maxBlockLength, 1));
+    for (int32_t i = 0; i < blockCount; i++) {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(state.programId, i, static_cast<GLsizei>(blockName.size()), &length,
+            blockName.data());
+        for (auto& [name, binding] : sharedBlocks) {
+            if (std::string_view(blockName.data(), length) == name) {
+                glUniformBlockBinding(state.programId, i, binding);
+            }
+        }
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        int32_t size = 0;
+        GLenum type = 0;
+        GLsizei length = 0;
+        glGetActiveUniform(state.programId, i, static_cast<GLsizei>(nameBuffer.size()), &length, &size, &type,
+            nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        int32_t location = glGetUniformLocation(state.programId, name.c_str());
+        if (location < 0)
+            continue;
+
+        // Arrays are reported by their first element, as "name[0]". Every element gets its own
+        // entry, and the bare name refers to the first one, as it does in GL.
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            std::string base = name.substr(0, name.size() - 3);
+            add(name, location, type);
+            state.indices.emplace(base, state.indices.at(name));
+            for (int32_t element = 1; element < size; element++) {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                add(elementName, glGetUniformLocation(state.programId, elementName.c_str()), type);
+            }
+        }
+        else {
+            add(name, location, type);
+        }
+    }
+
+    // Samplers start out on unit 0, and GL refuses to draw with samplers of different types on
+    // one unit. Setting them takes making the program current.
+    for (auto& [name, unit] : sharedSamplers) {
+        auto it = state.indices.find(name);
+        if (it != state.indices.end()) {
+            activate();
+            upload(it->second, static_cast<int32_t>(unit));
+        }
+    }
+}
+
+int32_t ShaderProgram::indexOf(std::string_view uniformName) const
+{
+    stats().locationLookupsSaved++;
+    auto it = m_state->indices.find(uniformName);
+    return it == m_state->indices.end() ? -1 : it->second;
+}
+
+template <typename T>
+void ShaderProgram::upload(int32_t index, const T& value)
+{
+    if (index < 0)
+        return;
+
+    Uniform& uniform = m_state->uniforms[index];
+    bool active = activeProgram == m_state->programId;
+    static_assert(sizeof(T) <= sizeof(uniform.value), "uniform values fit in the shadow");
+    if (active && uniform.known && std::memcmp(uniform.value, &value, sizeof(T)) == 0) {
+        stats().skippedUploads++;
+        return;
+    }
+
+    uploadValue(uniform.location, value);
+    stats().uploads++;
+    // A value set while another program is active went to that program instead, as in GL.
+    if (active) {
+        std::memcpy(uniform.value, &value, sizeof(T));
+        uniform.known = true;
+    }
 }
 
 void ShaderProgram::activate()
 {
-    glUseProgram(m_programId);
+    GLState::shared().useProgram(m_state->programId);
+    activeProgram = m_state->programId;
+}
+
+uint32_t ShaderProgram::getId() const
+{
+    return m_state->programId;
+}
+
+bool ShaderProgram::operator==(const ShaderProgram& other) const
+{
+    return m_state == other.m_state;
+}
+
+UniformHandle ShaderProgram::uniform(std::string_view uniformName) const
+{
+    auto it = m_state->indices.find(uniformName);
+    return { it == m_state->indices.end() ? -1 : it->second };
+}
+
+int32_t ShaderProgram::attributeLocation(std::string_view attributeName) const
+{
+    auto it = m_state->attributes.find(attributeName);
+    return it == m_state->attributes.end() ? -1 : it->second;
+}
+
+void ShaderProgram::invalidateUniforms()
+{
+    for (auto& uniform : m_state->uniforms) {
+        uniform.known = false;
+    }
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, bool value)
+{
+    upload(indexOf(uniformName), static_cast<int32_t>(value));
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, int32_t value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, float value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, const glm::vec2& value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, const glm::vec3& value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, const glm::vec4& value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, const glm::mat2& value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, const glm::mat3& value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(std::string_view uniformName, const glm::mat4& value)
+{
+    upload(indexOf(uniformName), value);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, bool value)
+{
+    upload(uniform.index, static_cast<int32_t>(value));
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, bool value)
+void ShaderProgram::setUniform(UniformHandle uniform, int32_t value)
 {
-    glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), (int32_t)value);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, int32_t value)
+void ShaderProgram::setUniform(UniformHandle uniform, float value)
 {
-    glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), value);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, float value)
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec2& value)
 {
-    glUniform1f(glGetUniformLocation(m_programId, uniformName.c_str()), (int)value);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec2& value)
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec3& value)
 {
-    glUniform2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec3& value)
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec4& value)
 {
-    glUniform3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec4& value)
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat2& value)
 {
-    glUniform4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat2& value)
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat3& value)
 {
-    glUniformMatrix2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat3& value)
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat4& value)
 {
-    glUniformMatrix3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    upload(uniform.index, value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat4& value)
+UniformStats& ShaderProgram::stats()
 {
-    glUniformMatrix4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    static UniformStats stats;
+    return stats;
 }
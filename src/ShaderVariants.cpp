@@ -0,0 +1,110 @@
+#include "ShaderVariants.h"
+#include "FrameUniforms.h"
+#include "ShaderManager.h"
+#include <filesystem>
+
+namespace {
+    bool hasColor(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular) {
+        return ambient != glm::vec3(0.f) || diffuse != glm::vec3(0.f) || specular != glm::vec3(0.f);
+    }
+}
+
+ShaderVariants::ShaderVariants(ShaderProgram program)
+    : m_program(program) {
+}
+
+bool ShaderVariants::supports(const ShaderProgram& program) {
+    for (auto& file : ShaderManager::shared().files(program)) {
+        if (std::filesystem::path(file).filename() == "features.glsl")
+            return true;
+    }
+    return false;
+}
+
+uint32_t ShaderVariants::materialFeatures(const std::vector<Texture>& textures) {
+    uint32_t features = 0;
+    for (auto& texture : textures) {
+        if (texture.samplerName == "material.normal") {
+            features |= FEATURE_NORMAL_MAP;
+        }
+        else if (texture.samplerName == "material.specular") {
+            features |= FEATURE_SPECULAR_MAP;
+        }
+    }
+    return features;
+}
+
+uint32_t ShaderVariants::lightFeatures(const FrameData& frame) {
+    uint32_t features = 0;
+    if (hasColor(frame.dirLight.ambient, frame.dirLight.diffuse, frame.dirLight.specular)) {
+        features |= FEATURE_DIR_LIGHT;
+    }
+    if (hasColor(frame.pointLight.ambient, frame.pointLight.diffuse, frame.pointLight.specular)) {
+        features |= FEATURE_POINT_LIGHT;
+    }
+    if (hasColor(frame.spotLight.ambient, frame.spotLight.diffuse, frame.spotLight.specular)) {
+        features |= FEATURE_SPOT_LIGHT;
+    }
+    if (frame.clusterGrid.w != 0) {
+        features |= FEATURE_CLUSTER_LIGHTS;
+    }
+    if (frame.shadowFlags.x != 0 || frame.shadowFlags.y != 0 || frame.shadowFlags.z != 0) {
+        features |= FEATURE_SHADOWS;
+    }
+    return features;
+}
+
+std::string ShaderVariants::defines(uint32_t features) {
+    // VARIANT keeps features.glsl from turning every feature on.
+    std::string lines = "#define VARIANT\n";
+    if (features & FEATURE_NORMAL_MAP) {
+        lines += "#define HAS_NORMAL_MAP\n";
+    }
+    if (features & FEATURE_SPECULAR_MAP) {
+        lines += "#define HAS_SPECULAR_MAP\n";
+    }
+    if (features & FEATURE_DIR_LIGHT) {
+        lines += "#define HAS_DIR_LIGHT\n";
+    }
+    lines += (features & FEATURE_POINT_LIGHT) ? "#define NUM_POINT_LIGHTS 1\n" : "#define NUM_POINT_LIGHTS 0\n";
+    if (features & FEATURE_SPOT_LIGHT) {
+        lines += "#define HAS_SPOT_LIGHT\n";
+    }
+    if (features & FEATURE_CLUSTER_LIGHTS) {
+        lines += "#define HAS_CLUSTER_LIGHTS\n";
+    }
+    if (features & FEATURE_SHADOWS) {
+        lines += "#define HAS_SHADOWS\n";
+    }
+    return lines;
+}
+
+const ShaderProgram& ShaderVariants::program() const {
+    return m_program;
+}
+
+void ShaderVariants::setLights(uint32_t lightFeatures) {
+    m_lights = lightFeatures & FEATURE_LIGHTS;
+}
+
+ShaderProgram& ShaderVariants::select(uint32_t materialFeatures) {
+    uint32_t features = (materialFeatures & FEATURE_MATERIAL) | m_lights;
+    if (features == FEATURE_ALL)
+        return m_program;
+
+    auto it = m_variants.find(features);
+    if (it == m_variants.end()) {
+        it = m_variants.emplace(features, ShaderManager::shared().requestVariant(m_program, defines(features))).first;
+    }
+    // Until the variant links, its program is 0.
+    return it->second.getId() != 0 ? it->second : m_program;
+}
+
+ShaderVariantStats ShaderVariants::stats() const {
+    ShaderVariantStats stats;
+    stats.variants = static_cast<uint32_t>(m_variants.size());
+    for (auto& [features, variant] : m_variants) {
+        stats.pending += variant.getId() == 0;
+    }
+    return stats;
+}
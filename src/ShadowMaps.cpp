@@ -0,0 +1,470 @@
+#include "ShadowMaps.h"
+#include "Frustum.h"
+#include "GLState.h"
+#include "ShaderManager.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <glad/glad.h>
+
+namespace {
+    // The atlas is four tiles wide: the cascades along the bottom, then the point light's faces
+    // in a block of three by two, with the spot light beside them.
+    constexpr uint32_t ATLAS_WIDTH = 4 * ShadowMaps::TILE_SIZE;
+    constexpr uint32_t ATLAS_HEIGHT = 3 * ShadowMaps::TILE_SIZE;
+
+    // How the cascade splits go from evenly spaced (0) to logarithmic (1). Logarithmic splits
+    // give each cascade texels as dense on screen as the last, but leave the first one tiny.
+    constexpr float SPLIT_BLEND = 0.75f;
+    // The near plane of the spot and point light maps.
+    constexpr float LIGHT_NEAR = 0.05f;
+    // The widest spot light map, in degrees; wider cones are shadowed only within it.
+    constexpr float MAX_SPOT_ANGLE = 150.f;
+    // Depth bias in the maps, scaled by a caster's slope and in depth buffer steps.
+    constexpr float SLOPE_BIAS = 2.f;
+    constexpr float CONSTANT_BIAS = 4.f;
+
+    uint32_t createAtlas(bool compare) {
+        uint32_t texture;
+        glGenTextures(1, &texture);
+        GLState::shared().bindTexture(0, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_DEPTH_COMPONENT,
+            GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (compare) {
+            // Lookups compare against the stored depth, and linear filtering blends the four
+            // nearest results.
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        else {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        return texture;
+    }
+
+    uint32_t createDepthFramebuffer(uint32_t depth) {
+        uint32_t framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        GLState::shared().bindFramebuffer(framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERROR: shadow atlas framebuffer incomplete!" << std::endl;
+        }
+        return framebuffer;
+    }
+
+    // Takes clip space to a tile of the atlas: texture coordinates in xy, depth in z.
+    glm::mat4 atlasMatrix(glm::ivec2 tile) {
+        glm::vec2 size(float(ShadowMaps::TILE_SIZE) / ATLAS_WIDTH, float(ShadowMaps::TILE_SIZE) / ATLAS_HEIGHT);
+        glm::mat4 matrix(1.f);
+        matrix[0][0] = 0.5f * size.x;
+        matrix[1][1] = 0.5f * size.y;
+        matrix[2][2] = 0.5f;
+        matrix[3] = glm::vec4(float(tile.x) / ATLAS_WIDTH + 0.5f * size.x, float(tile.y) / ATLAS_HEIGHT + 0.5f * size.y,
+            0.5f, 1.f);
+        return matrix;
+    }
+
+    // An up vector for looking along the direction.
+    glm::vec3 upFor(const glm::vec3& direction) {
+        return std::abs(direction.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+    }
+
+    // Whether the sphere may reach the view. Depth clamping keeps casters in front of the near
+    // plane, so with it, the near plane culls nothing.
+    bool reaches(const Frustum& frustum, const BoundingSphere& sphere, bool depthClamp) {
+        if (sphere.isEmpty())
+            return false;
+        for (int i = 0; i < 6; i++) {
+            if (depthClamp && i == 4)
+                continue;
+            const glm::vec4& plane = frustum.planes[i];
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        }
+        return true;
+    }
+
+    uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        // FNV-1a.
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+}
+
+ShadowMaps::ShadowMaps()
+    : m_depthProgram(ShaderManager::shared().request("shaders/simple_depth.vert", "shaders/simple_depth.frag")) {
+    m_atlas = createAtlas(true);
+    m_atlasFbo = createDepthFramebuffer(m_atlas);
+    m_cache = createAtlas(false);
+    m_cacheFbo = createDepthFramebuffer(m_cache);
+    GLState::shared().bindFramebuffer(0);
+
+    for (auto& queries : m_queries) {
+        glGenQueries(VIEWS, queries);
+    }
+}
+
+ShadowMaps::~ShadowMaps() {
+    for (auto& queries : m_queries) {
+        glDeleteQueries(VIEWS, queries);
+    }
+    GLState& state = GLState::shared();
+    state.deleteFramebuffer(m_cacheFbo);
+    state.deleteFramebuffer(m_atlasFbo);
+    state.deleteTexture(m_cache);
+    state.deleteTexture(m_atlas);
+}
+
+void ShadowMaps::setDistance(float distance) {
+    m_distance = distance;
+}
+
+void ShadowMaps::setSpotShadows(bool enabled) {
+    m_spotShadows = enabled;
+}
+
+void ShadowMaps::setPointShadows(bool enabled) {
+    m_pointShadows = enabled;
+}
+
+glm::ivec2 ShadowMaps::tileOf(uint32_t view) {
+    if (view < SPOT_VIEW)
+        return glm::ivec2(view * TILE_SIZE, 0);
+    if (view == SPOT_VIEW)
+        return glm::ivec2(3 * TILE_SIZE, TILE_SIZE);
+    uint32_t face = view - POINT_VIEW;
+    return glm::ivec2(face % 3 * TILE_SIZE, (1 + face / 3) * TILE_SIZE);
+}
+
+void ShadowMaps::gatherCasters(const ObjectPool& objects) {
+    if (m_objects.size() < objects.capacity()) {
+        m_objects.resize(objects.capacity());
+    }
+    for (auto& state : m_objects) {
+        state.seen = false;
+    }
+    m_staticCasters.clear();
+    m_dynamicCasters.clear();
+
+    for (auto it = objects.begin(); it != objects.end(); ++it) {
+        ObjectHandle handle = it.handle();
+        ObjectState& state = m_objects[handle.index];
+        if (!state.present || state.generation != handle.generation) {
+            // A static object destroyed since last frame, its slot already reused.
+            if (state.present && state.isStatic) {
+                m_staticChanged = true;
+            }
+            state = ObjectState();
+            state.generation = handle.generation;
+            state.present = true;
+        }
+        state.seen = true;
+
+        // The meshes and where they are, hashed to tell whether anything moved.
+        m_objectCasters.clear();
+        uint64_t transforms = 14695981039346656037ull;
+        it->forEachMesh([&](const MeshHandle& mesh, const glm::mat4& model) {
+            m_objectCasters.push_back({ mesh.get(), model, mesh->getBoundingSphere().transformed(model) });
+            const Mesh3D* pointer = mesh.get();
+            transforms = hashBytes(transforms, &pointer, sizeof(pointer));
+            transforms = hashBytes(transforms, &model, sizeof(model));
+        });
+
+        if (transforms != state.transforms) {
+            state.transforms = transforms;
+            state.stillFrames = 0;
+            if (state.isStatic) {
+                state.isStatic = false;
+                m_staticChanged = true;
+            }
+        }
+        else if (!state.isStatic && ++state.stillFrames >= SETTLE_FRAMES) {
+            state.isStatic = true;
+            m_staticChanged = true;
+        }
+
+        std::vector<Caster>& casters = state.isStatic ? m_staticCasters : m_dynamicCasters;
+        casters.insert(casters.end(), m_objectCasters.begin(), m_objectCasters.end());
+    }
+
+    for (auto& state : m_objects) {
+        if (state.present && !state.seen) {
+            if (state.isStatic) {
+                m_staticChanged = true;
+            }
+            state.present = false;
+        }
+    }
+
+    // Meshes of one arena page share a vertex array, which is then bound once.
+    auto byVertexArray = [](const Caster& a, const Caster& b) {
+        return a.mesh->getVertexArray() < b.mesh->getVertexArray();
+    };
+    std::sort(m_staticCasters.begin(), m_staticCasters.end(), byVertexArray);
+    std::sort(m_dynamicCasters.begin(), m_dynamicCasters.end(), byVertexArray);
+}
+
+void ShadowMaps::fitCascades(FrameData& frame) {
+    const FrameDirLight& light = frame.dirLight;
+    bool lit = glm::dot(light.diffuse, light.diffuse) + glm::dot(light.specular, light.specular) > 0.f;
+    if (!lit || glm::dot(light.direction, light.direction) == 0.f)
+        return;
+
+    // The planes of a glm::perspective() projection, and the frustum's spread: a corner's
+    // squared distance from the view axis, per squared unit of depth.
+    const glm::mat4& projection = frame.projection;
+    float near = projection[3][2] / (projection[2][2] - 1.f);
+    float far = std::min(projection[3][2] / (projection[2][2] + 1.f), m_distance);
+    float spread = 1.f / (projection[0][0] * projection[0][0]) + 1.f / (projection[1][1] * projection[1][1]);
+    if (far <= near)
+        return;
+
+    glm::vec3 direction = glm::normalize(light.direction);
+    glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.f), direction, upFor(direction));
+    glm::mat4 inverseView = glm::inverse(frame.view);
+
+    // Every static caster must be in front of the far plane and, to be kept from being
+    // clipped, behind the near plane; dynamic ones in front are clamped instead, so that they
+    // cannot change the projection.
+    float casterNear = std::numeric_limits<float>::max();
+    float casterFar = std::numeric_limits<float>::lowest();
+    for (auto& caster : m_staticCasters) {
+        float depth = -(lightRotation * glm::vec4(caster.sphere.center, 1.f)).z;
+        casterNear = std::min(casterNear, depth - caster.sphere.radius);
+        casterFar = std::max(casterFar, depth + caster.sphere.radius);
+    }
+
+    float sliceStart = near;
+    for (uint32_t i = 0; i < SHADOW_CASCADES; i++) {
+        float t = float(i + 1) / SHADOW_CASCADES;
+        float sliceEnd = SPLIT_BLEND * near * std::pow(far / near, t) + (1.f - SPLIT_BLEND) * (near + (far - near) * t);
+
+        // The smallest sphere around the slice is centered on the view axis, as far along as
+        // its near and far corners allow.
+        float center = std::min((sliceStart + sliceEnd) * 0.5f * (1.f + spread), sliceEnd);
+        float radius = std::sqrt((sliceEnd - center) * (sliceEnd - center) + spread * sliceEnd * sliceEnd);
+        // Moving the cascade by up to a step must still cover the sphere; a step is an eighth
+        // of the width, TILE_SIZE / 8 texels.
+        float halfWidth = radius * 4.f / 3.f;
+        float step = halfWidth / 4.f;
+
+        glm::vec3 sphereCenter = glm::vec3(inverseView * glm::vec4(0.f, 0.f, -center, 1.f));
+        glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(sphereCenter, 1.f));
+        lightCenter = glm::floor(lightCenter / step) * step;
+        float depth = -lightCenter.z;
+
+        View& view = m_views[i];
+        glm::mat4 orthographic = glm::ortho(lightCenter.x - halfWidth, lightCenter.x + halfWidth,
+            lightCenter.y - halfWidth, lightCenter.y + halfWidth,
+            std::min(depth - halfWidth, casterNear), std::max(depth + halfWidth, casterFar));
+        view.matrix = orthographic * lightRotation;
+        view.active = true;
+        view.depthClamp = true;
+
+        frame.cascadeMatrices[i] = atlasMatrix(tileOf(i)) * view.matrix;
+        frame.cascadeSplits[i] = sliceEnd;
+        frame.cascadeTexels[i] = 2.f * halfWidth / TILE_SIZE;
+        sliceStart = sliceEnd;
+    }
+    frame.shadowFlags.x = SHADOW_CASCADES;
+}
+
+void ShadowMaps::fitLights(FrameData& frame) {
+    const FrameSpotLight& spot = frame.spotLight;
+    float spotRadius = lightRadius(spot);
+    if (m_spotShadows && spotRadius > LIGHT_NEAR && glm::dot(spot.direction, spot.direction) > 0.f) {
+        // A little wider than the cone, so lookups at its edge stay on the tile.
+        float angle = 2.f * std::acos(std::clamp(spot.outerCutOff, -1.f, 1.f)) * 1.05f;
+        angle = std::min(angle, glm::radians(MAX_SPOT_ANGLE));
+        glm::vec3 direction = glm::normalize(spot.direction);
+
+        View& view = m_views[SPOT_VIEW];
+        view.matrix = glm::perspective(angle, 1.f, LIGHT_NEAR, spotRadius)
+            * glm::lookAt(spot.position, spot.position + direction, upFor(direction));
+        view.active = true;
+        view.depthClamp = false;
+
+        frame.spotShadowMatrix = atlasMatrix(tileOf(SPOT_VIEW)) * view.matrix;
+        frame.shadowTexels.x = 2.f * std::tan(angle / 2.f) / TILE_SIZE;
+        frame.shadowFlags.y = 1;
+    }
+
+    const FramePointLight& point = frame.pointLight;
+    float pointRadius = lightRadius(point);
+    if (m_pointShadows && pointRadius > LIGHT_NEAR) {
+        // Each face looks along one axis, either way, with the next two axes across it, as
+        // pointShadow() in shaders/shadows.glsl projects them. Some faces are mirrored, which
+        // does not matter with culling off.
+        float near = LIGHT_NEAR;
+        float far = pointRadius;
+        glm::mat4 toLight = glm::translate(glm::mat4(1.f), -point.position);
+        for (uint32_t face = 0; face < 6; face++) {
+            uint32_t axis = face / 2;
+            float sign = face % 2 ? -1.f : 1.f;
+            glm::mat4 projection(0.f);
+            projection[(axis + 1) % 3][0] = 1.f;
+            projection[(axis + 2) % 3][1] = 1.f;
+            projection[axis][2] = sign * (far + near) / (far - near);
+            projection[3][2] = -2.f * far * near / (far - near);
+            projection[axis][3] = sign;
+
+            View& view = m_views[POINT_VIEW + face];
+            view.matrix = projection * toLight;
+            view.active = true;
+            view.depthClamp = false;
+        }
+
+        glm::ivec2 corner = tileOf(POINT_VIEW);
+        frame.pointShadowTile = glm::vec4(float(corner.x) / ATLAS_WIDTH, float(corner.y) / ATLAS_HEIGHT,
+            float(TILE_SIZE) / ATLAS_WIDTH, float(TILE_SIZE) / ATLAS_HEIGHT);
+        // A face spans 90 degrees: two units across, one unit away.
+        frame.shadowTexels.y = 2.f / TILE_SIZE;
+        frame.shadowTexels.z = near;
+        frame.shadowTexels.w = far;
+        frame.shadowFlags.z = 1;
+    }
+}
+
+uint32_t ShadowMaps::drawCasters(const View& view, const std::vector<Caster>& casters) {
+    GLState& state = GLState::shared();
+    Frustum frustum = Frustum::fromMatrix(view.matrix);
+    UniformHandle model = m_depthProgram.uniform("model");
+    uint32_t drawn = 0;
+    for (auto& caster : casters) {
+        if (!reaches(frustum, caster.sphere, view.depthClamp))
+            continue;
+        m_depthProgram.setUniform(model, caster.model);
+        state.bindVertexArray(caster.mesh->getVertexArray());
+        caster.mesh->draw();
+        drawn++;
+    }
+    return drawn;
+}
+
+void ShadowMaps::renderView(uint32_t index, uint32_t slot) {
+    GLState& state = GLState::shared();
+    View& view = m_views[index];
+    ShadowViewStats& stats = m_viewStats[index];
+    glm::ivec2 tile = tileOf(index);
+
+    state.setEnabled(GL_DEPTH_CLAMP, view.depthClamp);
+    // Clears and copies stay within the tile.
+    glScissor(tile.x, tile.y, TILE_SIZE, TILE_SIZE);
+    m_depthProgram.setUniform("lightSpaceMatrix", view.matrix);
+    glBeginQuery(GL_SAMPLES_PASSED, m_queries[slot][index]);
+
+    bool stale = !view.cached || view.cachedMatrix != view.matrix;
+    if (stale) {
+        state.bindFramebuffer(m_cacheFbo);
+        state.viewport(tile.x, tile.y, TILE_SIZE, TILE_SIZE);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        stats.staticDraws = drawCasters(view, m_staticCasters);
+        view.cachedMatrix = view.matrix;
+        view.cached = true;
+        m_stats.staticRedraws++;
+    }
+
+    state.bindFramebuffer(m_atlasFbo);
+    if (stale || view.dirty) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_cacheFbo);
+        glBlitFramebuffer(tile.x, tile.y, tile.x + TILE_SIZE, tile.y + TILE_SIZE, tile.x, tile.y, tile.x + TILE_SIZE,
+            tile.y + TILE_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_atlasFbo);
+        stats.copiedTexels = TILE_SIZE * TILE_SIZE;
+    }
+    state.viewport(tile.x, tile.y, TILE_SIZE, TILE_SIZE);
+    stats.dynamicDraws = drawCasters(view, m_dynamicCasters);
+    view.dirty = stats.dynamicDraws > 0;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+    m_queryIssued[slot][index] = true;
+}
+
+void ShadowMaps::render(FrameData& frame, const ObjectPool& objects) {
+    GLState& state = GLState::shared();
+
+    // The queries of this slot were issued QUERIES frames ago; take their counts if the GPU is
+    // done, and keep the last counts otherwise.
+    uint32_t slot = m_frame++ % QUERIES;
+    for (uint32_t i = 0; i < VIEWS; i++) {
+        uint64_t fragments = m_viewStats[i].fragments;
+        if (m_queryIssued[slot][i]) {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(m_queries[slot][i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 samples = 0;
+                glGetQueryObjectui64v(m_queries[slot][i], GL_QUERY_RESULT, &samples);
+                fragments = samples;
+                m_queryIssued[slot][i] = false;
+            }
+        }
+        m_viewStats[i] = ShadowViewStats();
+        m_viewStats[i].fragments = fragments;
+        m_views[i].active = false;
+    }
+    m_stats = ShadowStats();
+
+    gatherCasters(objects);
+    if (m_staticChanged) {
+        // Maps not drawn this frame must notice too, once they are.
+        for (auto& view : m_views) {
+            view.cached = false;
+        }
+        m_staticChanged = false;
+    }
+    fitCascades(frame);
+    fitLights(frame);
+
+    state.enable(GL_DEPTH_TEST);
+    state.depthMask(true);
+    state.disable(GL_BLEND);
+    // Both sides of every caster: open meshes such as planes cast shadows either way.
+    state.disable(GL_CULL_FACE);
+    state.enable(GL_SCISSOR_TEST);
+    state.enable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(SLOPE_BIAS, CONSTANT_BIAS);
+    m_depthProgram.activate();
+
+    for (uint32_t i = 0; i < VIEWS; i++) {
+        if (m_views[i].active) {
+            renderView(i, slot);
+        }
+        else {
+            m_viewStats[i].fragments = 0;
+        }
+    }
+
+    glPolygonOffset(0.f, 0.f);
+    state.disable(GL_POLYGON_OFFSET_FILL);
+    state.disable(GL_SCISSOR_TEST);
+    state.disable(GL_DEPTH_CLAMP);
+    state.enable(GL_CULL_FACE);
+    state.bindTexture(SHADOW_ATLAS_UNIT, m_atlas);
+
+    for (uint32_t i = 0; i < SHADOW_CASCADES; i++) {
+        m_stats.cascades[i] = m_viewStats[i];
+    }
+    m_stats.spot = m_viewStats[SPOT_VIEW];
+    for (uint32_t i = POINT_VIEW; i < VIEWS; i++) {
+        m_stats.point.add(m_viewStats[i]);
+    }
+    m_stats.staticCasters = static_cast<uint32_t>(m_staticCasters.size());
+    m_stats.dynamicCasters = static_cast<uint32_t>(m_dynamicCasters.size());
+}
+
+const ShadowStats& ShadowMaps::stats() const {
+    return m_stats;
+}
@@ -0,0 +1,292 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <queue>
+
+SpatialGrid::SpatialGrid(float cellSize)
+    : m_cellSize(cellSize), m_invCellSize(1.f / cellSize) {
+}
+
+glm::ivec3 SpatialGrid::cellOf(const glm::vec3& p) const {
+    return glm::ivec3(glm::floor(p * m_invCellSize));
+}
+
+/**
+ * @brief Packs a cell coordinate into a hash key, 21 bits per axis.
+ */
+uint64_t SpatialGrid::keyOf(const glm::ivec3& cell) {
+    const uint64_t mask = (1u << 21) - 1;
+    const int64_t bias = 1 << 20;
+    return ((uint64_t)(cell.x + bias) & mask) |
+        (((uint64_t)(cell.y + bias) & mask) << 21) |
+        (((uint64_t)(cell.z + bias) & mask) << 42);
+}
+
+SpatialGrid::ItemId SpatialGrid::insert(const AABB& bounds, uint32_t userId) {
+    ItemId id;
+    if (!m_freeIds.empty()) {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    else {
+        id = static_cast<ItemId>(m_items.size());
+        m_items.emplace_back();
+    }
+
+    Item& item = m_items[id];
+    item.bounds = bounds;
+    item.userId = userId;
+    item.alive = true;
+    link(id);
+    m_count++;
+    return id;
+}
+
+void SpatialGrid::update(ItemId id, const AABB& bounds) {
+    Item& item = m_items[id];
+    glm::vec3 size = bounds.max - bounds.min;
+    bool large = std::max(size.x, std::max(size.y, size.z)) > m_cellSize;
+    uint64_t cell = keyOf(cellOf(bounds.center()));
+
+    item.bounds = bounds;
+    // Most moves stay within the same cell, and need nothing more.
+    if (large == item.large && (large || cell == item.cell))
+        return;
+
+    unlink(id);
+    link(id);
+}
+
+void SpatialGrid::remove(ItemId id) {
+    if (!m_items[id].alive)
+        return;
+
+    unlink(id);
+    m_items[id].alive = false;
+    m_freeIds.push_back(id);
+    m_count--;
+}
+
+size_t SpatialGrid::size() const {
+    return m_count;
+}
+
+const AABB& SpatialGrid::getBounds(ItemId id) const {
+    return m_items[id].bounds;
+}
+
+void SpatialGrid::link(ItemId id) {
+    Item& item = m_items[id];
+    glm::vec3 size = item.bounds.max - item.bounds.min;
+    item.large = std::max(size.x, std::max(size.y, size.z)) > m_cellSize;
+
+    std::vector<ItemId>* list;
+    if (item.large) {
+        list = &m_large;
+    }
+    else {
+        item.cell = keyOf(cellOf(item.bounds.center()));
+        list = &m_cells[item.cell];
+    }
+    item.slot = static_cast<uint32_t>(list->size());
+    list->push_back(id);
+}
+
+void SpatialGrid::unlink(ItemId id) {
+    Item& item = m_items[id];
+    auto cellIt = m_cells.end();
+    std::vector<ItemId>* list;
+    if (item.large) {
+        list = &m_large;
+    }
+    else {
+        cellIt = m_cells.find(item.cell);
+        list = &cellIt->second;
+    }
+
+    // Swap-remove, fixing up the slot of the item that moved into the hole.
+    ItemId last = list->back();
+    (*list)[item.slot] = last;
+    m_items[last].slot = item.slot;
+    list->pop_back();
+
+    if (cellIt != m_cells.end() && list->empty()) {
+        m_cells.erase(cellIt);
+    }
+}
+
+void SpatialGrid::forCandidates(const AABB& box, const std::function<void(ItemId)>& visit) const {
+    for (ItemId id : m_large) {
+        visit(id);
+    }
+
+    // Items can hang half a cell out of their own cell.
+    glm::vec3 loose(m_cellSize * 0.5f);
+    glm::ivec3 lo = cellOf(box.min - loose);
+    glm::ivec3 hi = cellOf(box.max + loose);
+
+    // A huge query box would visit far more cells than exist; just scan the occupied ones.
+    uint64_t span = (uint64_t)(hi.x - lo.x + 1) * (hi.y - lo.y + 1) * (hi.z - lo.z + 1);
+    if (span > m_cells.size()) {
+        AABB looseBox(box.min - loose, box.max + loose);
+        for (auto& cell : m_cells) {
+            for (ItemId id : cell.second) {
+                if (looseBox.contains(m_items[id].bounds.center())) {
+                    visit(id);
+                }
+            }
+        }
+        return;
+    }
+
+    for (int z = lo.z; z <= hi.z; z++) {
+        for (int y = lo.y; y <= hi.y; y++) {
+            for (int x = lo.x; x <= hi.x; x++) {
+                auto it = m_cells.find(keyOf(glm::ivec3(x, y, z)));
+                if (it == m_cells.end())
+                    continue;
+                for (ItemId id : it->second) {
+                    visit(id);
+                }
+            }
+        }
+    }
+}
+
+void SpatialGrid::queryBox(const AABB& box, const Visitor& visit) const {
+    forCandidates(box, [&](ItemId id) {
+        if (m_items[id].bounds.overlaps(box)) {
+            visit(m_items[id].userId);
+        }
+    });
+}
+
+/**
+ * @brief The squared distance from a point to the nearest point of a box (0 if inside).
+ */
+static float distanceSq(const AABB& box, const glm::vec3& p) {
+    glm::vec3 nearest = glm::clamp(p, box.min, box.max);
+    glm::vec3 d = p - nearest;
+    return glm::dot(d, d);
+}
+
+void SpatialGrid::querySphere(const glm::vec3& center, float radius, const Visitor& visit) const {
+    AABB box(center - glm::vec3(radius), center + glm::vec3(radius));
+    float radiusSq = radius * radius;
+    forCandidates(box, [&](ItemId id) {
+        if (distanceSq(m_items[id].bounds, center) <= radiusSq) {
+            visit(m_items[id].userId);
+        }
+    });
+}
+
+void SpatialGrid::queryFrustum(const Frustum& frustum, const Visitor& visit) const {
+    for (ItemId id : m_large) {
+        if (frustum.test(m_items[id].bounds) != Frustum::Result::Outside) {
+            visit(m_items[id].userId);
+        }
+    }
+
+    glm::vec3 loose(m_cellSize * 0.5f);
+    for (auto& cell : m_cells) {
+        // Reject the cell's whole (loose) region at once, where possible.
+        const AABB& first = m_items[cell.second.front()].bounds;
+        glm::vec3 cellMin = glm::floor(first.center() * m_invCellSize) * m_cellSize;
+        AABB cellBox(cellMin - loose, cellMin + glm::vec3(m_cellSize) + loose);
+        auto cellResult = frustum.test(cellBox);
+        if (cellResult == Frustum::Result::Outside)
+            continue;
+
+        for (ItemId id : cell.second) {
+            if (cellResult == Frustum::Result::Inside ||
+                frustum.test(m_items[id].bounds) != Frustum::Result::Outside) {
+                visit(m_items[id].userId);
+            }
+        }
+    }
+}
+
+std::vector<uint32_t> SpatialGrid::queryNearest(const glm::vec3& point, size_t k, float maxDistance) const {
+    if (k == 0)
+        return {};
+
+    // A max-heap of the best k so far, so the worst of them is on top.
+    using Candidate = std::pair<float, ItemId>;
+    std::priority_queue<Candidate> best;
+    float maxDistSq = maxDistance * maxDistance;
+
+    auto consider = [&](ItemId id) {
+        float d = distanceSq(m_items[id].bounds, point);
+        if (d > maxDistSq)
+            return;
+        if (best.size() < k) {
+            best.push({ d, id });
+        }
+        else if (d < best.top().first) {
+            best.pop();
+            best.push({ d, id });
+        }
+    };
+
+    for (ItemId id : m_large) {
+        consider(id);
+    }
+
+    auto considerCell = [&](int x, int y, int z) {
+        auto it = m_cells.find(keyOf(glm::ivec3(x, y, z)));
+        if (it == m_cells.end())
+            return;
+        for (ItemId id : it->second) {
+            consider(id);
+        }
+    };
+
+    // Visit the cells in rings of growing Chebyshev distance around the point's cell.
+    glm::ivec3 c = cellOf(point);
+    size_t cellsSearched = 0;
+    for (int ring = 0; ; ring++) {
+        // Nothing in this ring or beyond can be nearer than this.
+        float ringDist = std::max(0.f, (ring - 1.5f) * m_cellSize);
+        if (ringDist > maxDistance)
+            break;
+        if (best.size() == k && ringDist * ringDist > best.top().first)
+            break;
+
+        // Once the rings have covered more cells than are occupied, a linear scan of the
+        // occupied cells is cheaper than continuing outward.
+        cellsSearched += ring == 0 ? 1 : 24 * ring * ring + 2;
+        if (cellsSearched > m_cells.size()) {
+            best = std::priority_queue<Candidate>();
+            for (ItemId id : m_large) {
+                consider(id);
+            }
+            for (auto& cell : m_cells) {
+                for (ItemId id : cell.second) {
+                    consider(id);
+                }
+            }
+            break;
+        }
+
+        // Only the surface of each ring's cube is new.
+        for (int z = -ring; z <= ring; z++) {
+            for (int y = -ring; y <= ring; y++) {
+                if (std::abs(z) == ring || std::abs(y) == ring) {
+                    for (int x = -ring; x <= ring; x++) {
+                        considerCell(c.x + x, c.y + y, c.z + z);
+                    }
+                }
+                else {
+                    considerCell(c.x - ring, c.y + y, c.z + z);
+                    considerCell(c.x + ring, c.y + y, c.z + z);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> result(best.size());
+    for (size_t i = result.size(); i-- > 0;) {
+        result[i] = m_items[best.top().second].userId;
+        best.pop();
+    }
+    return result;
+}
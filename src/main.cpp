@@ -10,6 +10,7 @@ We now transform local space vertices to clip space using uniform matrices in th
 */
 #define _USE_MATH_DEFINES
 #include <glad/glad.h>
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <filesystem>
@@ -17,6 +18,19 @@ We now transform local space vertices to clip space using uniform matrices in th
 #include <math.h>
 
 #include "Framebuffer.h"
+#include "SpatialGrid.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "Raycast.h"
+#include "InstanceBatch.h"
+#include "RenderQueue.h"
+#include "GLState.h"
+#include "ProgramBinaryCache.h"
+#include "ShaderManager.h"
+#include "ShaderVariants.h"
+#include "DeferredRenderer.h"
+#include "LightClusters.h"
+#include "ShadowMaps.h"
 
 #include "Scene.cpp"
 
@@ -27,6 +41,94 @@ We now transform local space vertices to clip space using uniform matrices in th
 
 sf::Vector2<uint32_t> winSize = {1200, 800};
 
+// How hidden objects are culled; cycled with the P key.
+enum class OcclusionMode {
+    None,
+    Software,
+    HardwareConditional,
+    HardwareLastFrame,
+};
+
+const char* occlusionModeName(OcclusionMode mode) {
+    switch (mode) {
+        case OcclusionMode::None: return "none";
+        case OcclusionMode::Software: return "software";
+        case OcclusionMode::HardwareConditional: return "hw conditional";
+        case OcclusionMode::HardwareLastFrame: return "hw last frame";
+    }
+    return "";
+}
+
+// Draws per cascade, static over dynamic, and what the maps cost to fill, for the title.
+std::string shadowStatsText(const ShadowStats& stats) {
+    std::string text = " | shadow draws";
+    ShadowViewStats total;
+    for (auto& cascade : stats.cascades) {
+        text += " " + std::to_string(cascade.staticDraws) + "/" + std::to_string(cascade.dynamicDraws);
+        total.add(cascade);
+    }
+    total.add(stats.spot);
+    total.add(stats.point);
+    return text + " spot " + std::to_string(stats.spot.staticDraws + stats.spot.dynamicDraws) +
+        " point " + std::to_string(stats.point.staticDraws + stats.point.dynamicDraws) +
+        " fragments " + std::to_string(total.fragments) +
+        " copied " + std::to_string(total.copiedTexels) +
+        " redrawn " + std::to_string(stats.staticRedraws) +
+        " static " + std::to_string(stats.staticCasters) + " of " +
+        std::to_string(stats.staticCasters + stats.dynamicCasters);
+}
+
+// The world-space ray through a point on the screen, given in normalized device coordinates.
+void rayThroughScreen(const glm::mat4& inverseViewProjection, float ndcX, float ndcY,
+    glm::vec3& origin, glm::vec3& direction) {
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.f, 1.f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.f, 1.f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::vec3(farPoint) / farPoint.w - origin;
+}
+
+// Casts a grid of rays through the view, first on this thread and then across the workers,
+// and prints the throughput of each.
+void benchmarkRaycasts(const Raycaster& raycaster, ThreadPool& workers, const glm::mat4& viewProjection) {
+    const int gridSize = 512;
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    // Each run counts its own hits, so runs that disagree show up.
+    std::atomic<uint32_t> hits = 0;
+    auto castRow = [&](size_t y) {
+        uint32_t rowHits = 0;
+        for (int x = 0; x < gridSize; x++) {
+            glm::vec3 origin, direction;
+            rayThroughScreen(inverse, (x + 0.5f) / gridSize * 2.f - 1.f, (y + 0.5f) / gridSize * 2.f - 1.f,
+                origin, direction);
+            if (raycaster.raycast(origin, direction).hit) {
+                rowHits++;
+            }
+        }
+        hits += rowHits;
+    };
+
+    sf::Clock clock;
+    for (int y = 0; y < gridSize; y++) {
+        castRow(y);
+    }
+    float singleSeconds = clock.restart().asSeconds();
+    uint32_t singleHits = hits.exchange(0);
+    workers.parallelFor(gridSize, castRow);
+    float parallelSeconds = clock.restart().asSeconds();
+    uint32_t parallelHits = hits;
+
+    double rays = gridSize * gridSize;
+    std::cout << "raycast benchmark: " << raycaster.instanceCount() << " mesh instances, "
+        << raycaster.triangleCount() << " triangles, " << rays << " rays, "
+        << singleHits << " hits" << std::endl;
+    if (parallelHits != singleHits) {
+        std::cout << "ERROR: the parallel run hit " << parallelHits << " times, the single-threaded run "
+            << singleHits << " times" << std::endl;
+    }
+    std::cout << "  1 thread: " << rays / singleSeconds << " rays/s" << std::endl;
+    std::cout << "  " << workers.workerCount() + 1 << " threads: " << rays / parallelSeconds << " rays/s" << std::endl;
+}
+
 // uint32_t loadCubemap(vector<std::string> faces) {
 //     unsigned int textureID;
 //     glGenTextures(1, &textureID);
@@ -55,19 +157,6 @@ sf::Vector2<uint32_t> winSize = {1200, 800};
 //     return textureID;
 // }
 
-bool CheckCollision(Object3D& one, Object3D& two) {
-    bool collidedX = one.getPosition().x + one.getScale().x >= two.getPosition().x && two.getPosition().x + two.getScale().x >= one.getPosition().x;
-    bool collidedY = one.getPosition().y + one.getScale().y >= two.getPosition().y && two.getPosition().y + two.getScale().y >= one.getPosition().y;
-    bool collidedZ = one.getPosition().z + one.getScale().z >= two.getPosition().z && two.getPosition().z + two.getScale().z >= one.getPosition().z;
-
-    bool result = collidedX && collidedY && collidedZ;
-
-    if (result)
-        std::cout << "INFO: collision detected!" << std::endl;
-
-    return result;
-}
-
 int main() {
 	std::cout << std::filesystem::current_path() << std::endl;
 
@@ -87,30 +176,67 @@ int main() {
     winSize.x = window.getSize().x;
     winSize.y = window.getSize().y;
 	gladLoadGL();
+	// The 3.3 context gets program binaries from GL_ARB_get_program_binary, if at all.
+	ProgramBinaryCache::loadEntryPoints([](const char* name) {
+		return reinterpret_cast<void*>(sf::Context::getFunction(name));
+	});
 
     // === GL GLOBAL SETS ===
+    // State that is set often goes through GLState, which skips calls that change nothing.
     // DEPTH TEST
-	glEnable(GL_DEPTH_TEST);
+	GLState::shared().enable(GL_DEPTH_TEST);
 
     // STENCIL TEST
     /*glEnable(GL_STENCIL_TEST);*/
 
     // FACE CULLING
-	glEnable(GL_CULL_FACE);
+	GLState::shared().enable(GL_CULL_FACE);
     // NOTE(liam): could mess up models where front and back face must be visible
     glCullFace(GL_BACK);
 
-	// Inintialize scene objects.
-	auto myScene = Sanders();
-	// You can directly access specific objects in the scene using references.
-	// auto& firstObject = myScene.objects[0];
+	// Inintialize scene objects. Scenes are data files (see SceneFile.h); the assets they use
+	// stay cached, so loading another scene that shares them is quick.
+	SceneAssets sceneAssets;
+	sf::Clock loadClock;
+	// Programs are only submitted here, and the driver compiles them while the scene loads.
+	// finish() links them before anything uses them.
+    ShaderProgram fbs1 = FB_simpleShader();
+    ShaderProgram fbs2 = FB_sharpenShader();
+    ShaderProgram proxyProgram = simpleShader();
+    ShaderProgram instancedProgram = toonLightingInstancedShader();
+	auto myScene = loadScene("scenes/sanders.scene", sceneAssets);
+    // N switches the opaque meshes to deferred shading, lit by a field of point lights as
+    // well as the scene's own.
+    DeferredRenderer deferred(winSize.x, winSize.y);
+    bool useDeferred = false;
+    // H turns the shadows of the directional light off and on; T adds those of the spot and
+    // point lights.
+    ShadowMaps shadows;
+    bool useShadows = true;
+    bool useLightShadows = false;
+	ShaderManager::shared().finish();
+	// Meshes that the load registered but no object or cached asset kept.
+	MeshRegistry::shared().releaseUnused();
+	std::cout << "loaded scene in " << loadClock.getElapsedTime().asMilliseconds() << " ms" << std::endl;
+    // Programs linked on an earlier run come from the binary cache instead of being compiled.
+    const ProgramCacheStats& programCache = ProgramBinaryCache::shared().stats();
+    std::cout << "programs: " << programCache.hits << " from the binary cache, " << programCache.misses
+        << " compiled (" << programCache.rejected << " cached binaries rejected), "
+        << ShaderManager::shared().stats().failures << " failed" << std::endl;
+	MeshMemoryStats meshMemory = MeshRegistry::shared().stats();
+	std::cout << meshMemory.uniqueMeshes << " unique meshes (" << meshMemory.gpuBytes / 1024 << " KB on the GPU) used "
+		<< meshMemory.references << " times (" << meshMemory.unsharedGpuBytes / 1024 << " KB if unshared)" << std::endl;
+	GeometryArenaStats arena = GeometryArena::shared().stats();
+	std::cout << "geometry arena: " << arena.pages << " pages, " << arena.usedGpuBytes / 1024 << " of "
+		<< arena.gpuBytes / 1024 << " KB used (" << int(arena.occupancy() * 100) << "%), "
+		<< int(arena.fragmentation() * 100) << "% fragmented" << std::endl;
+	// You can access specific objects in the scene through their handles.
+	// auto& firstObject = myScene.objects.at(myScene.named.at("floor"));
 
 	// Activate the shader program.
 	myScene.program.activate();
 
     bool edgeShading = false;
-    ShaderProgram fbs1 = FB_simpleShader();
-    ShaderProgram fbs2 = FB_sharpenShader();
     fbs1.activate();
     fbs1.setUniform("screenTexture", 0);
     fbs2.activate();
@@ -125,6 +251,82 @@ int main() {
 	sf::Clock c;
 	auto last = c.getElapsedTime();
 
+    // Occluders such as walls are rasterized on the worker threads each frame, and objects
+    // hidden behind them are skipped.
+    ThreadPool workers;
+    OcclusionCuller occlusion(workers);
+    // Alternatively, the GPU tests each object's bounding box with an occlusion query.
+    OcclusionQueries occlusionQueries(proxyProgram);
+    OcclusionMode occlusionMode = OcclusionMode::Software;
+
+    // Ray casts against the scene's triangles: F picks whatever is under the crosshair, and
+    // R benchmarks ray throughput. The raycaster is rebuilt when one of them is requested.
+    Raycaster raycaster(workers);
+    bool pickRequested = false;
+    bool benchmarkRequested = false;
+
+    // B toggles a field of instanced bunnies, drawn with one draw call per bunny mesh.
+    std::optional<InstanceBatch> bunnies;
+    bool showBunnies = false;
+
+    // Per-frame camera and light data, shared by all lighting shaders.
+    FrameUniformBuffer frameUniforms;
+
+    // Visible meshes are sorted by state and depth before they are drawn, and their model
+    // matrices and materials are streamed to the GPU in one write per frame.
+    RenderQueue renderQueue(true);
+    RenderQueueStats queueStats;
+
+    // Meshes without a normal or specular map are drawn with cheaper variants of the scene's
+    // program, built the first time one is needed. V turns them off and on.
+    ShaderVariants sceneVariants(myScene.program);
+    bool useVariants = ShaderVariants::supports(myScene.program);
+
+    // A 16x16 grid of small colored point lights over the floor, and a ring of spot lights
+    // looking down on it, lit either by the deferred path or by the clustered forward one.
+    std::vector<FramePointLight> lightField;
+    for (int x = 0; x < 16; x++) {
+        for (int z = 0; z < 16; z++) {
+            FramePointLight light{};
+            light.position = glm::vec3((x - 7.5f) * 3.0f, 1.0f, (z - 7.5f) * 3.0f);
+            light.constant = 1.0f;
+            light.linear = 0.7f;
+            light.quadratic = 1.8f;
+            glm::vec3 color(0.5f + 0.5f * std::sin(x * 0.9f), 0.5f + 0.5f * std::sin(z * 1.3f + 2.0f),
+                0.5f + 0.5f * std::sin((x + z) * 0.7f + 4.0f));
+            light.diffuse = color;
+            light.specular = color;
+            lightField.push_back(light);
+        }
+    }
+    std::vector<FrameSpotLight> spotField;
+    for (int i = 0; i < 12; i++) {
+        float angle = glm::radians(i * 30.0f);
+        FrameSpotLight light{};
+        light.position = glm::vec3(std::cos(angle) * 18.0f, 8.0f, std::sin(angle) * 18.0f);
+        light.direction = glm::normalize(glm::vec3(-std::cos(angle), -1.5f, -std::sin(angle)));
+        light.cutOff = std::cos(glm::radians(15.0f));
+        light.outerCutOff = std::cos(glm::radians(20.0f));
+        light.constant = 1.0f;
+        light.linear = 0.09f;
+        light.quadratic = 0.032f;
+        light.diffuse = glm::vec3(1.0f, 0.9f, 0.7f);
+        light.specular = light.diffuse;
+        spotField.push_back(light);
+    }
+    // The deferred path lights the grid and the scene's own point light, which goes last and
+    // is refreshed every frame.
+    std::vector<FramePointLight> deferredLights = lightField;
+    deferredLights.emplace_back();
+    // C lights forward-shaded meshes with the grid and the ring too, through a grid of
+    // clusters built on the workers each frame.
+    LightClusters lightClusters(workers);
+    bool useClusters = false;
+
+    // Culling results for the last frame, shown in the window title twice per second.
+    CullStats cullStats;
+    float statsTimer = 0.0f;
+
 	// Start the animators.
 	// for (auto& anim : myScene.animators) {
 	// 	anim.start();
@@ -138,11 +340,44 @@ int main() {
 
     bool moveHeld = false;
 
-    Object3D& floor = myScene.objects[0];
-    Object3D& wall = myScene.objects[1];
-    Object3D& player = myScene.objects[2];
+    const ObjectHandle playerHandle = myScene.named.at("player");
+    const ObjectHandle lampHandle = myScene.named.at("lamp");
+    const ObjectHandle floorHandle = myScene.named.at("floor");
+    const ObjectHandle wallHandle = myScene.named.at("wall");
     auto& backflip = myScene.animators[0];
 
+    // Every top-level object is indexed by the spatial grid, whose user id is its object pool slot.
+    // The table of grid items follows the pool as it grows, and objects created since the last
+    // refresh are inserted then.
+    struct GridEntry {
+        SpatialGrid::ItemId item = 0;
+        uint32_t generation = 0;
+        bool inserted = false;
+    };
+    SpatialGrid grid;
+    std::vector<GridEntry> gridItems;
+    auto refreshGrid = [&]() {
+        if (gridItems.size() < myScene.objects.capacity()) {
+            gridItems.resize(myScene.objects.capacity());
+        }
+        for (auto it = myScene.objects.begin(); it != myScene.objects.end(); ++it) {
+            ObjectHandle h = it.handle();
+            bool moved = it->updateBounds();
+            GridEntry& entry = gridItems[h.index];
+            if (!entry.inserted || entry.generation != h.generation) {
+                // A slot reused without its old item being removed still holds that item.
+                if (entry.inserted) {
+                    grid.remove(entry.item);
+                }
+                entry = { grid.insert(it->getBounds(), h.index), h.generation, true };
+            }
+            else if (moved) {
+                grid.update(entry.item, it->getBounds());
+            }
+        }
+    };
+    refreshGrid();
+
     // center the mouse initially.
     sf::Vector2<int> centerPosition = {(int)winSize.x / 2, (int)winSize.y / 2};
     sf::Vector2<int> mousePosition = {};
@@ -169,6 +404,7 @@ int main() {
                 window.setSize({ winSize.x, winSize.y });
 
                 fb.Resize();
+                deferred.resize();
 
                 myScene.camera.RequestPerspective();
             }
@@ -184,6 +420,40 @@ int main() {
                     myScene.camera.ProcessMouseScroll(ev.mouseWheelScroll.delta);
                 }
             }
+            else if (ev.type == sf::Event::KeyPressed) {
+                if (ev.key.code == sf::Keyboard::P) {
+                    occlusionMode = static_cast<OcclusionMode>((static_cast<int>(occlusionMode) + 1) % 4);
+                }
+                else if (ev.key.code == sf::Keyboard::F) {
+                    pickRequested = true;
+                }
+                else if (ev.key.code == sf::Keyboard::R) {
+                    benchmarkRequested = true;
+                }
+                else if (ev.key.code == sf::Keyboard::B) {
+                    showBunnies = !showBunnies;
+                }
+                else if (ev.key.code == sf::Keyboard::G) {
+                    GLState::shared().setDebug(!GLState::shared().isDebug());
+                }
+                else if (ev.key.code == sf::Keyboard::V && ShaderVariants::supports(myScene.program)) {
+                    useVariants = !useVariants;
+                }
+                else if (ev.key.code == sf::Keyboard::N) {
+                    useDeferred = !useDeferred;
+                }
+                else if (ev.key.code == sf::Keyboard::C) {
+                    useClusters = !useClusters;
+                }
+                else if (ev.key.code == sf::Keyboard::H) {
+                    useShadows = !useShadows;
+                }
+                else if (ev.key.code == sf::Keyboard::T) {
+                    useLightShadows = !useLightShadows;
+                    shadows.setSpotShadows(useLightShadows);
+                    shadows.setPointShadows(useLightShadows);
+                }
+            }
         }
 #else
         while (const std::optional ev = window.pollEvent()) {
@@ -200,6 +470,7 @@ int main() {
                 window.setSize(winSize);
 
                 fb.Resize();
+                deferred.resize();
 
                 myScene.camera.RequestPerspective();
             }
@@ -214,6 +485,40 @@ int main() {
                 if (msScrolled->wheel == sf::Mouse::Wheel::Vertical) {
                     myScene.camera.ProcessMouseScroll(msScrolled->delta);
                 }
+            }
+            else if (const auto* keyPressed = ev->getIf<sf::Event::KeyPressed>()) {
+                if (keyPressed->code == sf::Keyboard::Key::P) {
+                    occlusionMode = static_cast<OcclusionMode>((static_cast<int>(occlusionMode) + 1) % 4);
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::F) {
+                    pickRequested = true;
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::R) {
+                    benchmarkRequested = true;
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::B) {
+                    showBunnies = !showBunnies;
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::G) {
+                    GLState::shared().setDebug(!GLState::shared().isDebug());
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::V && ShaderVariants::supports(myScene.program)) {
+                    useVariants = !useVariants;
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::N) {
+                    useDeferred = !useDeferred;
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::C) {
+                    useClusters = !useClusters;
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::H) {
+                    useShadows = !useShadows;
+                }
+                else if (keyPressed->code == sf::Keyboard::Key::T) {
+                    useLightShadows = !useLightShadows;
+                    shadows.setSpotShadows(useLightShadows);
+                    shadows.setPointShadows(useLightShadows);
+                }
             }
 		}
 #endif
@@ -227,6 +532,9 @@ int main() {
             sf::Mouse::setPosition(sf::Vector2<int>(winSize.x / 2, winSize.y / 2), window);
         }
 
+        // The player is never eaten, so at() can't throw here.
+        Object3D& player = myScene.objects.at(playerHandle);
+
         // === INPUT ===
 
         if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Space)) {
@@ -235,7 +543,7 @@ int main() {
                     // for (auto& anim : myScene.animators) {
                     //     anim.start();
                     // }
-                    myScene.camera.SetTarget(&player.getPosition());
+                    myScene.camera.SetTarget(player.getPosition());
                 }
                 else {
                     myScene.camera.DropTarget();
@@ -348,13 +656,15 @@ int main() {
             myScene.camera.ProcessKeyboard(direction, dt);
             moveHeld = false;
             // keeps floor below player
-            // myScene.objects[0].setPosition(glm::vec3(player.getPosition().x, 0, player.getPosition().z));
+            // myScene.objects.at(floorHandle).setPosition(glm::vec3(player.getPosition().x, 0, player.getPosition().z));
         }
 
         // === UPDATE ===
 
-        // point light is attached to thung
-        myScene.plight.position = myScene.objects[3].getPosition() + glm::vec3(0, 0.5f, 0);
+        // point light is attached to the lamp object, until it is eaten
+        if (const Object3D* lamp = myScene.objects.get(lampHandle)) {
+            myScene.plight.position = lamp->getPosition() + glm::vec3(0, 0.5f, 0);
+        }
 
         if (targetLockCooldown > 0.0) {
             targetLockCooldown -= dt;
@@ -378,37 +688,82 @@ int main() {
         player.setRotAcceleration(totalRotAcceleration);
         player.setOrientation(facing);
 
+        if (myScene.camera.target) {
+            myScene.camera.MoveTarget(player.getPosition());
+        }
         myScene.camera.update((float)winSize.x, (float)winSize.y, dt);
 
 		// Update the scene.
-        // for (auto& o : myScene.objects) {
-        for (int i = 0; i < myScene.objects.size(); i++) {
-            auto& o = myScene.objects[i];
-
-            // skip checking player and floor and wall
-            if (&o == &player || &o == &floor || &o == &wall);
-            else if (o.getDisplay() and CheckCollision(player, o)) {
-                // if (&o == &wall) {
-                //     player.setVelocity(-player.getVelocity());
-                // }
-                // else
-                {
-                    player.grow(player.getScale() + o.getScale() + glm::vec3(0.25));
-                    o.setDisplay(false);
-                }
-            }
-
+        for (auto& o : myScene.objects) {
             o.tick(dt);
         }
 
 		for (auto& anim : myScene.animators) {
-			anim.tick(dt);
+			anim.tick(dt, myScene.objects);
 		}
 
+        // Refresh the bounds of whatever moved, then let the player eat anything it touches,
+        // other than the floor and wall.
+        refreshGrid();
+        std::vector<ObjectHandle> eaten;
+        grid.queryBox(player.getBounds(), [&](uint32_t slot) {
+            ObjectHandle h = myScene.objects.handleAt(slot);
+            if (h != playerHandle && h != floorHandle && h != wallHandle) {
+                eaten.push_back(h);
+            }
+        });
+        // Eaten objects are destroyed outright, so they no longer cost anything.
+        for (ObjectHandle h : eaten) {
+            player.grow(player.getScale() + myScene.objects.at(h).getScale() + glm::vec3(0.25));
+            grid.remove(gridItems[h.index].item);
+            gridItems[h.index].inserted = false;
+            myScene.objects.destroy(h);
+        }
+
+        if (pickRequested || benchmarkRequested) {
+            glm::mat4 cameraViewProjection = myScene.camera.perspective * myScene.camera.view;
+            raycaster.build(myScene.objects);
+
+            if (pickRequested) {
+                glm::vec3 origin, direction;
+                rayThroughScreen(glm::inverse(cameraViewProjection), 0.f, 0.f, origin, direction);
+                RayHit hit = raycaster.raycast(origin, direction);
+                if (hit.hit) {
+                    std::cout << "picked object " << hit.object.index << " (" << myScene.objects.at(hit.object).getName()
+                        << "), mesh " << hit.mesh << ", triangle " << hit.triangle
+                        << ", at distance " << hit.distance << std::endl;
+                }
+                else {
+                    std::cout << "picked nothing" << std::endl;
+                }
+            }
+            if (benchmarkRequested) {
+                benchmarkRaycasts(raycaster, workers, cameraViewProjection);
+            }
+            pickRequested = false;
+            benchmarkRequested = false;
+        }
+
+        // Programs whose shader files changed are rebuilt, and swapped in once they link.
+        ShaderManager::shared().update();
+
         // === RENDER ===
         // sends render calls to Texture map.
         // also clears the textures
         // and enables certain tests automatically
+        GLState::shared().stats().reset();
+
+        // The camera and lights reach every lighting shader through one buffer write.
+        FrameData frameData = sceneFrameData(myScene);
+        if (useClusters) {
+            lightClusters.build(frameData, winSize.x, winSize.y, lightField, spotField);
+        }
+        // The shadow maps are drawn first, since they leave their own framebuffer bound.
+        if (useShadows) {
+            shadows.render(frameData, myScene.objects);
+        }
+        frameUniforms.update(frameData);
+
         fb.RenderOnTexture();
         // fb.RenderOnScreen();
         // fb.Clear();
@@ -417,18 +772,100 @@ int main() {
         /*glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);*/
         // disables writing to stencil buffer by default
         /*glStencilMask(0x00);*/
+        // Lights that are off are left out of the variants.
+        sceneVariants.setLights(ShaderVariants::lightFeatures(frameData));
+        if (useVariants) {
+            renderQueue.addVariants(sceneVariants);
+        }
+        else {
+            renderQueue.removeVariants(sceneVariants);
+        }
+        // The hardware occlusion modes draw objects as they go rather than through the queue,
+        // so they stay forward-shaded.
+        bool deferredFrame = useDeferred && (occlusionMode == OcclusionMode::None
+            || occlusionMode == OcclusionMode::Software);
+        if (deferredFrame) {
+            deferred.attach(renderQueue, myScene.program);
+            deferredLights.back() = frameData.pointLight;
+        }
+        else {
+            deferred.detach(renderQueue);
+        }
 
         // render scene to texture buffer
         myScene.program.activate();
 
         /*glCullFace(GL_FRONT);*/
         GLSetCameraUniform(myScene);
-		// Render the scene objects.
-		for (auto& o : myScene.objects) {
-			o.render(myScene.program);
-		}
+		// Render the scene objects that the camera can see.
+        glm::mat4 viewProjection = myScene.camera.perspective * myScene.camera.view;
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+
+        cullStats.reset();
+        queueStats.reset();
+        ShaderProgram::stats().reset();
+        renderQueue.begin(myScene.camera.view);
+        if (occlusionMode == OcclusionMode::Software) {
+            occlusion.beginFrame(viewProjection);
+            for (auto& o : myScene.objects) {
+                o.addOccluders(occlusion);
+            }
+            occlusion.rasterize();
+
+            for (auto& o : myScene.objects) {
+                o.render(renderQueue, myScene.program, frustum, cullStats, &occlusion);
+            }
+        }
+        else if (occlusionMode == OcclusionMode::None) {
+            for (auto& o : myScene.objects) {
+                o.render(renderQueue, myScene.program, frustum, cullStats);
+            }
+        }
+        else {
+            occlusionQueries.setMode(occlusionMode == OcclusionMode::HardwareConditional
+                ? OcclusionQueries::Mode::Conditional : OcclusionQueries::Mode::LastFrame);
+            occlusionQueries.render(myScene.objects, myScene.program, frustum, cullStats,
+                myScene.camera.view, myScene.camera.perspective, myScene.camera.position);
+        }
         /*glCullFace(GL_BACK);*/
 
+        // Opaque meshes go to the G-buffer and are lit into the framebuffer, ahead of everything
+        // forward-shaded.
+        if (deferredFrame) {
+            deferred.beginGeometry();
+            renderQueue.submit(queueStats, RenderPass::Opaque);
+            deferred.shade(fb, frameData, deferredLights);
+        }
+
+        if (showBunnies) {
+            if (!bunnies) {
+                bunnies.emplace(sceneAssets.model("models/bunny_textured.obj", true, false));
+                // A 150x150 grid around the origin, in a spread of colors and sizes.
+                const int side = 150;
+                for (int x = 0; x < side; x++) {
+                    for (int z = 0; z < side; z++) {
+                        glm::vec3 position((x - side / 2) * 4.0f, 0.0f, (z - side / 2) * 4.0f);
+                        float size = 6.0f + 4.0f * ((x * 7 + z * 13) % 10) / 10.0f;
+                        glm::mat4 model = glm::translate(glm::mat4(1), position);
+                        model = glm::rotate(model, (x * 31 + z * 17) * 0.1f, glm::vec3(0, 1, 0));
+                        model = glm::scale(model, glm::vec3(size));
+                        glm::vec3 tint(0.6f + 0.4f * (x % 5) / 4.0f, 0.6f + 0.4f * (z % 5) / 4.0f, 1.0f);
+                        bunnies->add(model, glm::vec4(tint, 4.0f));
+                    }
+                }
+            }
+            instancedProgram.activate();
+            bunnies->render(instancedProgram, frustum, cullStats);
+        }
+
+        // Opaque meshes first, nearest first; then transparent ones, over everything opaque.
+        if (deferredFrame) {
+            renderQueue.submit(queueStats, RenderPass::Transparent);
+        }
+        else {
+            renderQueue.submit(queueStats);
+        }
+
         // enables writing to stencil buffer
         /*glStencilFunc(GL_ALWAYS, 1, 0xFF);*/
         /*glStencilMask(0xFF);*/
@@ -456,7 +893,45 @@ int main() {
         fb.TextureToScreen();
 
 		window.display();
+
+        statsTimer += dt;
+        if (statsTimer >= 0.5f) {
+            statsTimer = 0.0f;
+            window.setTitle("Modern OpenGL | occlusion " + std::string(occlusionModeName(occlusionMode)) +
+                " | visible " + std::to_string(cullStats.visibleObjects) +
+                " culled " + std::to_string(cullStats.culledSubtrees) +
+                " occluded " + std::to_string(cullStats.occludedSubtrees) +
+                " meshes " + std::to_string(cullStats.drawnMeshes) +
+                " | state changes " + std::to_string(queueStats.stateChanges()) +
+                " avoided " + std::to_string(queueStats.avoidedStateChanges()) +
+                " | draw calls " + std::to_string(queueStats.drawCalls) +
+                (useVariants ? " | variants " + std::to_string(sceneVariants.stats().variants) : std::string()) +
+                (deferredFrame
+                    ? " | lights " + std::to_string(deferred.stats().drawnLights) +
+                    " of " + std::to_string(deferred.stats().pointLights) +
+                    " lit fragments " + std::to_string(deferred.stats().litFragments)
+                    : std::string()) +
+                (useClusters
+                    ? " | clustered lights " + std::to_string(lightClusters.stats().visibleLights) +
+                    " of " + std::to_string(lightClusters.stats().lights) +
+                    " indices " + std::to_string(lightClusters.stats().indices) +
+                    " max " + std::to_string(lightClusters.stats().maxClusterLights) +
+                    " in " + std::to_string(lightClusters.stats().assignMs) + " ms"
+                    : std::string()) +
+                (useShadows ? shadowStatsText(shadows.stats()) : std::string()) +
+                " | uniforms " + std::to_string(ShaderProgram::stats().uploads) +
+                " skipped " + std::to_string(ShaderProgram::stats().skippedUploads) +
+                (GLState::shared().isDebug()
+                    ? " | gl calls " + std::to_string(GLState::shared().stats().issued) +
+                    " skipped " + std::to_string(GLState::shared().stats().skipped) +
+                    " mismatched " + std::to_string(GLState::shared().stats().mismatches)
+                    : std::string()));
+        }
 	}
+    // The shared registry and arena outlive main(), and with it the GL context, so their GPU
+    // memory is freed now.
+    MeshRegistry::shared().clear();
+    GeometryArena::shared().releaseBuffers();
     window.close();
 	return 0;
 }